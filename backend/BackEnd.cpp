@@ -16,4 +16,11 @@ FortranOutput::FortranOutput(std::ostream& os) : Output(os) {
     lineLen = 0;
 }
 
+void FortranOutput::append(std::istream& is) {
+    // inserting an empty stream would fail os
+    if (is.peek() != std::char_traits<char>::eof())
+        os << is.rdbuf();
+    lineLen = 0;
+}
+
 LatexOutput::LatexOutput(std::ostream &os) : Output(os) { }
@@ -32,6 +32,9 @@ class FortranOutput : public Output {
     public:
         FortranOutput(std::ostream&);
 
+        /// appends the text written by another output (whole lines)
+        void append(std::istream&);
+
         inline FortranOutput& operator<<(const std::string& str) {
             checkLineLen(str);
             lineLen += str.length();
@@ -48,6 +51,9 @@ class FortranOutput : public Output {
             os << str;
             return (*this);
         }
+        inline FortranOutput& operator<<(const ir::Name& n) {
+            return (*this) << n.str();
+        }
         template <typename T>
         inline FortranOutput& operator<<(const T& t) {
             checkLineLen(std::to_string(t));
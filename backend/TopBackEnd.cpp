@@ -7,6 +7,10 @@
 #include <cstring>
 #include <cstdlib>
 
+extern "C" {
+#include <unistd.h>
+}
+
 #define unsupported(e) { \
     err << __FILE__ << ":" << __LINE__ << " unsupported expr\n"; \
     e->display("unsupported expr:"); \
@@ -27,33 +31,39 @@ ir::Identifier fp("fp");
 ir::Identifier l("l");
 ir::UnaryExpr ll(&l, '\'');
 
-const std::map<std::string, ir::Symbol *>
+// names the backend looks for (interned once)
+static const ir::Name avgName("avg");
+static const ir::Name drName("dr");
+static const ir::Name rName("r");
+
+const std::map<std::string, ir::Param>
     TopBackEnd::internalVariables = {
-        {"shift",   new ir::Param("shift",      "double")},
-        {"l",       new ir::Param("l",          "int")},
-        {"m",       new ir::Param("m",          "int")},
-        {"iparity", new ir::Param("iparity",    "int")},
-        {"lh",      new ir::Param("lh",         "int")},
-        {"lres",    new ir::Param("lres",       "int")},
-        {"orderFD", new ir::Param("orderFD",    "int")},
-        {"nsol",    new ir::Param("nsol",       "int")},
+        {"shift",   ir::Param("shift",      "double")},
+        {"l",       ir::Param("l",          "int")},
+        {"m",       ir::Param("m",          "int")},
+        {"iparity", ir::Param("iparity",    "int")},
+        {"lh",      ir::Param("lh",         "int")},
+        {"lres",    ir::Param("lres",       "int")},
+        {"orderFD", ir::Param("orderFD",    "int")},
+        {"nsol",    ir::Param("nsol",       "int")},
     };
 
 LlExpr::LlExpr(int ivar, ir::Expr *expr) {
     this->ivar = ivar;
     this->expr = expr;
 
-    if (auto be = dynamic_cast<ir::BinExpr *>(expr->getParent())) {
+    if (auto be = ir::dyn_cast<ir::BinExpr>(expr->getParent())) {
         this->op = be->getOp();
     }
+    else if (auto ne = ir::dyn_cast<ir::NaryExpr>(expr->getParent())) {
+        this->op = ne->getOp();
+    }
     else {
         logger::warn << "Could not find llExpr parents\n";
         this->op = '*';
         // exit(EXIT_FAILURE);
     }
 
-    auto ids = getIds(expr);
-
     if (expr->contains(ll))
         this->type = "ll";
     else if (expr->contains(l))
@@ -91,79 +101,113 @@ void TopBackEnd::emitExpr(ir::Expr *expr, FortranOutput& fo,
         return;
     }
 
-    if (auto be = dynamic_cast<ir::BinExpr *>(expr)) {
-        fo << "(";
-        emitExpr(be->getLeftOp(), fo, ivar, ieq, emitLlExpr, bcLocation);
-        switch (be->getOp()) {
-            case '^':
-                fo << "**";
-                break;
-            default:
-                fo << be->getOp();
-        }
-        emitExpr(be->getRightOp(), fo, ivar, ieq, emitLlExpr, bcLocation);
-        fo << ")";
-    }
-    else if (auto ue = dynamic_cast<ir::UnaryExpr *>(expr)) {
-        if (ue->getOp() == '\'') {
-            err << "should not happen since radial derivatives " <<
-                "where replaced with DiffExpr\n";
-            exit(EXIT_FAILURE);
-        }
-        fo << ue->getOp() << "(";
-        emitExpr(ue->getExpr(), fo, ivar, ieq, emitLlExpr, bcLocation);
-        fo << ")";
-    }
-    else if (auto fc = dynamic_cast<ir::FuncCall *>(expr)) {
-        int narg = 0;
-        fo << fc->name;
-        fo << "(";
-        for (auto a: fc->getArgs()) {
-            if (narg++ > 0)
-                fo << ", ";
-            emitExpr(a, fo, ivar, ieq, emitLlExpr, bcLocation);
+    switch (expr->getKind()) {
+        case ir::BINARY:
+        case ir::INDEX_RANGE: {
+            ir::BinExpr *be = static_cast<ir::BinExpr *>(expr);
+            fo << "(";
+            emitExpr(be->getLeftOp(), fo, ivar, ieq, emitLlExpr, bcLocation);
+            switch (be->getOp()) {
+                case '^':
+                    fo << "**";
+                    break;
+                default:
+                    fo << be->getOp();
+            }
+            emitExpr(be->getRightOp(), fo, ivar, ieq, emitLlExpr, bcLocation);
+            fo << ")";
+            break;
         }
-        fo << ")";
-    }
-    else if (auto id = dynamic_cast<ir::Identifier *>(expr)) {
-        if (isDef(id->name)) {
-            fo << id->name;
-            if (bcLocation != "" && isField(id->name)) {
-                if (this->dim == 1)
-                    fo << "(" << bcLocation << ")";
-                else if (this->dim == 2)
-                    fo << "(" << bcLocation << ", 1:lres)";
-                else {
-                    err << "Dimension " << this->dim << " not supported\n";
-                    exit(EXIT_FAILURE);
+        case ir::SUM:
+        case ir::PRODUCT: {
+            ir::NaryExpr *ne = static_cast<ir::NaryExpr *>(expr);
+            fo << "(";
+            for (int i=0; i<ne->getNOperands(); i++) {
+                ir::ScalarExpr *op = ne->getOperand(i);
+                auto ue = ir::dyn_cast<ir::UnaryExpr>(op);
+                if (i > 0 && ne->getOp() == '+' && ue && ue->getOp() == '-') {
+                    // subtracted term
+                    fo << "-";
+                    op = ue->getExpr();
+                }
+                else if (i > 0) {
+                    fo << ne->getOp();
                 }
+                emitExpr(op, fo, ivar, ieq, emitLlExpr, bcLocation);
             }
+            fo << ")";
+            break;
         }
-        else {
-            if (id->srcLoc != "unknown")
-                err << id->srcLoc << ": " <<
-                    "`" << id->name << "\' is undefined\n";
-            else
-                err << "`" << id->name << "\' is undefined\n";
-            exit(EXIT_FAILURE);
+        case ir::UNARY: {
+            ir::UnaryExpr *ue = static_cast<ir::UnaryExpr *>(expr);
+            if (ue->getOp() == '\'') {
+                err << "should not happen since radial derivatives " <<
+                    "where replaced with DiffExpr\n";
+                exit(EXIT_FAILURE);
+            }
+            fo << ue->getOp() << "(";
+            emitExpr(ue->getExpr(), fo, ivar, ieq, emitLlExpr, bcLocation);
+            fo << ")";
+            break;
         }
-    }
-    else if (auto v = dynamic_cast<ir::Value<int> *>(expr)) {
-        fo << v->getValue();
-    }
-    else if (auto v = dynamic_cast<ir::Value<float> *>(expr)) {
-        fo << v->getValue() << "d0";
-    }
-    else {
-        unsupported(expr);
+        case ir::FUNC_CALL: {
+            ir::FuncCall *fc = static_cast<ir::FuncCall *>(expr);
+            int narg = 0;
+            fo << fc->name;
+            fo << "(";
+            for (auto a: fc->getArgs()) {
+                if (narg++ > 0)
+                    fo << ", ";
+                emitExpr(a, fo, ivar, ieq, emitLlExpr, bcLocation);
+            }
+            fo << ")";
+            break;
+        }
+        case ir::IDENTIFIER:
+        case ir::ARRAY: {
+            ir::Identifier *id = static_cast<ir::Identifier *>(expr);
+            if (isDef(id)) {
+                fo << id->name;
+                if (bcLocation != "" && isField(id)) {
+                    if (this->dim == 1)
+                        fo << "(" << bcLocation << ")";
+                    else if (this->dim == 2)
+                        fo << "(" << bcLocation << ", 1:lres)";
+                    else {
+                        err << "Dimension " << this->dim << " not supported\n";
+                        exit(EXIT_FAILURE);
+                    }
+                }
+            }
+            else {
+                if (id->srcLoc.isKnown())
+                    err << id->srcLoc.str() << ": " <<
+                        "`" << id->name << "\' is undefined\n";
+                else
+                    err << "`" << id->name << "\' is undefined\n";
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case ir::INT_VALUE:
+            fo << static_cast<ir::Value<int> *>(expr)->getValue();
+            break;
+        case ir::FLOAT_VALUE:
+            fo << static_cast<ir::Value<float> *>(expr)->getValue() << "d0";
+            break;
+        default:
+            unsupported(expr);
     }
 }
 
-Term::Term(ir::Expr *expr, ir::Expr *llTerm, ir::Symbol var,
+Term::Term(ir::Expr *expr, ir::Expr *llTerm, ir::Variable var,
                 int power, std::string der, int ivar, std::string varName,
                 TopBackEnd* backend) : var(var) {
     this->backend = backend;
     this->expr = expr;
+    this->avg = NULL;
+    this->nAvgs = 0;
+    this->avgUnhandled = NULL;
     if (llTerm)
         this->llExpr = new LlExpr(ivar, llTerm);
     else
@@ -176,14 +220,21 @@ Term::Term(ir::Expr *expr, ir::Expr *llTerm, ir::Symbol var,
     this->idx = 0;
 }
 
-TopBackEnd *Term::getBackend() {
+TopBackEnd *Term::getBackend() const {
     return backend;
 }
 
-TermBC::TermBC(Term t) : Term(t.expr, NULL, t.var, t.power, t.der, t.ivar, t.varName,
-        t.getBackend()) {
+Term::~Term() {
+    delete llExpr;
+}
+
+TermBC::TermBC(const Term& t) : Term(t.expr, NULL, t.var, t.power, t.der,
+        t.ivar, t.varName, t.getBackend()) {
     if (t.llExpr)
         this->llExpr = new LlExpr(t.ivar, t.llExpr->expr);
+    avg = t.avg;
+    nAvgs = t.nAvgs;
+    avgUnhandled = t.avgUnhandled;
     varLoc = "1";
     eqLoc = "1";
 }
@@ -275,48 +326,49 @@ std::string Term::getMatrix(IndexType it) {
     exit(EXIT_FAILURE);
 }
 
+static bool isZeroValue(ir::Expr *e) {
+    switch (e->getKind()) {
+        case ir::INT_VALUE:
+            return static_cast<ir::Value<int> *>(e)->getValue() == 0;
+        case ir::FLOAT_VALUE:
+            return static_cast<ir::Value<float> *>(e)->getValue() == 0;
+        default:
+            return false;
+    }
+}
+
 bool isZero(ir::Expr *e) {
-    ir::Value<int> i0(0);
-    ir::Value<float> f0(0);
-    ir::UnaryExpr mi0(&i0, '-');
-    ir::UnaryExpr mf0(&f0, '-');
-    return (*e) == i0 ||
-        (*e) == f0 ||
-        (*e) == mi0 ||
-        (*e) == mf0;
-}
-
-std::list<ir::Equation *> TopBackEnd::formatEquations() {
-    std::list<ir::Equation *> list;
-
-    for (auto e: prog->getEqs()) {
-        this->simplify(e->getLHS());
-        this->simplify(e->getRHS());
-        ir::Expr *lhs = e->getLHS();
-        ir::Expr *rhs = e->getRHS();
-        ir::Expr *eq = NULL;
-        if (isZero(lhs)) {
-            eq = rhs;
-        }
-        else if (isZero(rhs)) {
-            eq = lhs;
-        }
-        else {
-            eq = (*rhs - *lhs).copy();
-        }
-        if (e->name == "undef") {
-            err << "equation without a name\n";
-            exit(EXIT_FAILURE);
-        }
-        ir::Equation *newEq = new ir::Equation(e->name, eq,
-                new ir::Value<float>(0), e->getBCs());
-        list.push_back(newEq);
+    if (auto ue = ir::dyn_cast<ir::UnaryExpr>(e)) {
+        return ue->getOp() == '-' && isZeroValue(ue->getExpr());
     }
-    return list;
+    return isZeroValue(e);
+}
+
+ir::Equation *TopBackEnd::formatEquation(ir::Equation *e) {
+    this->simplify(e->getLHS());
+    this->simplify(e->getRHS());
+    ir::Expr *lhs = e->getLHS();
+    ir::Expr *rhs = e->getRHS();
+    ir::Expr *eq = NULL;
+    if (isZero(lhs)) {
+        eq = rhs;
+    }
+    else if (isZero(rhs)) {
+        eq = lhs;
+    }
+    else {
+        eq = (*rhs - *lhs).copy();
+    }
+    if (e->name == "undef") {
+        err << "equation without a name\n";
+        exit(EXIT_FAILURE);
+    }
+    ir::BCLst bcs = e->getBCs();
+    return new ir::Equation(e->name, eq, new ir::Value<float>(0), &bcs);
 }
 
 ir::FuncCall *isCoupling(ir::Expr *e) {
-    if (auto fc = dynamic_cast<ir::FuncCall *>(e)) {
+    if (auto fc = ir::dyn_cast<ir::FuncCall>(e)) {
         if (std::strstr(fc->name.c_str(), "llm")) {
             return fc;
         }
@@ -325,8 +377,8 @@ ir::FuncCall *isCoupling(ir::Expr *e) {
 }
 
 ir::FuncCall *isAvg(ir::Expr *e) {
-    if (auto fc = dynamic_cast<ir::FuncCall *>(e)) {
-        if (fc->name == "avg") {
+    if (auto fc = ir::dyn_cast<ir::FuncCall>(e)) {
+        if (fc->name == avgName) {
             return fc;
         }
     }
@@ -340,7 +392,7 @@ TermType Term::getType() {
     if (isAvg(expr)) {
         return AR;
     }
-    if (dynamic_cast<ir::FuncCall *>(expr))
+    if (ir::dyn_cast<ir::FuncCall>(expr))
         return AR;
     else {
         if (llExpr) {
@@ -353,10 +405,14 @@ TermType Term::getType() {
             err << "dimension " << backend->dim << " not supported\n";
             exit(EXIT_FAILURE);
         }
+        else if (!expr->hasAttr(ir::ATTR_UNRESOLVED)) {
+            return expr->hasAttr(ir::ATTR_FIELD) ? AR : AS;
+        }
         else {
+            // the names are resolved on the way
             std::vector<ir::Identifier *> ids = getIds(expr, true);
             for (auto id: ids) {
-                if (backend->isField(id->name))
+                if (backend->isField(id))
                     return AR;
             }
             return AS;
@@ -373,9 +429,8 @@ TermType TermBC::getType() {
     else return ATBC;
 }
 
-void TopBackEnd::checkCoupling(ir::Expr *expr) {
+void TopBackEnd::checkCoupling(ir::FuncCall *coupling) {
     static int singlePrint = 0;
-    ir::Expr *coupling = this->findCoupling(expr);
     if (coupling == NULL) {
         err << "malformed coupling expression\n";
         exit(EXIT_FAILURE);
@@ -385,69 +440,102 @@ void TopBackEnd::checkCoupling(ir::Expr *expr) {
     }
 }
 
-Term *TopBackEnd::buildTerm(ir::Expr *t) {
+// operation of the kind of ne on some of its operands (in the same order):
+// the operands are not adopted (they keep ne as parent), and the view is not
+// part of the program
+static ir::NaryExpr *operandView(ir::NaryExpr *ne,
+        const std::vector<ir::ScalarExpr *>& ops) {
+    ir::NaryExpr *view;
+    if (ne->getKind() == ir::SUM)
+        view = new ir::Sum(ne);
+    else
+        view = new ir::Product(ne);
+    for (auto op: ops)
+        view->getChildren().push_back(op);
+    return view;
+}
+
+// e under a unary operator: e is not adopted either
+static ir::UnaryExpr *unaryView(ir::ScalarExpr *e, char op) {
+    ir::Node *parent = e->getParent();
+    ir::UnaryExpr *view = new ir::UnaryExpr(e, op);
+    e->setParent(parent);
+    return view;
+}
+
+Term *TopBackEnd::buildTerm(ir::Expr *t, ir::Equation *e, bool negate) {
     t->setParents();
-    ir::Identifier *var = this->findVar(t);
+    // copied: binding an identifier below (see ivar) modifies the equation,
+    // and its attributes are then evaluated again
+    const TermAttr a = passes.get(termAttrs, e)(t);
+    if (a.nVars > 1) {
+        err << "non linear term are not allowed\n";
+        t->display("non linear term in:");
+        exit(EXIT_FAILURE);
+    }
+    ir::Identifier *var = a.var;
     if (!var) {
         err << "term without varaible?\n";
         t->display();
         exit(EXIT_FAILURE);
     }
-    int power = this->findPower(t);
+    int power = a.power;
+    if (power == ir::NOT_FP_MONOMIAL)
+        power = this->findPower(t);
     if (power > this->powerMax)
         this->powerMax = power;
-    std::string der = this->findDerivativeOrder(var);
-    ir::Expr *expr = this->findCoupling(t);
+    std::string der = a.der;
+    if (a.couplings->size() > 1) {
+        err << "non linear term are not allowed\n";
+        t->display("non linear term in:");
+        exit(EXIT_FAILURE);
+    }
+    ir::Expr *expr = a.coupling;
     ir::Expr *llExpr = NULL;
     std::string varName = var->name;
-    int ivar = this->ivar(var->name);
+    int ivar = this->ivar(var);
     if (expr == NULL) {
-        if (auto be = dynamic_cast<ir::BinExpr *>(t)) {
-            if (be->getOp() != '*') {
-                err << "terms should be products...\n";
+        if (auto pr = ir::dyn_cast<ir::Product>(t)) {
+            // the coefficient of the term is the product of the factors other
+            // than the variable (or its derivative)
+            int varFactor = -1;
+            for (int i=0; i<pr->getNOperands() && varFactor < 0; i++) {
+                ir::Expr *f = pr->getOperand(i);
+                if (auto de = ir::dyn_cast<ir::DiffExpr>(f))
+                    f = de->getExpr();
+                if (f == var)
+                    varFactor = i;
+            }
+            if (varFactor < 0) {
+                err << "malformed term\n";
+                t->display("malformed term");
                 exit(EXIT_FAILURE);
             }
-            if (auto id = dynamic_cast<ir::Identifier *>(be->getRightOp())) {
-                if (isVar(id->name))
-                    expr = be->getLeftOp();
-                else
-                    unsupported(t);
-            }
-            else if (auto de = dynamic_cast<ir::DiffExpr *>(be->getRightOp())) {
-                ir::Identifier *id = dynamic_cast<ir::Identifier *>(de->getExpr());
-                if (id != NULL && isVar(id->name))
-                    expr = be->getLeftOp();
-                else
-                    unsupported(t);
-            }
-            else if (auto id = dynamic_cast<ir::Identifier *>(be->getLeftOp())) {
-                if (isVar(id->name))
-                    expr = be->getRightOp();
-                else
-                    unsupported(t);
-            }
-            else if (auto de = dynamic_cast<ir::DiffExpr *>(be->getLeftOp())) {
-                ir::Identifier *id = dynamic_cast<ir::Identifier *>(de->getExpr());
-                if (id != NULL && isVar(id->name))
-                    expr = be->getRightOp();
-                else
-                    unsupported(t);
+            if (pr->getNOperands() == 2) {
+                expr = pr->getOperand(1 - varFactor);
             }
             else {
-                err << "malformed term\n";
-                t->display("malformed term");
-                exit(EXIT_FAILURE);
+                // the factors are not copied: the coefficient is a view of
+                // the term
+                std::vector<ir::ScalarExpr *> factors;
+                for (int i=0; i<pr->getNOperands(); i++) {
+                    if (i != varFactor)
+                        factors.push_back(pr->getOperand(i));
+                }
+                expr = operandView(pr, factors);
             }
         }
-        else if (auto ue = dynamic_cast<ir::UnaryExpr *>(t)) {
-            Term *ret = buildTerm(ue->getExpr());
+        else if (ir::isa<ir::BinExpr>(t)) {
+            err << "terms should be products...\n";
+            exit(EXIT_FAILURE);
+        }
+        else if (auto ue = ir::dyn_cast<ir::UnaryExpr>(t)) {
             if (ue->getOp() != '-')
                 unsupported(ue);
-            ret->expr = new ir::UnaryExpr(scalar(ret->expr), '-');
-            return ret;
+            return buildTerm(ue->getExpr(), e, !negate);
         }
-        else if (auto de = dynamic_cast<ir::DiffExpr *>(t)) {
-            if (auto id = dynamic_cast<ir::Identifier *>(de->getExpr())) {
+        else if (auto de = ir::dyn_cast<ir::DiffExpr>(t)) {
+            if (auto id = ir::dyn_cast<ir::Identifier>(de->getExpr())) {
                 if (id == var)
                     expr = new ir::Value<float>(1.0);
                 else
@@ -456,7 +544,7 @@ Term *TopBackEnd::buildTerm(ir::Expr *t) {
             else
                 unsupported(t);
         }
-        else if (auto id = dynamic_cast<ir::Identifier *>(t)) {
+        else if (auto id = ir::dyn_cast<ir::Identifier>(t)) {
             if (id != var)
                 unsupported(t);
             expr = new ir::Value<float>(1.0);
@@ -467,8 +555,8 @@ Term *TopBackEnd::buildTerm(ir::Expr *t) {
         llExpr = extractLlExpr(expr);
     }
     else {
-        checkCoupling(t);
-        llExpr = dynamic_cast<ir::Expr *>(expr->getChildren()[0]);
+        checkCoupling(a.coupling);
+        llExpr = ir::dyn_cast<ir::Expr>(expr->getChildren()[0]);
         if (llExpr)
             llExpr = extractLlExpr(llExpr);
         else {
@@ -497,9 +585,20 @@ Term *TopBackEnd::buildTerm(ir::Expr *t) {
         exit(EXIT_FAILURE);
     }
 #endif
-    return new Term(expr, llExpr,
-            ir::Symbol(var->name),
+    Term *term = new Term(expr, llExpr,
+            ir::Variable(var->name, var->vectComponent),
             power, der, ivar, varName, this);
+    // expr is a subexpression of the term, or made of subexpressions: its
+    // attributes are already evaluated
+    const TermAttr c = passes.get(termAttrs, e)(expr);
+    term->avg = c.avg;
+    term->nAvgs = c.nAvgs;
+    term->avgUnhandled = c.avgUnhandled;
+    // a coupling integral stays the expression of its term (see
+    // isCoupling): it is not negated
+    if (negate && a.coupling == NULL)
+        term->expr = unaryView(scalar(expr), '-');
+    return term;
 }
 
 int TopBackEnd::computeTermIndex(Term *term) {
@@ -529,9 +628,9 @@ int TopBackEnd::computeTermIndex(Term *term) {
 }
 
 std::string getVarLocation(ir::BC *bc) {
-    if (auto id = dynamic_cast<ir::Identifier *>(bc->getLoc()->getLHS())) {
-        if (id->name == "r") {
-            if (auto v = dynamic_cast<ir::Value<int> *>(bc->getLoc()->getRHS())) {
+    if (auto id = ir::dyn_cast<ir::Identifier>(bc->getLoc()->getLHS())) {
+        if (id->name == rName) {
+            if (auto v = ir::dyn_cast<ir::Value<int> >(bc->getLoc()->getRHS())) {
                 if (v->getValue() == 0)
                     return "1";
                 if (v->getValue() == 1)
@@ -562,264 +661,362 @@ std::string getEqLocation(ir::BC *bc) {
     }
 }
 
-void TopBackEnd::buildTermList(std::list<ir::Equation *> eqs) {
-    int ieq = 0;
+void TopBackEnd::buildTerms(ir::Equation *e, int ieq) {
+    if (!isZero(e->getRHS())) {
+        err << "equation was not correctly formatted (RHS is not 0)\n";
+        exit(EXIT_FAILURE);
+    }
+    eqNames.push_back(e->name);
+    auto terms = this->splitIntoTerms(e->getLHS());
+    this->eqs[e->name] = std::list<Term *>();
+    for (auto t: terms) {
+        Term *term = buildTerm(t.first, e, t.second);
+        term->ieq = ieq;
+        term->eqName = e->name;
+        term->idx = computeTermIndex(term);
+        this->eqs[e->name].push_back(term);
+    }
 
-    this->nas = 0;
-    this->nar = 0;
-    this->nasbc = 0;
-    this->nart = 0;
-    this->nartt = 0;
-    this->natbc = 0;
-    this->nattbc = 0;
+    // simplifying the BCs modifies the equation: the attributes of its terms
+    // are evaluated again
+    for (auto bc: e->getBCs()) {
+        this->simplify(bc->getCond()->getLHS());
+        this->simplify(bc->getCond()->getRHS());
+        this->simplify(bc->getLoc()->getLHS());
+        this->simplify(bc->getLoc()->getRHS());
 
-    for (auto e: eqs) {
-        if (!isZero(e->getRHS())) {
-            err << "equation was not correctly formatted (RHS is not 0)\n";
-            exit(EXIT_FAILURE);
-        }
-        ieq++;
-        std::vector<ir::Expr *> *terms = this->splitIntoTerms(e->getLHS());
-        this->eqs[e->name] = std::list<Term *>();
-        if (terms) {
-            for (auto t: *terms) {
-                Term *term = buildTerm(t);
-                term->ieq = ieq;
-                term->eqName = e->name;
-                term->idx = computeTermIndex(term);
-                this->eqs[e->name].push_back(term);
-            }
-
-            for (auto bc: *e->getBCs()) {
-                this->simplify(bc->getCond()->getLHS());
-                this->simplify(bc->getCond()->getRHS());
-                this->simplify(bc->getLoc()->getLHS());
-                this->simplify(bc->getLoc()->getRHS());
-
-                ir::Expr *lhs = bc->getCond()->getLHS();
-                ir::Expr *rhs = bc->getCond()->getRHS();
-                ir::Expr *eq = NULL;
-
-                this->simplify(lhs);
-                this->simplify(rhs);
-
-                if (isZero(rhs)) {
-                    eq = dynamic_cast<ir::Expr *>(lhs);
-                }
-                else if (isZero(lhs)) {
-                    eq = new ir::UnaryExpr(scalar(rhs->copy()), '-');
-                }
-                else {
-                    eq = new ir::BinExpr(scalar(lhs), '-', scalar(rhs));
-                }
+        ir::Expr *lhs = bc->getCond()->getLHS();
+        ir::Expr *rhs = bc->getCond()->getRHS();
 
-                eq->setParents();
-                std::vector<ir::Expr *> *terms = this->splitIntoTerms(eq);
-                for (auto t: *terms) {
-                    TermBC *termBC = new TermBC(*buildTerm(t));
-                    termBC->ieq = ieq;
-                    termBC->eqName = e->name;
-                    termBC->idx = computeTermIndex(termBC);
-                    termBC->eqLoc = getEqLocation(bc);
-                    termBC->varLoc = getVarLocation(bc);
-                    this->eqs[e->name].push_back(termBC);
-                }
-            }
+        this->simplify(lhs);
+        this->simplify(rhs);
 
+        // the terms of lhs - rhs
+        std::vector<std::pair<ir::Expr *, bool>> terms;
+        if (isZero(rhs)) {
+            terms = this->splitIntoTerms(lhs);
         }
-        else  {
-            err << "could not split equation into proper terms\n";
-            exit(EXIT_FAILURE);
+        else if (isZero(lhs)) {
+            terms = this->splitIntoTerms(rhs, true);
         }
-        delete terms;
-    }
+        else {
+            terms = this->splitIntoTerms(lhs);
+            for (auto t: this->splitIntoTerms(rhs, true))
+                terms.push_back(t);
+        }
+
+        for (auto t: terms) {
+            Term *term = buildTerm(t.first, e, t.second);
+            TermBC *termBC = new TermBC(*term);
+            delete term;
+            termBC->ieq = ieq;
+            termBC->eqName = e->name;
+            termBC->idx = computeTermIndex(termBC);
+            termBC->eqLoc = getEqLocation(bc);
+            termBC->varLoc = getVarLocation(bc);
+            this->eqs[e->name].push_back(termBC);
+        }
+    }
+
+    EquationSummary summary;
+    summary.needModifyL0 = true;
+    summary.l0Ivar = 0;
+    for (auto t: this->eqs[e->name]) {
+        if (dim == 1 && !dynamic_cast<TermBC *>(t) && t->getType() == AR)
+            summary.arTerms.push_back(std::make_pair(t->varName,
+                        t->getMatrix(FULL)));
+        if (t->getType() == AS || t->getType() == AR)
+            summary.needModifyL0 = false;
+        if (auto fc = isCoupling(t->expr)) {
+            if (std::strstr(fc->name.c_str(), "Illm") && t->llExpr == NULL)
+                summary.needModifyL0 = false;
+        }
+        if (summary.l0Var == "" && e->name == "eq" + t->varName) {
+            summary.l0Var = t->varName;
+            summary.l0Matrix = t->getMatrix(FULL);
+            summary.l0Ivar = t->ivar;
+        }
+    }
+    // only kept if init_a has something to emit for the equation
+    if (summary.needModifyL0 || !summary.arTerms.empty())
+        summaries[e->name] = summary;
+    else
+        summaries.erase(e->name);
 }
 
-TopBackEnd::TopBackEnd(ir::Program *p, DerivativeType derType, int dim) :
-    derType(derType), dim(dim) {
-    this->prog = p;
+void TopBackEnd::initCounters() {
     this->nas = 0;
+    this->nar = 0;
+    this->nasbc = 0;
     this->nartt = 0;
     this->nart = 0;
     this->nvar = 0;
     this->natbc = 0;
     this->nattbc = 0;
     this->powerMax = 0;
+}
+
+void TopBackEnd::addPasses() {
+    passes.addProgramPass("names", [] (ir::Program *p) {
+            // add internal definitions
+            // the symbol table of the program owns its symbols
+            for (auto s: internalVariables) {
+                p->getSymTab().add(new ir::Param(s.second));
+            }
+            p->resolveNames();
+        });
+    passes.addProgramPass("variables", [this] (ir::Program *) {
+            buildVarList();
+        });
+    passes.addEquationPass("format", [this] (ir::Equation *e) {
+            formatted[e] = formatEquation(e);
+        });
+    passes.addEquationPass("terms", [this] (ir::Equation *e) {
+            ir::Equation *f = formatted[e];
+            // bound beforehand: binding a name while the terms are built
+            // would invalidate the attributes of the terms
+            prog->resolveNames(f);
+            buildTerms(f, eqNames.size() + 1);
+            // the attributes are not needed once the terms are built
+            passes.forget(f);
+        });
+    termAttrs = passes.addAnalysis<Fold<TermAttr>>("term attributes",
+            [this] (ir::Equation *) {
+                return Fold<TermAttr>([this] (ir::Node *n,
+                            const std::vector<const TermAttr *>& children) {
+                        return this->termAttr(n, children);
+                    });
+            });
+}
+
+void TopBackEnd::setProgram(ir::Program *p) {
+    this->prog = p;
+    passes.run(p);
+}
+
+TopBackEnd::TopBackEnd(ir::Program *p, DerivativeType derType, int dim) :
+    out(NULL), latex(NULL), spoolOutput(NULL), derType(derType), dim(dim) {
+    // nodes built by the backend belong to the program
+    ir::Arena::Scope scope(p->getArena());
+    initCounters();
+    addPasses();
+    addSimplifications();
+    setProgram(p);
+    formatted.clear();
+}
+
+TopBackEnd::TopBackEnd(DerivativeType derType, int dim, FortranOutput& fo,
+        LatexOutput *lo, const std::string renameFile) :
+    prog(NULL), out(&fo), latex(lo), renameFile(renameFile),
+    spoolOutput(NULL), derType(derType), dim(dim) {
+    initCounters();
+    addPasses();
+    addSimplifications();
+}
 
-    buildVarList();
-    std::list<ir::Equation *> eqs = formatEquations();
-    buildTermList(eqs);
+TopBackEnd::~TopBackEnd() {
+    for (auto e: eqs) {
+        for (auto t: e.second)
+            delete t;
+    }
+    delete spoolOutput;
+}
 
-    // add internal definitions
-    for (auto s: internalVariables) {
-        this->prog->getSymTab().add(s.second);
+// opens an anonymous temporary file (removed as soon as it is created, it
+// goes away when closed)
+static void openSpool(std::fstream& f) {
+    const char *dir = getenv("TMPDIR");
+    std::string path = std::string(dir ? dir : "/tmp") + "/edl-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd == -1) {
+        err << "cannot create a temporary file in `" << path << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    f.open(name.data(), std::fstream::in | std::fstream::out |
+            std::fstream::trunc);
+    unlink(name.data());
+    close(fd);
+    if (!f) {
+        err << "cannot open temporary file `" << name.data() << "'\n";
+        exit(EXIT_FAILURE);
     }
 }
 
-TopBackEnd::~TopBackEnd() { }
+void TopBackEnd::begin(ir::Program *p) {
+    ir::Arena::Scope scope(p->getArena());
+    setProgram(p);
+    openSpool(spool);
+    spoolOutput = new FortranOutput(spool);
+    if (latex)
+        beginLaTeX(*latex, renameFile);
+}
+
+void TopBackEnd::equation(ir::Equation *e) {
+    // the nodes built for the equation are released with it: they are
+    // allocated in its arena (the current one)
+    passes.run(e);
+    formatted.erase(e);
+    emitIndices(*out, e->name);
+    emitCoefficients(*spoolOutput, e->name);
+    if (latex)
+        emitEquationLaTeX(*latex, e->name);
+
+    for (auto t: eqs[e->name])
+        delete t;
+    eqs.erase(e->name);
+}
+
+void TopBackEnd::reportPasses(std::ostream& os) const {
+    passes.report(os);
+}
+
+void TopBackEnd::end() {
+    ir::Arena::Scope scope(prog->getArena());
+    // the declarations can refer to any equation (leq): they are bound once
+    // all the equations are known
+    for (auto d: prog->getDecls())
+        prog->resolveNames(d);
+
+    spool.seekg(0);
+    out->append(spool);
+    this->emitInitA(*out);
+    if (latex)
+        endLaTeX(*latex);
+}
 
 // this takes derivative expressions (e.g., u''') and fold them into DiffExpr
 // (e.g., DiffExpr(u, r, 3))
 // this also transform FuncCall (dr(u, 3) into the specialized DiffExpr(u, r, 3)
 void TopBackEnd::simplify(ir::Expr *expr) {
-    Analysis<ir::Identifier> a;
-    Analysis<ir::UnaryExpr> a2;
     assert(expr);
-    auto foldDer = [this] (ir::Identifier *id) {
-        ir::Expr *root = id;
-        ir::UnaryExpr *ue = dynamic_cast<ir::UnaryExpr *>(id->getParent());
-        int order = 0;
-
-        if (*id == l || *id == ll) return;
-
-        while (ue) {
-            if (ue->getOp() == '\'') {
-                order++;
-                root = ue;
-            }
-            else {
-                break;
-            }
-            ue = dynamic_cast<ir::UnaryExpr *>(ue->getParent());
-        }
-        if (order > 0) {
-            ir::Node *newNode = new ir::DiffExpr(id,
-                    new ir::Identifier("r"),
-                    std::to_string(order));
-            prog->replace(root, newNode);
-        }
-    };
+    // replacements are spliced in place: the parents have to be up to date
+    // (shared nodes do not know their parent in this expression otherwise)
+    expr->setParents();
+    simplifications.apply(expr);
+}
 
-    auto foldConst = [this, &expr] (ir::UnaryExpr *ue) {
-        if (ue->getOp() == '-') {
-            if (auto val = dynamic_cast<ir::Value<int> *>(ue->getExpr())) {
-                ir::Value<int> *newNode = new ir::Value<int>(-val->getValue());
-                prog->replace(ue, newNode);
-            }
-        }
+void TopBackEnd::addSimplifications() {
+    ir::Identifier c("?c"), u("?u"), n("?n"), x("?x"), r(rName);
+    RewriteRules::VarKinds ids = {
+        {"x", {ir::IDENTIFIER, ir::FUNC_CALL, ir::ARRAY}}
     };
 
-    auto foldDr = [this, &expr] (ir::Identifier *id) {
-
-        if (id->name == "dr") {
-            ir::FuncCall *fc = dynamic_cast<ir::FuncCall *>(id);
-            assert(fc);
-
-            std::string derOrder;
-            if (auto order = dynamic_cast<ir::Identifier *>(fc->getChildren()[1])) {
-                derOrder = order->name;
-            }
-            else if (auto order = dynamic_cast<ir::Value<int> *>(fc->getChildren()[1])) {
-                derOrder = std::to_string(order->getValue());
-            }
-            else {
-                err << "derivative order should be an integer or a variable...";
-                unsupported(fc);
-            }
-            if (auto derVar = dynamic_cast<ir::Identifier *>(fc->getChildren()[0])) {
-                ir::Node *newNode = new ir::DiffExpr(
-                        derVar,
-                        new ir::Identifier("r"),
-                        derOrder);
-                prog->replace(fc, newNode);
-            }
-            else {
+    simplifications.add(ir::UnaryExpr(c, '-'),
+            [] (ir::Expr *, const Bindings& b) -> ir::Expr * {
+                return new ir::Value<int>(
+                        -b.get<ir::Value<int> >("c")->getValue());
+            }, {{"c", {ir::INT_VALUE}}});
+
+    ir::ExprLst args;
+    args.push_back(&u);
+    args.push_back(&n);
+    ir::FuncCall dr(drName, &args);
+    dr.setClearOnDelete(true);
+    simplifications.add(dr, [] (ir::Expr *fc, const Bindings& b) ->
+            ir::Expr * {
+                std::string derOrder;
+                ir::Expr *n = b.get("n");
+                if (auto order = ir::dyn_cast<ir::Identifier>(n)) {
+                    derOrder = order->name;
+                }
+                else if (auto order = ir::dyn_cast<ir::Value<int> >(n)) {
+                    derOrder = std::to_string(order->getValue());
+                }
+                else {
+                    err << "derivative order should be an integer or a variable...";
+                    unsupported(fc);
+                }
+                if (auto derVar = b.get<ir::Identifier>("u")) {
+                    return new ir::DiffExpr(derVar, new ir::Identifier(rName),
+                            derOrder);
+                }
                 err << "derivative of expression not yet supported...";
                 unsupported(fc);
-            }
-        }
-    };
-    expr->setParents();
-    a2.run(foldConst, expr);
-    expr->setParents();
-    a.run(foldDr, expr);
-    expr->setParents();
-    a.run(foldDer, expr);
+            });
+
+    // the chains of `'' are folded from the inside: u' then (u')'...
+    simplifications.add(ir::UnaryExpr(x, '\''),
+            [] (ir::Expr *, const Bindings& b) -> ir::Expr * {
+                ir::Identifier *id = b.get<ir::Identifier>("x");
+                if (*id == l)
+                    return NULL;
+                return new ir::DiffExpr(id, new ir::Identifier(rName));
+            }, ids);
+    simplifications.add(ir::UnaryExpr(ir::DiffExpr(x, r), '\''),
+            [] (ir::Expr *ue, const Bindings&) -> ir::Expr * {
+                ir::DiffExpr *de = ir::dyn_cast<ir::DiffExpr>(
+                        ue->getChildren()[0]);
+                std::string order = de->getOrder();
+                // the order of dr(u, n) is not a number
+                if (order.empty() ||
+                        order.find_first_not_of("0123456789") !=
+                        std::string::npos)
+                    return NULL;
+                de->setOrder(std::to_string(std::stoi(order) + 1));
+                return de;
+            }, ids);
 }
 
-bool TopBackEnd::isVar(std::string id) {
-    ir::Symbol *s = this->prog->getSymTab().search(id);
-    if (s) {
-        if (dynamic_cast<ir::Variable *>(s))
-            return true;
-    }
-    return false;
+ir::SymbolKind TopBackEnd::kindOf(ir::Identifier *id) {
+    // identifiers built by the backend are bound on first use
+    if (id->isResolved())
+        return id->getSymbolKind();
+    return this->prog->resolve(id);
 }
 
-bool TopBackEnd::isParam(std::string id) {
-    ir::Symbol *s = this->prog->getSymTab().search(id);
-    if (s) {
-        if (dynamic_cast<ir::Param *>(s))
-            return true;
-    }
-    return false;
+bool TopBackEnd::isVar(ir::Identifier *id) {
+    ir::SymbolKind k = kindOf(id);
+    return k == ir::VARIABLE_SYMBOL || k == ir::ARRAY_SYMBOL;
 }
 
-bool TopBackEnd::isField(std::string id) {
-    ir::Symbol *s = this->prog->getSymTab().search(id);
-    if (s) {
-        if (dynamic_cast<ir::Field *>(s))
-            return true;
-    }
-    return false;
+bool TopBackEnd::isParam(ir::Identifier *id) {
+    return kindOf(id) == ir::PARAM_SYMBOL;
 }
 
-bool TopBackEnd::isScal(std::string id) {
-    ir::Symbol *s = this->prog->getSymTab().search(id);
-    if (s) {
-        if (dynamic_cast<ir::Scalar *>(s))
-            return true;
-    }
-    return false;
+bool TopBackEnd::isField(ir::Identifier *id) {
+    return kindOf(id) == ir::FIELD_SYMBOL;
 }
 
-bool TopBackEnd::isDef(std::string id) {
-    return isField(id) || isScal(id) || isVar(id) || isParam(id);
+bool TopBackEnd::isScal(ir::Identifier *id) {
+    return kindOf(id) == ir::SCALAR_SYMBOL;
 }
 
-bool haveLlTerms(ir::Expr *e) {
-    std::vector<ir::Identifier *> ids = getIds(e);
-    for (auto i: ids) {
-        if (i->name == "l")
+bool TopBackEnd::isDef(ir::Identifier *id) {
+    switch (kindOf(id)) {
+        case ir::PARAM_SYMBOL:
+        case ir::VARIABLE_SYMBOL:
+        case ir::ARRAY_SYMBOL:
+        case ir::FIELD_SYMBOL:
+        case ir::SCALAR_SYMBOL:
             return true;
+        default:
+            return false;
     }
-    return false;
 }
 
-ir::FuncCall *TopBackEnd::extractAvg(ir::Expr *e) {
-    assert(e);
+bool haveLlTerms(ir::Expr *e) {
+    return e->hasAttr(ir::ATTR_L);
+}
 
-    if (auto fc = isAvg(e)) {
-        return fc;
-    }
-    else if (auto be = dynamic_cast<ir::BinExpr *>(e)) {
-        ir::FuncCall *l = extractAvg(be->getLeftOp());
-        ir::FuncCall *r = extractAvg(be->getRightOp());
-        if (l && r) {
-            err << "several avg expr in terms are not yet implemented\n";
-            exit(EXIT_FAILURE);
-        }
-        if (l) return l;
-        if (r) return r;
-    }
-    else if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
-        return extractAvg(ue->getExpr());
-    }
-    else if (dynamic_cast<ir::Identifier *>(e)) {
-        return NULL;
-    }
-    else if (dynamic_cast<ir::Value<int> *>(e)) {
-        return NULL;
-    }
-    else if (dynamic_cast<ir::Value<float> *>(e)) {
-        return NULL;
-    }
-    else {
+// the only name e refers to is l
+static bool onlyL(ir::Expr *e) {
+    const ir::NameSet& names = e->getNames();
+    return names.size() == 1 && names.contains(l.name);
+}
+
+ir::FuncCall *TopBackEnd::extractAvg(Term *term) {
+    if (term->avgUnhandled) {
         err << "case not yet handled, sorry\n";
-        e->display();
+        term->avgUnhandled->display();
         exit(EXIT_FAILURE);
     }
-    return NULL;
+    if (term->nAvgs > 1) {
+        err << "several avg expr in terms are not yet implemented\n";
+        exit(EXIT_FAILURE);
+    }
+    return term->avg;
 }
 
 ir::Expr *TopBackEnd::extractLlExpr(ir::Expr *e) {
@@ -828,25 +1025,20 @@ ir::Expr *TopBackEnd::extractLlExpr(ir::Expr *e) {
     if (this->dim == 1)
         return NULL;
 
-    if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
+    if (auto ue = ir::dyn_cast<ir::UnaryExpr>(e)) {
         if (auto ll = extractLlExpr(ue->getExpr())) {
-            ir::UnaryExpr *newExpr = new ir::UnaryExpr(scalar(ll),
-                    ue->getOp());
+            ir::UnaryExpr *newExpr = unaryView(scalar(ll), ue->getOp());
             newExpr->setParent(e->getParent());
             return newExpr;
         }
     }
 
-    auto ids = getIds(e);
-    if (ids.size() == 1) {
-        if (*ids[0] == l || *ids[0] == ll) {
-            return e;
-        }
-    }
-    if (ids.size() == 0)
+    if (onlyL(e))
+        return e;
+    if (e->getNames().size() == 0)
         return NULL;
 
-    if (auto be = dynamic_cast<ir::BinExpr *>(e)) {
+    if (auto be = ir::dyn_cast<ir::BinExpr>(e)) {
         if (haveLlTerms(be->getLeftOp()) && !haveLlTerms(be->getRightOp())) {
             return extractLlExpr(be->getLeftOp());
         }
@@ -858,17 +1050,35 @@ ir::Expr *TopBackEnd::extractLlExpr(ir::Expr *e) {
         }
         unsupported(e);
     }
-    else if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
+    else if (auto ne = ir::dyn_cast<ir::NaryExpr>(e)) {
+        std::vector<ir::ScalarExpr *> llOps;
+        for (int i=0; i<ne->getNOperands(); i++) {
+            if (haveLlTerms(ne->getOperand(i)))
+                llOps.push_back(ne->getOperand(i));
+        }
+        if (llOps.size() == 0)
+            return NULL;
+        if (llOps.size() == 1)
+            return extractLlExpr(llOps[0]);
+        // several operands depend on l (e.g. l*(l+1)*u): they are grouped in
+        // an operation of the same kind (a view of the operands, which are
+        // not copied), as a binary tree would have grouped them
+        ir::NaryExpr *group = operandView(ne, llOps);
+        if (onlyL(group))
+            return group;
+        unsupported(e);
+    }
+    else if (auto ue = ir::dyn_cast<ir::UnaryExpr>(e)) {
         return extractLlExpr(ue->getExpr());
     }
-    else if (auto fc = dynamic_cast<ir::FuncCall *>(e)) {
+    else if (auto fc = ir::dyn_cast<ir::FuncCall>(e)) {
         for (auto arg: fc->getArgs()) {
-            if (extractLlExpr(dynamic_cast<ir::Expr *>(arg))) {
+            if (extractLlExpr(ir::dyn_cast<ir::Expr>(arg))) {
                 return fc;
             }
         }
     }
-    else if (auto id = dynamic_cast<ir::Identifier *>(e)) {
+    else if (auto id = ir::dyn_cast<ir::Identifier>(e)) {
         if (*id == l || *id == ll) {
             return id;
         }
@@ -882,213 +1092,243 @@ ir::Expr *TopBackEnd::extractLlExpr(ir::Expr *e) {
     return NULL;
 }
 
-std::vector<ir::Expr *> *TopBackEnd::splitIntoTerms(ir::Expr *e) {
-    assert(e);
-    std::vector<ir::Expr *> *rLeft = NULL;
-    std::vector<ir::Expr *> *rRight = NULL;
-    std::vector<ir::Expr *> *r = NULL;
-
-    if (auto be = dynamic_cast<ir::BinExpr *>(e)) {
-        switch(be->getOp()) {
-            case '+':
-            case '-':
-                rLeft = this->splitIntoTerms(be->getLeftOp());
-                rRight = splitIntoTerms(be->getRightOp());
-                for (auto expr: *rRight) {
-                    if (be->getOp() == '-') {
-                        rLeft->push_back(new ir::UnaryExpr(scalar(expr), '-'));
-                    }
-                    else {
-                        rLeft->push_back(expr);
-                    }
-                }
-                return rLeft;
-            case '*':
-                r = new std::vector<ir::Expr *>();
-                r->push_back(be);
-                return r;
-            default:
-                err << "unsupported operator `" << be->getOp() << "\'\n";
-                exit(EXIT_FAILURE);
+// appends the terms of e to terms, with their sign (flipped if negate is
+// true)
+static void collectTerms(ir::Expr *e, bool negate,
+        std::vector<std::pair<ir::Expr *, bool>>& terms) {
+    switch (e->getKind()) {
+        case ir::SUM: {
+            ir::Sum *sum = static_cast<ir::Sum *>(e);
+            for (int i=0; i<sum->getNOperands(); i++) {
+                collectTerms(sum->getOperand(i), negate, terms);
+            }
+            return;
         }
-    }
-    else if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
-        switch(ue->getOp()) {
-            case '-':
-                r = this->splitIntoTerms(ue->getExpr());
-                return r;
-            default:
-                err << "unsupported unary operator `" << ue->getOp() << "\'\n";
-                e->display("unsupported unary operator");
-                exit(EXIT_FAILURE);
+        case ir::BINARY:
+        case ir::INDEX_RANGE: {
+            ir::BinExpr *be = static_cast<ir::BinExpr *>(e);
+            switch(be->getOp()) {
+                case '+':
+                case '-':
+                    collectTerms(be->getLeftOp(), negate, terms);
+                    collectTerms(be->getRightOp(),
+                            be->getOp() == '-' ? !negate : negate, terms);
+                    return;
+                default:
+                    err << "unsupported operator `" << be->getOp() << "\'\n";
+                    exit(EXIT_FAILURE);
+            }
         }
-    }
-    else if (auto v = dynamic_cast<ir::Value<int> *>(e)) {
-        r = new std::vector<ir::Expr *>();
-        r->push_back(v);
-        return r;
-    }
-    else if (auto v = dynamic_cast<ir::Value<float> *>(e)) {
-        r = new std::vector<ir::Expr *>();
-        r->push_back(v);
-        return r;
-    }
-    else if (auto id = dynamic_cast<ir::Identifier *>(e)) {
-        r = new std::vector<ir::Expr *>();
-        r->push_back(id);
-        return r;
-    }
-    else if (auto de = dynamic_cast<ir::DiffExpr *>(e)) {
-        r = new std::vector<ir::Expr *>();
-        r->push_back(de);
-        return r;
-    }
-    else {
-        err << "skipped term\n";
-        unsupported(e);
-    }
-    return NULL;
-}
-
-ir::Identifier *TopBackEnd::findVar(ir::Expr *e) {
-    assert(e);
-    int nvar = 0;
-    ir::Identifier *ret = NULL;
-    std::vector<ir::Identifier *> ids = getIds(e, false);
-    for (auto id: ids) {
-        if (this->isVar(id->name)) {
-            ret = id;
-            nvar++;
+        case ir::UNARY: {
+            ir::UnaryExpr *ue = static_cast<ir::UnaryExpr *>(e);
+            switch(ue->getOp()) {
+                case '-':
+                    collectTerms(ue->getExpr(), !negate, terms);
+                    return;
+                default:
+                    err << "unsupported unary operator `" << ue->getOp() << "\'\n";
+                    e->display("unsupported unary operator");
+                    exit(EXIT_FAILURE);
+            }
         }
+        case ir::PRODUCT:
+        case ir::INT_VALUE:
+        case ir::FLOAT_VALUE:
+        case ir::IDENTIFIER:
+        case ir::FUNC_CALL:
+        case ir::ARRAY:
+        case ir::DIFF:
+            terms.push_back(std::make_pair(e, negate));
+            return;
+        default:
+            err << "skipped term\n";
+            unsupported(e);
     }
-    if (nvar > 1) {
-        err << "non linear term are not allowed\n";
-        e->display("non linear term in:");
-        exit(EXIT_FAILURE);
-    }
-    return ret;
 }
 
-ir::FuncCall *TopBackEnd::findCoupling(ir::Expr *e) {
+std::vector<std::pair<ir::Expr *, bool>> TopBackEnd::splitIntoTerms(
+        ir::Expr *e, bool negate) {
     assert(e);
-    int nfc = 0;
-    ir::FuncCall *ret = NULL;
-    std::vector<ir::Identifier *> ids = getIds(e);
-    for (auto i: ids) {
-        if (auto fc = isCoupling(i)) {
-            nfc++;
-            ret = fc;
-        }
-    }
-    if (nfc > 1) {
-        err << "non linear term are not allowed\n";
-        e->display("non linear term in:");
-        exit(EXIT_FAILURE);
-    }
-    return ret;
+    std::vector<std::pair<ir::Expr *, bool>> terms;
+    collectTerms(e, negate, terms);
+    return terms;
 }
 
-std::string TopBackEnd::findDerivativeOrder(ir::Identifier *id) {
-    assert(id);
-    int order = 0;
-    ir::Expr *e = id;
+TermAttr TopBackEnd::termAttr(ir::Node *n,
+        const std::vector<const TermAttr *>& children) {
+    ir::Expr *e = ir::dyn_cast<ir::Expr>(n);
     assert(e);
-    if (e->getParent() == NULL) {
-        return "0";
-    }
-    assert(e->getParent());
-
-    if (auto de = dynamic_cast<ir::DiffExpr *>(e->getParent())) {
-        return de->getOrder();
+    TermAttr a;
+    a.power = e->getFpDegree();
+    a.var = NULL;
+    a.nVars = 0;
+    a.derOpen = false;
+    a.coupling = NULL;
+    a.couplings = ir::NameSet::empty();
+    a.avg = NULL;
+    a.nAvgs = 0;
+    a.avgUnhandled = NULL;
+
+    // variables and coupling integrals are looked for everywhere, the node
+    // comes before its children
+    if (auto id = ir::dyn_cast<ir::Identifier>(e)) {
+        if (this->isVar(id)) {
+            a.var = id;
+            a.nVars = 1;
+            a.der = "0";
+            a.derOpen = true;
+        }
+    }
+    if (auto fc = isCoupling(e)) {
+        a.coupling = fc;
+        a.couplings = ir::NameSet::get(fc->name);
+    }
+    int varChild = -1;
+    for (size_t i=0; i<children.size(); i++) {
+        const TermAttr *c = children[i];
+        if (c->var) {
+            a.var = c->var;
+            a.der = c->der;
+            a.derOpen = c->derOpen;
+            varChild = i;
+        }
+        a.nVars += c->nVars;
+        if (a.coupling == NULL)
+            a.coupling = c->coupling;
+        a.couplings = ir::NameSet::merge(a.couplings, c->couplings);
+    }
+
+    // the derivative order of the variable: `' applied to it, or the order
+    // of the derivative whose operand it is
+    if (varChild >= 0 && a.derOpen) {
+        auto ue = ir::dyn_cast<ir::UnaryExpr>(e);
+        auto de = ir::dyn_cast<ir::DiffExpr>(e);
+        if (ue && ue->getOp() == '\'') {
+            a.der = std::to_string(std::stoi(a.der) + 1);
+        }
+        else if (de && e->getChildren()[varChild] == a.var) {
+            a.der = de->getOrder();
+            a.derOpen = false;
+        }
+        else {
+            a.derOpen = false;
+        }
     }
 
-    while (e && e->getParent()) {
-        if (auto ue = dynamic_cast<ir::UnaryExpr *>(e->getParent())) {
-            if (ue->getOp() == '\'') {
-                order++;
-                e = dynamic_cast<ir::Expr *>(ue->getParent());
-                assert(e);
+    // avg calls are looked for in the operands of operators only
+    if (auto fc = isAvg(e)) {
+        a.avg = fc;
+        a.nAvgs = 1;
+        return a;
+    }
+    switch (e->getKind()) {
+        case ir::BINARY:
+        case ir::INDEX_RANGE:
+        case ir::SUM:
+        case ir::PRODUCT:
+        case ir::UNARY:
+            for (auto c: children) {
+                if (a.avg == NULL)
+                    a.avg = c->avg;
+                a.nAvgs += c->nAvgs;
+                if (a.avgUnhandled == NULL)
+                    a.avgUnhandled = c->avgUnhandled;
             }
-            else
-                return std::to_string(order);
-        }
-        else {
             break;
-        }
+        case ir::IDENTIFIER:
+        case ir::FUNC_CALL:
+        case ir::ARRAY:
+        case ir::INT_VALUE:
+        case ir::FLOAT_VALUE:
+            break;
+        default:
+            a.avgUnhandled = e;
     }
-    return std::to_string(order);
+    return a;
 }
 
 int TopBackEnd::findPower(ir::Expr *e) {
     assert(e);
-    int p = 0;
-    if (auto be = dynamic_cast<ir::BinExpr *>(e)) {
-        std::vector<ir::Identifier *> ids;
-        switch (be->getOp()) {
-            case '+':
-                if (findPower(be->getLeftOp()) == findPower(be->getRightOp()))
-                    return findPower(be->getLeftOp());
-                else
-                    unsupported(e);
-                break;
-            case '-':
-                if (findPower(be->getLeftOp()) == findPower(be->getRightOp()))
-                    return findPower(be->getLeftOp());
-                else
-                    unsupported(e);
-                break;
-            case '*':
-                return findPower(be->getLeftOp()) + findPower(be->getRightOp());
-                break;
-            case '^':
-                if (auto v = dynamic_cast<ir::Value<int> *>(be->getRightOp())) {
-                        return findPower(be->getLeftOp()) * v->getValue();
-                }
-                else
-                    unsupported(e);
-                break;
-            case '/':
-                ids = getIds(be->getRightOp());
-                for (auto i: ids) {
-                    if (i->name == "fp") {
+    int p = e->getFpDegree();
+    if (p != ir::NOT_FP_MONOMIAL)
+        return p;
+    // only reached to report the unsupported subexpression: the operands
+    // that are monomials return above
+    p = 0;
+    switch (e->getKind()) {
+        case ir::BINARY:
+        case ir::INDEX_RANGE: {
+            ir::BinExpr *be = static_cast<ir::BinExpr *>(e);
+            switch (be->getOp()) {
+                case '+':
+                case '-':
+                    // the left operand is only evaluated once
+                    p = findPower(be->getLeftOp());
+                    if (p == findPower(be->getRightOp()))
+                        return p;
+                    else
+                        unsupported(e);
+                    break;
+                case '*':
+                    return findPower(be->getLeftOp()) + findPower(be->getRightOp());
+                    break;
+                case '^':
+                    if (auto v = ir::dyn_cast<ir::Value<int> >(be->getRightOp())) {
+                            return findPower(be->getLeftOp()) * v->getValue();
+                    }
+                    else
+                        unsupported(e);
+                    break;
+                case '/':
+                    if (be->getRightOp()->hasAttr(ir::ATTR_FP)) {
                         err << "fp should not appear in the rhs of a div operator\n";
                         unsupported(e);
                     }
-                }
-                return findPower(be->getLeftOp());
-                break;
-            default:
-                unsupported(e);
+                    return findPower(be->getLeftOp());
+                    break;
+                default:
+                    unsupported(e);
+            }
+            break;
         }
-    }
-    else if (auto id = dynamic_cast<ir::Identifier *>(e)) {
-        if (id->name == "fp") {
-            return 1;
+        case ir::SUM: {
+            ir::Sum *sum = static_cast<ir::Sum *>(e);
+            p = findPower(sum->getOperand(0));
+            for (int i=1; i<sum->getNOperands(); i++) {
+                if (findPower(sum->getOperand(i)) != p)
+                    unsupported(e);
+            }
+            return p;
         }
-        else
+        case ir::PRODUCT: {
+            ir::Product *prod = static_cast<ir::Product *>(e);
+            for (int i=0; i<prod->getNOperands(); i++) {
+                p += findPower(prod->getOperand(i));
+            }
+            return p;
+        }
+        case ir::IDENTIFIER:
+        case ir::FUNC_CALL:
+        case ir::ARRAY:
+            if (static_cast<ir::Identifier *>(e)->name == fp.name)
+                return 1;
+            else
+                return 0;
+        case ir::UNARY:
+            return findPower(static_cast<ir::UnaryExpr *>(e)->getExpr());
+        case ir::INT_VALUE:
+        case ir::FLOAT_VALUE:
+        case ir::DIFF:
             return 0;
-    }
-    else if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
-        return findPower(ue->getExpr());
-    }
-    else if (dynamic_cast<ir::Value<int> *>(e)) {
-        return 0;
-    }
-    else if (dynamic_cast<ir::Value<float> *>(e)) {
-        return 0;
-    }
-    else if (dynamic_cast<ir::DiffExpr *>(e)) {
-        return 0;
-    }
-    else {
-        unsupported(e);
+        default:
+            unsupported(e);
     }
     return p;
 }
 
 void TopBackEnd::emitTerm(FortranOutput& fo, Term *term) {
 
-    ir::FuncCall *avg = extractAvg(term->expr);
+    ir::FuncCall *avg = extractAvg(term);
 
     switch(term->getType()) {
         case AS:
@@ -1114,7 +1354,7 @@ void TopBackEnd::emitTerm(FortranOutput& fo, Term *term) {
             break;
         case ARTT:
             if (auto fc = isCoupling(term->expr)) {
-                ir::Expr *arg = dynamic_cast<ir::Expr *>(term->expr->getChildren()[0]);
+                ir::Expr *arg = ir::dyn_cast<ir::Expr>(term->expr->getChildren()[0]);
                 fo << "      call " << fc->name << "(";
                 emitExpr(arg, fo, term->ivar, term->ieq, false);
                 fo << ", ";
@@ -1194,7 +1434,7 @@ void TopBackEnd::emitTerm(FortranOutput& fo, TermBC *term) {
             break;
         case ATTBC:
             if (auto fc = isCoupling(term->expr)) {
-                ir::Expr *arg = dynamic_cast<ir::Expr *>(term->expr->getChildren()[0]);
+                ir::Expr *arg = ir::dyn_cast<ir::Expr>(term->expr->getChildren()[0]);
                 fo << "      call " << fc->name << "bc(";
                 emitExpr(arg, fo, term->ivar, term->ieq, false, bcLoc);
                 fo << ", ";
@@ -1285,26 +1525,20 @@ void TermBC::emitInitIndex(FortranOutput& fo) {
         this->varLoc << " ! var location\n";
 }
 
-int TopBackEnd::ivar(std::string name) {
-    int i = 1;
-    for (auto v: this->vars) {
-        if (v->name == name)
-            return i;
-        i++;
+int TopBackEnd::ivar(ir::Identifier *id) {
+    if (!isVar(id)) {
+        err << "no such variable: `" << id->name << "\'\n";
+        exit(EXIT_FAILURE);
     }
-    err << "no such variable: `" << name << "\'\n";
-    exit(EXIT_FAILURE);
+    return id->getIndex();
 }
 
-int TopBackEnd::ieq(std::string name) {
-    int i = 1;
-    for (auto e: this->prog->getEqs()) {
-        if (e->name == name)
-            return i;
-        i++;
+int TopBackEnd::ieq(ir::Identifier *id) {
+    if (kindOf(id) != ir::EQUATION_NAME) {
+        err << "no such equation: `" << id->name << "\'\n";
+        exit(EXIT_FAILURE);
     }
-    err << "no such equation: `" << name << "\'\n";
-    exit(EXIT_FAILURE);
+    return id->getIndex();
 }
 
 void TopBackEnd::buildVarList() {
@@ -1320,7 +1554,8 @@ void TopBackEnd::emitUseModel(FortranOutput& fo) {
     fo << "      use model, only: ";
     int n = 0;
     for (auto id: this->prog->getSymTab()) {
-        if (isField(id->name) || isScal(id->name)) {
+        if (id->getKind() == ir::FIELD_SYMBOL ||
+                id->getKind() == ir::SCALAR_SYMBOL) {
             if (n > 0) {
                 fo << ", ";
             }
@@ -1331,72 +1566,94 @@ void TopBackEnd::emitUseModel(FortranOutput& fo) {
     fo << "\n";
 }
 
-void TopBackEnd::emitCode(FortranOutput& fo) {
-
-    for (auto e: prog->getEqs()) {
-        fo << "!------------------------------------------------------------\n";
-        fo << "! Indices for equation " << e->name << "\n";
-        fo << "!------------------------------------------------------------\n";
-        fo << "      subroutine eqi_" << e->name << "()\n\n";
-        emitUseModel(fo);
-        fo << "      use inputs\n";
-        fo << "      implicit none\n";
-
-        for (auto t: eqs[e->name]) {
-            t->emitInitIndex(fo);
-            fo << "\n";
-        }
+void TopBackEnd::emitIndices(FortranOutput& fo, const std::string& eqName) {
+    fo << "!------------------------------------------------------------\n";
+    fo << "! Indices for equation " << eqName << "\n";
+    fo << "!------------------------------------------------------------\n";
+    fo << "      subroutine eqi_" << eqName << "()\n\n";
+    emitUseModel(fo);
+    fo << "      use inputs\n";
+    fo << "      implicit none\n";
 
-        fo << "      end subroutine eqi_" << e->name << "\n";
+    for (auto t: eqs[eqName]) {
+        t->emitInitIndex(fo);
+        fo << "\n";
     }
 
-    for (auto e: prog->getEqs()) {
-        int it = 0;
-        fo << "!------------------------------------------------------------\n";
-        fo << "! Coupling coefficients for equation " << e->name << "\n";
-        fo << "!------------------------------------------------------------\n";
-        fo << "      subroutine eq_" << e->name << "()\n\n";
-        emitUseModel(fo);
-        fo << "      implicit none\n";
-        fo << "      integer i, j, jj\n";
+    fo << "      end subroutine eqi_" << eqName << "\n";
+}
 
-        for (auto t: eqs[e->name]) {
-            it++;
-            if (auto tbc = dynamic_cast<TermBC *>(t)) {
-                this->emitTerm(fo, tbc);
-            }
-            else {
-                this->emitTerm(fo, t);
-            }
-            fo << "\n";
+void TopBackEnd::emitCoefficients(FortranOutput& fo,
+        const std::string& eqName) {
+    fo << "!------------------------------------------------------------\n";
+    fo << "! Coupling coefficients for equation " << eqName << "\n";
+    fo << "!------------------------------------------------------------\n";
+    fo << "      subroutine eq_" << eqName << "()\n\n";
+    emitUseModel(fo);
+    fo << "      implicit none\n";
+    fo << "      integer i, j, jj\n";
+
+    for (auto t: eqs[eqName]) {
+        if (auto tbc = dynamic_cast<TermBC *>(t)) {
+            this->emitTerm(fo, tbc);
+        }
+        else {
+            this->emitTerm(fo, t);
         }
-        fo << "      end subroutine eq_" << e->name << "\n\n";
+        fo << "\n";
     }
+    fo << "      end subroutine eq_" << eqName << "\n\n";
+}
+
+void TopBackEnd::emitCode(FortranOutput& fo) {
+    ir::Arena::Scope scope(prog->getArena());
+
+    for (auto e: eqNames)
+        emitIndices(fo, e);
+
+    for (auto e: eqNames)
+        emitCoefficients(fo, e);
 
     this->emitInitA(fo);
 }
 
 void TopBackEnd::emitDeclRHS(FortranOutput& fo, ir::Expr *expr) {
     assert(expr);
-    if (auto be = dynamic_cast<ir::BinExpr *>(expr)) {
+    if (auto be = ir::dyn_cast<ir::BinExpr>(expr)) {
         fo << "(";
         emitDeclRHS(fo, be->getLeftOp());
         fo << be->getOp();
         emitDeclRHS(fo, be->getRightOp());
         fo << ")";
     }
-    else if (auto fc = dynamic_cast<ir::FuncCall *>(expr)) {
+    else if (auto ne = ir::dyn_cast<ir::NaryExpr>(expr)) {
+        fo << "(";
+        for (int i=0; i<ne->getNOperands(); i++) {
+            ir::ScalarExpr *op = ne->getOperand(i);
+            auto ue = ir::dyn_cast<ir::UnaryExpr>(op);
+            if (i > 0 && ne->getOp() == '+' && ue && ue->getOp() == '-') {
+                fo << "-";
+                op = ue->getExpr();
+            }
+            else if (i > 0) {
+                fo << ne->getOp();
+            }
+            emitDeclRHS(fo, op);
+        }
+        fo << ")";
+    }
+    else if (auto fc = ir::dyn_cast<ir::FuncCall>(expr)) {
         int iarg = 0;
         fo << fc->name << "(";
         for (auto arg: fc->getArgs()) {
             if (iarg++ > 0)
                 fo << ", ";
-            emitDeclRHS(fo, dynamic_cast<ir::Expr *>(arg));
+            emitDeclRHS(fo, ir::dyn_cast<ir::Expr>(arg));
         }
         fo << ")";
     }
-    else if (auto id = dynamic_cast<ir::Identifier *>(expr)) {
-        if (!isDef(id->name)) {
+    else if (auto id = ir::dyn_cast<ir::Identifier>(expr)) {
+        if (!isDef(id)) {
             err << id->name << " is undefined\n";
             exit(EXIT_FAILURE);
         }
@@ -1404,10 +1661,10 @@ void TopBackEnd::emitDeclRHS(FortranOutput& fo, ir::Expr *expr) {
             fo << "dm(1)\%";
         fo << id->name;
     }
-    else if (auto val = dynamic_cast<ir::Value<int> *>(expr)) {
+    else if (auto val = ir::dyn_cast<ir::Value<int> >(expr)) {
         fo << val->getValue();
     }
-    else if (auto val = dynamic_cast<ir::Value<float> *>(expr)) {
+    else if (auto val = ir::dyn_cast<ir::Value<float> >(expr)) {
         fo << val->getValue() << "d0";
     }
     else {
@@ -1420,13 +1677,13 @@ void TopBackEnd::emitDecl(FortranOutput& fo, ir::Decl *decl,
         std::map<std::string, bool>& lvar_set,
         std::map<std::string, bool>& leq_set) {
     assert(decl);
-    ir::Expr *lhs = dynamic_cast<ir::Expr *>(decl->getLHS());
-    if (auto fc = dynamic_cast<ir::FuncCall *>(lhs)) {
+    ir::Expr *lhs = ir::dyn_cast<ir::Expr>(decl->getLHS());
+    if (auto fc = ir::dyn_cast<ir::FuncCall>(lhs)) {
 #if 0
         if (fc->name == "lvar") {
-            ir::Identifier *id = dynamic_cast<ir::Identifier *>(fc->getArgs()->at(0));
+            ir::Identifier *id = ir::dyn_cast<ir::Identifier>(fc->getArgs()->at(0));
             assert(id);
-            int ivar = this->ivar(id->name);
+            int ivar = this->ivar(id);
             fo << "      dm(1)\%lvar(1, " << ivar <<
                 ") = ";
             emitDeclRHS(fo, decl->getDef());
@@ -1436,12 +1693,12 @@ void TopBackEnd::emitDecl(FortranOutput& fo, ir::Decl *decl,
         else
 #endif
         if (fc->name == "leq") {
-            ir::Identifier *id = dynamic_cast<ir::Identifier *>(fc->getArgs()[0]);
+            ir::Identifier *id = ir::dyn_cast<ir::Identifier>(fc->getArgs()[0]);
             assert(id);
-            int ieq = this->ieq(id->name);
+            int ieq = this->ieq(id);
             fo << "      dm(1)\%leq(1, " << ieq <<
                 ") = ";
-            emitDeclRHS(fo, dynamic_cast<ir::Expr *>(decl->getDef()));
+            emitDeclRHS(fo, ir::dyn_cast<ir::Expr>(decl->getDef()));
             fo << " ! eq: " << id->name << "\n";
             leq_set[id->name] = true;
         }
@@ -1450,9 +1707,9 @@ void TopBackEnd::emitDecl(FortranOutput& fo, ir::Decl *decl,
             exit(EXIT_FAILURE);
         }
     }
-    else if (auto id = dynamic_cast<ir::Identifier *>(lhs)) {
+    else if (auto id = ir::dyn_cast<ir::Identifier>(lhs)) {
         fo << "      " << id->name << " = ";
-        emitDeclRHS(fo, dynamic_cast<ir::Expr *>(decl->getDef()));
+        emitDeclRHS(fo, ir::dyn_cast<ir::Expr>(decl->getDef()));
         fo << "\n";
     }
     else {
@@ -1463,7 +1720,7 @@ void TopBackEnd::emitDecl(FortranOutput& fo, ir::Decl *decl,
 
 void TopBackEnd::emitInitA(FortranOutput& fo) {
     int nvar = 0;
-    int neq = this->prog->getEqs().size();
+    int neq = eqNames.size();
 
     std::map<std::string, bool> lvar_set;
     std::map<std::string, bool> leq_set;
@@ -1559,8 +1816,8 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
     inputs << "end module inputs\n";
     inputs.close();
 
-    for (auto e: prog->getEqs()) {
-        leq_set[e->name] = false;
+    for (auto e: eqNames) {
+        leq_set[e] = false;
     }
 
     fo << "\n      subroutine init_a()\n\n";
@@ -1588,8 +1845,9 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
     }
 
     if (dim == 2) {
+        int ivar = 1;
         for (auto v: vars) {
-            fo << "      dm(1)%lvar(1, " << ivar(v->name) << ") = ";
+            fo << "      dm(1)%lvar(1, " << ivar++ << ") = ";
             if (v->vectComponent == 3)
                 fo << "abs(m) + 1 - iparity\n";
             else
@@ -1684,12 +1942,12 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
     }
 
     int ieq = 1;
-    for (auto e: this->prog->getEqs()) {
-        fo << "      dm(1)\%eq_name(" << ieq++ << ") = \'" << e->name << "\'\n";
+    for (auto e: eqNames) {
+        fo << "      dm(1)\%eq_name(" << ieq++ << ") = \'" << e << "\'\n";
     }
 
-    for (auto e: this->prog->getEqs()) {
-        fo << "      call eqi_" << e->name << "()\n";
+    for (auto e: eqNames) {
+        fo << "      call eqi_" << e << "()\n";
     }
 
     fo << "      power_max = " << this->powerMax << "\n";
@@ -1730,14 +1988,10 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
     fo << "            ! r_map(1, j) = 1d0\n";
     fo << "      enddo\n";
 
-    for (auto e: this->prog->getEqs()) {
-        fo << "      call eq_" << e->name << "()\n";
+    for (auto e: eqNames) {
+        fo << "      call eq_" << e << "()\n";
     }
 
-    bool *eqHasModifyL0 = new bool[this->eqs.size()];
-    for (int i=0; i<eqs.size(); i++)
-        eqHasModifyL0[i] = false;
-
     std::map<std::string, bool> varLm0Null;
     for (auto v: this->vars) {
         if (v->vectComponent > 1)
@@ -1752,19 +2006,12 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
                 // look for all terms in equation and enforce at least one of them
                 // is not 0 (if l == 0)
                 bool done = false;
-                for (auto e : eqs) {
-                    for (auto t: e.second) {
-                        if (!dynamic_cast<TermBC *>(t)) {
-                            if (t->varName == v->name) {
-                                auto ids = getIds(t->expr, true);
-                                // if (ids.size() == 1 && ids[0]->name == "lh"
-                                //         && done == false) {
-                                if (t->getType() == AR) {
-                                    fo << "      if (lh == 0)";
-                                    fo << t->getMatrix(FULL) << " =  1d0\n";
-                                    done = true;
-                                }
-                            }
+                for (auto& e : summaries) {
+                    for (auto& t: e.second.arTerms) {
+                        if (t.first == v->name) {
+                            fo << "      if (lh == 0)";
+                            fo << t.second << " =  1d0\n";
+                            done = true;
                         }
                     }
                 }
@@ -1776,33 +2023,18 @@ void TopBackEnd::emitInitA(FortranOutput& fo) {
         }
     }
 
-    for (auto e: eqs) {
-        bool eqNeedModifyL0 = true;
-        for (auto t: e.second) {
-            if (t->getType() == AS || t->getType() == AR)
-                eqNeedModifyL0 = false;
-            if (auto fc = isCoupling(t->expr)) {
-                if (std::strstr(fc->name.c_str(), "Illm") && t->llExpr == NULL) {
-                    eqNeedModifyL0 = false;
-                }
-            }
-        }
-        if (eqNeedModifyL0) {
+    for (auto& e: summaries) {
+        const EquationSummary& s = e.second;
+        if (s.needModifyL0) {
             bool modifyCalled = false;
-            for (auto t: e.second) {
-                if (varLm0Null[t->varName] && modifyCalled == false
-#if 1
-                        && (e.first == "eq" + t->varName)
-#endif
-                   ) {
-                    modifyCalled = true;
-                    varLm0Null[t->varName] = false; // do not set twice
-                    fo << "      call modify_l0(" <<  t->getMatrix(FULL);
-                    fo << ", ";
-                    fo << "dm(1)\%lvar(1, " << t->ivar << ")";
-                    fo << ")\n";
-                    break;
-                }
+            // the first term on the variable the equation is named after
+            if (s.l0Var != "" && varLm0Null[s.l0Var]) {
+                modifyCalled = true;
+                varLm0Null[s.l0Var] = false; // do not set twice
+                fo << "      call modify_l0(" <<  s.l0Matrix;
+                fo << ", ";
+                fo << "dm(1)\%lvar(1, " << s.l0Ivar << ")";
+                fo << ")\n";
             }
             if (modifyCalled == false) {
                 err << "could not find a spot to insert modify_l0 in `" <<
@@ -1891,13 +2123,13 @@ void emitTermLaTeX(LatexOutput& lo, Term *term) {
             lo << "1";
             return;
         }
-        if (auto ue = dynamic_cast<ir::UnaryExpr *>(e)) {
+        if (auto ue = ir::dyn_cast<ir::UnaryExpr>(e)) {
             if (ue->getOp() != '-')
                 unsupported(ue);
             lo << "-";
             emitExpr(ue->getExpr());
         }
-        else if (auto be = dynamic_cast<ir::BinExpr *>(e)) {
+        else if (auto be = ir::dyn_cast<ir::BinExpr>(e)) {
             if (be->getOp() == '/') {
                 lo << "\\frac{";
                 emitExpr(be->getLeftOp());
@@ -1939,34 +2171,62 @@ void emitTermLaTeX(LatexOutput& lo, Term *term) {
                     lo << ")";
             }
         }
+        else if (auto ne = ir::dyn_cast<ir::NaryExpr>(e)) {
+            for (int i=0; i<ne->getNOperands(); i++) {
+                ir::ScalarExpr *op = ne->getOperand(i);
+                auto ue = ir::dyn_cast<ir::UnaryExpr>(op);
+                if (i > 0 && ne->getOp() == '+' && ue && ue->getOp() == '-') {
+                    lo << "-";
+                    op = ue->getExpr();
+                    if (op->priority <= ne->priority) {
+                        lo << "(";
+                        emitExpr(op);
+                        lo << ")";
+                        continue;
+                    }
+                }
+                else if (i > 0) {
+                    if (ne->getOp() == '*')
+                        lo << "\\ ";
+                    else
+                        lo << ne->getOp();
+                }
+                if (op->priority < ne->priority) {
+                    lo << "(";
+                }
+                emitExpr(op);
+                if (op->priority < ne->priority)
+                    lo << ")";
+            }
+        }
         else if (auto fc = isCoupling(e)) {
             lo << "\\iint_{4 \\pi}";
             int narg = 0;
             for (auto a: fc->getArgs()) {
                 if (narg++ > 0)
                     lo << ", ";
-                emitExpr(dynamic_cast<ir::Expr *>(a));
+                emitExpr(ir::dyn_cast<ir::Expr>(a));
             }
             lo << getIntegralLaTeX(fc->name);
             lo << "\\ d\\Omega";
         }
-        else if (auto fc = dynamic_cast<ir::FuncCall *>(e)) {
+        else if (auto fc = ir::dyn_cast<ir::FuncCall>(e)) {
             lo << renamer->name(fc->name) << "\\Big(";
             int narg = 0;
             for (auto a: fc->getArgs()) {
                 if (narg++ > 0)
                     lo << ", ";
-                emitExpr(dynamic_cast<ir::Expr *>(a));
+                emitExpr(ir::dyn_cast<ir::Expr>(a));
             }
             lo << "\\Big)";
         }
-        else if (auto id = dynamic_cast<ir::Identifier *>(e)) {
+        else if (auto id = ir::dyn_cast<ir::Identifier>(e)) {
             lo << renamer->name(id->name);
         }
-        else if (auto val = dynamic_cast<ir::Value<int> *>(e)) {
+        else if (auto val = ir::dyn_cast<ir::Value<int> >(e)) {
             lo << val->getValue();
         }
-        else if (auto val = dynamic_cast<ir::Value<float> *>(e)) {
+        else if (auto val = ir::dyn_cast<ir::Value<float> >(e)) {
             lo << val->getValue();
         }
         else {
@@ -1999,7 +2259,7 @@ void emitTermLaTeX(LatexOutput& lo, Term *term) {
     lo << " & ";
 
     ir::Value<float> onef(1);
-    if (auto ue = dynamic_cast<ir::UnaryExpr *>(term->expr)) {
+    if (auto ue = ir::dyn_cast<ir::UnaryExpr>(term->expr)) {
         if (*ue->getExpr() != onef) {
             emitExpr(ue->getExpr());
         }
@@ -2014,7 +2274,7 @@ void emitTermLaTeX(LatexOutput& lo, Term *term) {
     lo << "\\ \\ ";
 }
 
-void TopBackEnd::emitLaTeX(LatexOutput& lo, const std::string renameFile) {
+void TopBackEnd::beginLaTeX(LatexOutput& lo, const std::string& renameFile) {
     renamer = new LaTeXRenamer();
     if (renameFile != "") {
         std::string pattern, rename;
@@ -2032,44 +2292,57 @@ void TopBackEnd::emitLaTeX(LatexOutput& lo, const std::string renameFile) {
     lo << "\\usepackage{amsmath}\n";
     lo << "\\begin{document}\n";
     lo << "Filename: \\texttt{" << escapeLaTeX(this->prog->filename) << "}";
+}
 
-    for (auto e: prog->getEqs()) {
-        lo << "\\subsection*{" << escapeLaTeX(e->name) << "}\n";
-        lo << "\\begin{align*}\n";
-        int n = 0;
-        for (auto t: eqs[e->name]) {
-            if (t->getType() == AS ||
-                    t->getType() == AR ||
-                    t->getType() == ART ||
-                    t->getType() == ARTT) {
-                if (auto ue = dynamic_cast<ir::UnaryExpr *>(t->expr)) {
-                    if (ue->getOp() != '-') {
-                        unsupported(ue);
-                    }
-                    lo << "& -";
-                    lo << "\\\\\n";
-                }
-                else {
-                    if (n > 0) {
-                        lo << "& +";
-                        lo << "\\\\\n";
-                    }
+void TopBackEnd::emitEquationLaTeX(LatexOutput& lo, const std::string& eqName) {
+    lo << "\\subsection*{" << escapeLaTeX(eqName) << "}\n";
+    lo << "\\begin{align*}\n";
+    int n = 0;
+    for (auto t: eqs[eqName]) {
+        if (t->getType() == AS ||
+                t->getType() == AR ||
+                t->getType() == ART ||
+                t->getType() == ARTT) {
+            if (auto ue = ir::dyn_cast<ir::UnaryExpr>(t->expr)) {
+                if (ue->getOp() != '-') {
+                    unsupported(ue);
                 }
-                emitTermLaTeX(lo, t);
-                n++;
-            }
-            else if (t->getType() == ASBC ||
-                    t->getType() == ATBC) {
+                lo << "& -";
+                lo << "\\\\\n";
             }
             else {
-                err << "skipped term in LaTeX output!\n";
-                t->expr->display("skipped term");
+                if (n > 0) {
+                    lo << "& +";
+                    lo << "\\\\\n";
+                }
             }
+            emitTermLaTeX(lo, t);
+            n++;
+        }
+        else if (t->getType() == ASBC ||
+                t->getType() == ATBC) {
+        }
+        else {
+            err << "skipped term in LaTeX output!\n";
+            t->expr->display("skipped term");
         }
-        lo << " & = 0\n";
-        lo << "\\end{align*}\n";
     }
+    lo << " & = 0\n";
+    lo << "\\end{align*}\n";
+}
+
+void TopBackEnd::endLaTeX(LatexOutput& lo) {
     lo << "\\end{document}\n";
+    delete renamer;
+    renamer = NULL;
+}
+
+void TopBackEnd::emitLaTeX(LatexOutput& lo, const std::string renameFile) {
+    ir::Arena::Scope scope(prog->getArena());
+    beginLaTeX(lo, renameFile);
+    for (auto e: eqNames)
+        emitEquationLaTeX(lo, e);
+    endLaTeX(lo);
 }
 
 #undef unsupported
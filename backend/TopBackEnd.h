@@ -3,8 +3,13 @@
 
 #include "config.h"
 #include "BackEnd.h"
+#include "FrontEnd.h"
+#include "Analysis.h"
+#include "PassManager.h"
+#include "Rewrite.h"
 #include "SymTab.h"
 
+#include <fstream>
 #include <map>
 
 std::string escapeLaTeX(const std::string&);
@@ -51,6 +56,33 @@ class LlExpr {
 };
 
 class TopBackEnd;
+
+///
+/// What the backend needs to know about a term, synthesized bottom-up for
+/// every subexpression of the term in one traversal (see
+/// TopBackEnd::termAttr)
+///
+struct TermAttr {
+    /// degree in fp (ir::NOT_FP_MONOMIAL if it is not a monomial in fp)
+    int power;
+    /// the variable (the last one if there are several) and the number of
+    /// occurrences of variables
+    ir::Identifier *var;
+    int nVars;
+    /// derivative order of the variable, it is still derived (by `'') if
+    /// derOpen is set
+    std::string der;
+    bool derOpen;
+    /// first coupling integral (as `Illm(rho)'), and the names of the
+    /// coupling integrals
+    ir::FuncCall *coupling;
+    const ir::NameSet *couplings;
+    /// avg call, number of avg calls, and first subexpression where they
+    /// are not looked for (see TopBackEnd::extractAvg)
+    ir::FuncCall *avg;
+    int nAvgs;
+    ir::Expr *avgUnhandled;
+};
 class Term {
 
     protected:
@@ -59,7 +91,11 @@ class Term {
     public:
         ir::Expr *expr;
         LlExpr *llExpr;
-        ir::Symbol var;
+        /// avg calls of expr (see TermAttr)
+        ir::FuncCall *avg;
+        int nAvgs;
+        ir::Expr *avgUnhandled;
+        ir::Variable var;
         int power;
         std::string der;
         int ivar;
@@ -69,15 +105,19 @@ class Term {
 
         int idx;
 
-        Term(ir::Expr *expr, ir::Expr *llTerm, ir::Symbol var,
+        Term(ir::Expr *expr, ir::Expr *llTerm, ir::Variable var,
                 int power, std::string der, int ivar, std::string varName,
                 TopBackEnd* backend);
+        /// the term owns its llExpr (its expressions belong to the program)
+        virtual ~Term();
+        Term(const Term&) = delete;
+        Term& operator=(const Term&) = delete;
         virtual TermType getType();
         std::string getMatrix(IndexType);
         std::string getMatrixI();
         virtual void emitInitIndex(FortranOutput& o);
 
-        TopBackEnd *getBackend();
+        TopBackEnd *getBackend() const;
 };
 
 class TermBC : public Term {
@@ -85,21 +125,61 @@ class TermBC : public Term {
         std::string varLoc;
         std::string eqLoc;
 
-        TermBC(Term);
+        TermBC(const Term&);
         virtual TermType getType();
         virtual void emitInitIndex(FortranOutput& o);
 };
 
-class TopBackEnd : public BackEnd {
+class TopBackEnd : public BackEnd, public EquationSink {
 
-    static const std::map<std::string, ir::Symbol *> internalVariables;
+    static const std::map<std::string, ir::Param> internalVariables;
 
     private:
+        /// what init_a needs to know about an equation (when streaming, the
+        /// terms of an equation are deleted once it is emitted)
+        struct EquationSummary {
+            /// matrices of the AR terms (but BCs) and their variables (in
+            /// 1D only)
+            std::list<std::pair<std::string, std::string>> arTerms;
+            /// no term of the equation is set at l = 0
+            bool needModifyL0;
+            /// first term on the variable the equation is named after
+            /// (eq<var>): its variable, matrix and variable index
+            std::string l0Var;
+            std::string l0Matrix;
+            int l0Ivar;
+        };
+
         ir::Program *prog;
         std::list<ir::Variable *> vars;
         std::map<std::string, std::list<Term *>> eqs;
-
-        std::vector<ir::Expr *> *splitIntoTerms(ir::Expr *);
+        /// equations in program order, and the summaries init_a uses
+        std::vector<std::string> eqNames;
+        std::map<std::string, EquationSummary> summaries;
+
+        /// outputs of a stream: the coefficients of the equations are
+        /// emitted after all the indices, they are spooled to a temporary
+        /// file meanwhile
+        FortranOutput *out;
+        LatexOutput *latex;
+        std::string renameFile;
+        std::fstream spool;
+        FortranOutput *spoolOutput;
+
+        /// the pipeline: names and variables of the program, then the
+        /// format and the terms of each equation
+        ir::PassManager passes;
+        /// formatted equations (see formatEquation), by equation
+        std::map<ir::Equation *, ir::Equation *> formatted;
+        /// attributes of the terms of a formatted equation, evaluated on
+        /// demand
+        ir::PassManager::AnalysisId<Fold<TermAttr>> termAttrs;
+        void addPasses();
+
+        /// terms of e, with their sign (true if the term is subtracted): the
+        /// terms are the subexpressions of e, they are not negated in place
+        std::vector<std::pair<ir::Expr *, bool>> splitIntoTerms(ir::Expr *e,
+                bool negate = false);
         void emitTermI(FortranOutput&, Term *);
         void emitTermI(FortranOutput&, TermBC *);
 
@@ -112,16 +192,22 @@ class TopBackEnd : public BackEnd {
                 bool emitLlExpr = false,
                 std::string bcLocation = "");
 
-        ir::Identifier *findVar(ir::Expr *e);
-        ir::FuncCall *findCoupling(ir::Expr *e);
-        std::string findDerivativeOrder(ir::Identifier *);
+        /// attributes of a node of a term, from those of its children (the
+        /// rule of the Fold evaluating the terms)
+        TermAttr termAttr(ir::Node *, const std::vector<const TermAttr *>&);
+        /// reports why a term is not a monomial in fp
         int findPower(ir::Expr *);
-        ir::FuncCall *extractAvg(ir::Expr *);
+        /// avg call of the coefficient of a term (NULL if none)
+        ir::FuncCall *extractAvg(Term *);
         ir::Expr *extractLlExpr(ir::Expr *);
 
+        /// rules of simplify: the derivatives (`u''' and `dr(u, 3)') are
+        /// folded into DiffExpr, and negated integers into constants
+        RewriteRules simplifications;
+        void addSimplifications();
         void simplify(ir::Expr *);
 
-        void checkCoupling(ir::Expr *expr);
+        void checkCoupling(ir::FuncCall *coupling);
         void emitUseModel(FortranOutput&);
         void emitInitA(FortranOutput&);
         void emitDecl(FortranOutput&, ir::Decl *,
@@ -139,33 +225,61 @@ class TopBackEnd : public BackEnd {
 
         int powerMax;
 
-        void buildTermList(std::list<ir::Equation *>);
+        void initCounters();
+        void setProgram(ir::Program *);
+        /// builds the terms of an equation (formatted) and its summary
+        void buildTerms(ir::Equation *, int ieq);
         void emitDeclRHS(FortranOutput& fo, ir::Expr *expr);
 
-        std::list<ir::Equation *> formatEquations();
+        /// returns the equation as `expr = 0' (simplified)
+        ir::Equation *formatEquation(ir::Equation *);
+
+        /// subroutines setting the indices and the coefficients of the
+        /// terms of an equation
+        void emitIndices(FortranOutput&, const std::string& eqName);
+        void emitCoefficients(FortranOutput&, const std::string& eqName);
+
+        void beginLaTeX(LatexOutput&, const std::string& renameFile);
+        void emitEquationLaTeX(LatexOutput&, const std::string& eqName);
+        void endLaTeX(LatexOutput&);
 
         void buildVarList();
         int computeTermIndex(Term *);
         DerivativeType derType;
 
         /// this constructs a Term object based on the expression given as
-        /// argument
-        Term *buildTerm(ir::Expr *);
+        /// argument (a term of the formatted equation e, subtracted if negate
+        /// is set)
+        Term *buildTerm(ir::Expr *, ir::Equation *e, bool negate = false);
 
     public:
         const int dim;
-        int ivar(std::string);
-        int ieq(std::string);
+        /// index of a variable / of an equation (starting at 1)
+        int ivar(ir::Identifier *);
+        int ieq(ir::Identifier *);
         TopBackEnd(ir::Program *p, DerivativeType, int dim = 2);
+        /// backend of a stream (see FrontEnd::stream): the code of each
+        /// equation is emitted as soon as the equation is parsed, to fo (and
+        /// to lo in LaTeX if not NULL)
+        TopBackEnd(DerivativeType, int dim, FortranOutput& fo,
+                LatexOutput *lo = NULL, const std::string renameFile = "");
         ~TopBackEnd();
         void emitCode(FortranOutput& of);
         void emitLaTeX(LatexOutput& lo, const std::string = "");
-
-        bool isVar(std::string);
-        bool isField(std::string);
-        bool isParam(std::string);
-        bool isScal(std::string);
-        bool isDef(std::string);
+        /// time spent in each pass (see ir::PassManager::report)
+        void reportPasses(std::ostream&) const;
+
+        virtual void begin(ir::Program *);
+        virtual void equation(ir::Equation *);
+        virtual void end();
+
+        /// what the identifier refers to (binds it if needed)
+        ir::SymbolKind kindOf(ir::Identifier *);
+        bool isVar(ir::Identifier *);
+        bool isField(ir::Identifier *);
+        bool isParam(ir::Identifier *);
+        bool isScal(ir::Identifier *);
+        bool isDef(ir::Identifier *);
 
 };
 
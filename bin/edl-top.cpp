@@ -1,6 +1,5 @@
 #include "config.h"
 #include "IR.h"
-#include "parser.hpp"
 #include "Printer.h"
 #include "FrontEnd.h"
 #include "TopBackEnd.h"
@@ -15,26 +14,17 @@ extern "C" {
 #include <unistd.h>
 }
 
-
-extern int yylineno;
-extern int yylex();
-extern int yyerror(const char *s);
-
-extern FILE *yyin;
-
 void usage(char *bin) {
-    fprintf(stderr, "Usage: %s <input> [-o <output] [-f] [-v level]\n", bin);
+    fprintf(stderr, "Usage: %s <input | -> [-o <output] [-f] [-v level]\n", bin);
 }
 
 void help(char *bin) {
     usage(bin);
     std::cerr << "OPTIONS:\n";
     std::cerr << std::left << std::setw(16) << "  -o filename" <<
-        "\toutput file name\n";
-    // std::cerr << std::setw(20) <<
-    //     std::setw(30) << " (default: standard output)\n";
+        "\twrites the graph of the program (dot) instead of displaying it\n";
     std::cerr << std::setw(16) << "  -f" <<
-        "\tforce: override output file (if exists)\n";
+        "\tforce: override output files (if they exist)\n";
     std::cerr << std::setw(16) << "  -h" <<
         "\thelp: display this help\n";
     std::cerr << std::setw(16) << "  -v level" <<
@@ -45,12 +35,13 @@ void help(char *bin) {
 
 int main(int argc, char* argv[]) {
     {
+        std::string *filename = NULL;
         std::string *outFileName = NULL, *latexFileName = NULL;
         char c;
         int nfile = 0;
         bool force = false, latex = false;
 
-        Printer::init();
+        logger::Printer::init();
 
         while ((c = getopt(argc, argv, "o:fhv:l:")) != EOF) {
             switch (c) {
@@ -65,7 +56,7 @@ int main(int argc, char* argv[]) {
                     outFileName = new std::string(optarg);
                     break;
                 case 'v':
-                    Printer::init(atoi(optarg));
+                    logger::Printer::init(atoi(optarg));
                     break;
                 case 'l':
                     latex = true;
@@ -75,12 +66,8 @@ int main(int argc, char* argv[]) {
         }
         if (optind < argc) {
             while ((optind + nfile) < argc) {
+                // opened by the frontend, - reads the standard input
                 filename = new std::string(argv[optind + nfile]);
-                yyin = fopen(filename->c_str(), "r");
-                if (!yyin) {
-                    err << "cannot open input file `" << *filename << "'\n";
-                    exit(EXIT_FAILURE);
-                }
                 nfile++;
             }
         }
@@ -90,9 +77,11 @@ int main(int argc, char* argv[]) {
         }
 
 
-        if (!force && access(optarg, F_OK) != -1) {
-            err << "File `" << optarg << "' already exists\n";
-            exit(EXIT_FAILURE);
+        for (auto f: {outFileName, latexFileName}) {
+            if (f && !force && access(f->c_str(), F_OK) != -1) {
+                logger::err << "File `" << *f << "' already exists\n";
+                exit(EXIT_FAILURE);
+            }
         }
 
         FrontEnd fe;
@@ -102,10 +91,24 @@ int main(int argc, char* argv[]) {
         std::cout << "after parsing: "
             << ir::Node::getNodeNumber() << " nodes\n";
 
-        p->display();
+        if (outFileName) {
+            std::ofstream ofs(*outFileName);
+            p->dumpDOT(ofs, p->filename);
+        }
+        else {
+            p->display();
+        }
+
+        if (latex) {
+            TopBackEnd backend(p, CHEB);
+            std::ofstream lofs(*latexFileName);
+            LatexOutput lo(lofs);
+            backend.emitLaTeX(lo);
+        }
 
-        fclose(yyin);
         delete filename;
+        delete outFileName;
+        delete latexFileName;
         delete p;
         std::cout << "after delete prog: "
             << ir::Node::getNodeNumber() << " nodes\n";
@@ -1,29 +1,25 @@
 #include "config.h"
 #include "IR.h"
-#include "parser.hpp"
+#include "FlatIR.h"
 #include "Printer.h"
 #include "FrontEnd.h"
 #include "TopBackEnd.h"
+#include "MemStats.h"
 
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <string>
 #include <list>
+#include <vector>
 
 extern "C" {
 #include <unistd.h>
 }
 
 
-extern int yylineno;
-extern int yylex();
-extern int yyerror(const char *s);
-
-extern FILE *yyin;
-
 void usage(char *bin) {
-    fprintf(stderr, "Usage: %s <input>\n", bin);
+    fprintf(stderr, "Usage: %s <input> (- for standard input)\n", bin);
 }
 
 void help(char *bin) {
@@ -45,21 +41,41 @@ void help(char *bin) {
         "\trenaming file for LaTeX output\n";
     std::cerr << std::setw(16) << "  -t derivative_type" <<
         "\tradial derivative type (CHEB or FD)\n";
+    std::cerr << std::setw(16) << "  -m" <<
+        "\tprint the live nodes and bytes after each phase\n";
+    std::cerr << std::setw(16) << "  -s" <<
+        "\tuse the hand-written scanner instead of flex\n";
+    std::cerr << std::setw(16) << "  -j n" <<
+        "\tparse the equations on n threads\n";
+    std::cerr << std::setw(16) << "  -S" <<
+        "\tstream: emit each equation as soon as it is parsed\n";
+    std::cerr << std::setw(16) << "  -c filename" <<
+        "\tprecompile the model into filename (an input of readeq or edl-top)\n";
+    std::cerr << std::setw(16) << "  -I dir" <<
+        "\tsearch the imported modules in dir\n";
+    std::cerr << std::setw(16) << "  -p" <<
+        "\tprint the time spent in each pass of the backend\n";
 }
 
 int main(int argc, char* argv[]) {
+    std::string *filename = NULL;
     std::string *outFileName = NULL, *latexFileName = NULL;
+    std::string *precompiledFileName = NULL;
     std::string renameFile("");
     char c;
     int nfile = 0;
-    bool force = false, latex = false;
+    bool force = false, latex = false, memStats = false, stream = false;
+    bool passStats = false;
+    LexerType lexerType = FLEX_LEXER;
+    int nThreads = 1;
+    std::vector<std::string> importPaths;
     int dim = 2;
     std::string derTypeOpt("not set");
     DerivativeType derType;
 
     logger::Printer::init();
 
-    while ((c = getopt(argc, argv, "o:fhv:l:d:r:t:")) != EOF) {
+    while ((c = getopt(argc, argv, "o:fhv:l:d:r:t:msj:Sc:I:p")) != EOF) {
         switch (c) {
         case 'h':
             help(argv[0]);
@@ -81,6 +97,27 @@ int main(int argc, char* argv[]) {
         case 'r':
             renameFile = std::string(optarg);
             break;
+        case 'm':
+            memStats = true;
+            break;
+        case 's':
+            lexerType = HAND_LEXER;
+            break;
+        case 'j':
+            nThreads = atoi(optarg);
+            break;
+        case 'S':
+            stream = true;
+            break;
+        case 'c':
+            precompiledFileName = new std::string(optarg);
+            break;
+        case 'I':
+            importPaths.push_back(optarg);
+            break;
+        case 'p':
+            passStats = true;
+            break;
         case 'd':
             dim = atoi(optarg);
             if (dim != 1 && dim != 2) {
@@ -105,12 +142,8 @@ int main(int argc, char* argv[]) {
     }
     if (optind < argc) {
         while ((optind + nfile) < argc) {
+            // opened by the frontend
             filename = new std::string(argv[optind + nfile]);
-            yyin = fopen(filename->c_str(), "r");
-            if (!yyin) {
-                logger::err << "cannot open input file `" << *filename << "'\n";
-                exit(EXIT_FAILURE);
-            }
             nfile++;
         }
     }
@@ -130,33 +163,107 @@ int main(int argc, char* argv[]) {
     //     exit(EXIT_FAILURE);
     // }
 
-    FrontEnd fe;
-    ir::Program *p = fe.parse(*filename);
-    TopBackEnd topBackEnd(p, derType, dim);
+    FrontEnd fe(lexerType, nThreads);
+    for (auto& dir: importPaths)
+        fe.addImportPath(dir);
+    ir::Program *p;
+    if (precompiledFileName) {
+        // written before the backend modifies the program
+        if (stream) {
+            logger::err << "a streamed model cannot be precompiled\n";
+            exit(EXIT_FAILURE);
+        }
+        if (!force && access(precompiledFileName->c_str(), F_OK) != -1) {
+            logger::err << "File `" << *precompiledFileName <<
+                "' already exists\n";
+            exit(EXIT_FAILURE);
+        }
+        p = fe.parse(*filename);
+        std::ofstream pofs(*precompiledFileName, std::ios::binary);
+        ir::FlatIR(p).write(pofs);
+        pofs.close();
+        if (!pofs) {
+            logger::err << "cannot write `" << *precompiledFileName << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        delete p;
+        delete filename;
+        delete precompiledFileName;
+        return 0;
+    }
+
+    ir::MemStats stats;
+    TopBackEnd *topBackEnd;
     FortranOutput *o;
     std::ofstream ofs;
-    if (outFileName) {
-        ofs.open(*outFileName);
-        o = new FortranOutput(ofs);
+    if (stream) {
+        // the equations are emitted as they are parsed
+        if (outFileName) {
+            ofs.open(*outFileName);
+            o = new FortranOutput(ofs);
+        }
+        else {
+            o = new FortranOutput(std::cout);
+        }
+        LatexOutput *lo = NULL;
+        std::ofstream lofs;
+        if (latex) {
+            lofs.open(*latexFileName);
+            lo = new LatexOutput(lofs);
+        }
+        topBackEnd = new TopBackEnd(derType, dim, *o, lo, renameFile);
+        stats.begin("stream");
+        p = fe.stream(*filename, *topBackEnd);
+        if (latex) {
+            lofs.close();
+            delete lo;
+        }
     }
     else {
-        o = new FortranOutput(std::cout);
-    }
+        stats.begin("parse");
+        p = fe.parse(*filename);
+        stats.begin("backend");
+        topBackEnd = new TopBackEnd(p, derType, dim);
+        stats.begin("emit");
+        if (outFileName) {
+            ofs.open(*outFileName);
+            o = new FortranOutput(ofs);
+        }
+        else {
+            o = new FortranOutput(std::cout);
+        }
 
-    if (latex) {
-        LatexOutput *lo;
-        std::ofstream lofs;
-        lofs.open(*latexFileName);
-        lo = new LatexOutput(lofs);
-        topBackEnd.emitLaTeX(*lo, renameFile);
-        lofs.close();
+        if (latex) {
+            LatexOutput *lo;
+            std::ofstream lofs;
+            lofs.open(*latexFileName);
+            lo = new LatexOutput(lofs);
+            topBackEnd->emitLaTeX(*lo, renameFile);
+            lofs.close();
+            delete lo;
+        }
+
+        topBackEnd->emitCode(*o);
     }
 
-    topBackEnd.emitCode(*o);
+#ifdef ARENA_STATS
+    if (p->getArena())
+        p->getArena()->report(std::cerr, p->filename);
+#endif
 
     delete o;
+    if (passStats)
+        topBackEnd->reportPasses(std::cerr);
+    stats.begin("release");
+    delete topBackEnd;
+    delete p;
+    stats.end();
+
+    if (memStats)
+        stats.report(std::cerr);
 
-    fclose(yyin);
     delete filename;
+    delete outFileName;
+    delete latexFileName;
     return 0;
 }
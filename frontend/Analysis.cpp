@@ -1,22 +1,14 @@
 #include "Analysis.h"
 
 #include <cassert>
+#include <unordered_set>
 
 std::vector<ir::Identifier *> getIds(ir::Expr *e, bool uniq) {
     std::vector<ir::Identifier *> ret;
-    Analysis<ir::Identifier> a;
-    auto addIdentifiers = [&ret, &uniq] (ir::Identifier *id) {
-        bool add = true;
-        // check if id is already in ret
-        if (uniq) {
-            for (auto i: ret) {
-                if (i->name == id->name)
-                    add = false;
-            }
-        }
-        if (add)
-            ret.push_back(id);
-    };
-    a.run(addIdentifiers, e);
+    std::unordered_set<ir::Name> names;
+    forEach<ir::Identifier>(e, [&ret, &names, uniq] (ir::Identifier *id) {
+            if (!uniq || names.insert(id->name).second)
+                ret.push_back(id);
+        });
     return ret;
 }
@@ -5,31 +5,194 @@
 #include "IR.h"
 
 #include <functional>
+#include <unordered_map>
+#include <vector>
 
+/// what a traversal does after a node is visited
+typedef enum {
+    /// goes on (with the children of the node, in preorder)
+    VISIT_CONTINUE,
+    /// does not visit the children of the node (in preorder): the postorder
+    /// hook of the node is still called
+    VISIT_SKIP,
+    /// ends the traversal
+    VISIT_STOP
+} VisitAction;
+
+///
+/// Depth-first traversal of a tree, with an explicit stack: the depth of the
+/// tree is not limited by the call stack.
+///
+/// Each node is given to the preorder hook before its children, and to the
+/// postorder hook after them. The children of a node are read when its
+/// preorder hook returns, so that the hook may replace the node (its old
+/// children are then visited) or modify its subtree. Hooks can be
+/// restricted to the nodes of a class (as `pre<ir::Identifier>(...)'), the
+/// other nodes are traversed without being given to them.
+///
+class Traversal {
+    public:
+        typedef std::function<VisitAction (ir::Node *)> Hook;
+
+        inline Traversal() { }
+
+        inline Traversal& pre(Hook h) {
+            preHook = h;
+            return *this;
+        }
+        inline Traversal& post(Hook h) {
+            postHook = h;
+            return *this;
+        }
+        template<class T>
+        inline Traversal& pre(std::function<VisitAction (T *)> h) {
+            return pre(filter(h));
+        }
+        template<class T>
+        inline Traversal& post(std::function<VisitAction (T *)> h) {
+            return post(filter(h));
+        }
+
+        /// returns false if a hook stopped the traversal
+        inline bool run(ir::Node *root) {
+            // nodes to visit, and whether their children are pushed
+            std::vector<std::pair<ir::Node *, bool>> stack;
+            stack.push_back(std::make_pair(root, false));
+            while (!stack.empty()) {
+                ir::Node *n = stack.back().first;
+                if (stack.back().second) {
+                    stack.pop_back();
+                    if (postHook && postHook(n) == VISIT_STOP)
+                        return false;
+                    continue;
+                }
+                stack.back().second = true;
+                VisitAction a = preHook ? preHook(n) : VISIT_CONTINUE;
+                if (a == VISIT_STOP)
+                    return false;
+                if (a == VISIT_SKIP)
+                    continue;
+                ir::ChildArray& children = n->getChildren();
+                for (size_t i=children.size(); i>0; i--)
+                    stack.push_back(std::make_pair(children[i-1], false));
+            }
+            return true;
+        }
+
+    private:
+        Hook preHook;
+        Hook postHook;
+
+        template<class T>
+        static inline Hook filter(std::function<VisitAction (T *)> h) {
+            return [h] (ir::Node *n) {
+                if (T *t = ir::dyn_cast<T>(n))
+                    return h(t);
+                return VISIT_CONTINUE;
+            };
+        }
+};
+
+/// gives the nodes of class T to f, in preorder
+template<class T>
+inline void forEach(ir::Node *root, std::function<void (T *)> f) {
+    Traversal().pre<T>([&f] (T *n) {
+            f(n);
+            return VISIT_CONTINUE;
+        }).run(root);
+}
+
+/// returns the first node of class T (in preorder) satisfying p, NULL if
+/// there is none: the traversal stops there
+template<class T>
+inline T *findFirst(ir::Node *root, std::function<bool (T *)> p) {
+    T *found = NULL;
+    Traversal().pre<T>([&found, &p] (T *n) {
+            if (!p(n))
+                return VISIT_CONTINUE;
+            found = n;
+            return VISIT_STOP;
+        }).run(root);
+    return found;
+}
+
+///
+/// Visits the nodes of class T in preorder (see forEach).
+///
 template<class T>
 class Analysis {
     public:
         inline Analysis() { }
 
         inline void run(std::function<void (T *)> check, ir::Node *root) {
-            if (T *n = dynamic_cast<T *>(root)) {
-                check(n);
-            }
-            for (auto c:root->getChildren()) {
-                run(check, c);
-            }
+            forEach<T>(root, check);
         }
-        inline ir::Node *run(std::function<ir::Node *(T *)> check, ir::Node *root) {
-            if (T *n = dynamic_cast<T *>(root)) {
-                check(n);
-            }
-            for (auto c:root->getChildren()) {
-                run(check, c);
-            }
-            return NULL;
+        /// returns the first non NULL result of check (the traversal stops
+        /// there), NULL if there is none
+        inline ir::Node *run(std::function<ir::Node *(T *)> check,
+                ir::Node *root) {
+            ir::Node *ret = NULL;
+            findFirst<T>(root, [&ret, &check] (T *n) {
+                    ret = check(n);
+                    return ret != NULL;
+                });
+            return ret;
+        }
+};
+
+///
+/// Bottom-up evaluation of a synthesized attribute: the attribute of a node
+/// is computed by a rule, from the node and the attributes of its children.
+/// Attributes are memoized per node, so that a tree (or a DAG of shared
+/// nodes) is evaluated in one linear postorder traversal; several attributes
+/// are evaluated together by gathering them in one structure.
+///
+template<class A>
+class Fold {
+    public:
+        /// computes the attribute of a node from those of its children (in
+        /// the order of the children)
+        typedef std::function<A (ir::Node *, const std::vector<const A *>&)>
+            Rule;
+
+        inline Fold(Rule rule) : rule(rule) { }
+
+        /// attribute of a node (the nodes of its subtree are evaluated if
+        /// they are not yet)
+        inline const A& operator()(ir::Node *n) {
+            auto it = memo.find(n);
+            if (it != memo.end())
+                return it->second;
+            // the nodes already evaluated are not traversed again (shared
+            // nodes are met several times)
+            Traversal().pre([this] (ir::Node *m) {
+                    return memo.count(m) ? VISIT_SKIP : VISIT_CONTINUE;
+                }).post([this] (ir::Node *m) {
+                    if (memo.count(m))
+                        return VISIT_CONTINUE;
+                    std::vector<const A *> children;
+                    children.reserve(m->getChildren().size());
+                    for (auto c: m->getChildren())
+                        children.push_back(&memo.find(c)->second);
+                    // references to the elements of the map stay valid
+                    // when it grows
+                    memo.emplace(m, rule(m, children));
+                    return VISIT_CONTINUE;
+                }).run(n);
+            return memo.find(n)->second;
+        }
+
+        /// forgets the attributes (when the nodes are modified or deleted)
+        inline void clear() {
+            memo.clear();
         }
+
+    private:
+        Rule rule;
+        std::unordered_map<ir::Node *, A> memo;
 };
 
+/// identifiers of e in preorder (only the first one of each name if uniq)
 std::vector<ir::Identifier *> getIds(ir::Expr *e, bool uniq=true);
 
 // ir::Expr *factorize(ir::Expr *);
@@ -1,26 +1,526 @@
 #include "FrontEnd.h"
+#include "ParseContext.h"
+#include "Lexer.h"
 #include "Printer.h"
+#include "FlatIR.h"
 
-std::string *filename = NULL;
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
 
-FrontEnd::FrontEnd() {}
+extern "C" {
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+// $EDL_CACHE, or ~/.cache/edl
+static std::string defaultCacheDir() {
+    if (const char *dir = getenv("EDL_CACHE"))
+        return dir;
+    if (const char *home = getenv("HOME"))
+        return std::string(home) + "/.cache/edl";
+    return "";
+}
+
+FrontEnd::FrontEnd(LexerType lexerType, int nThreads) :
+    lexerType(lexerType), nThreads(nThreads), sink(NULL),
+    cacheDir(defaultCacheDir()) {}
+
+void FrontEnd::addImportPath(const std::string& dir) {
+    importPaths.push_back(dir);
+}
+
+void FrontEnd::setCacheDir(const std::string& dir) {
+    cacheDir = dir;
+}
 
 ir::Program *FrontEnd::parse(char *file) {
     std::string f = std::string(file);
     return parse(f);
 }
 
-ir::Program *FrontEnd::parse(const std::string& file) {
-    std::string f = std::string(file);
+ir::Program *FrontEnd::parse(std::string &file) {
+    const std::string& f = file;
     return parse(f);
 }
 
-ir::Program *FrontEnd::parse(std::string &file) {
-    filename = &file;
-    yyin = fopen(file.c_str(), "r");
-    if (!yyin) {
+ir::Program *FrontEnd::stream(const std::string& file, EquationSink& s) {
+    sink = &s;
+    ir::Program *prog = parse(file);
+    sink = NULL;
+    s.end();
+    return prog;
+}
+
+// reads what is left of fd
+static bool readAll(int fd, std::string& text) {
+    char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n > 0)
+            text.append(buf, n);
+        else if (n == 0)
+            return true;
+        else if (errno != EINTR)
+            return false;
+    }
+}
+
+ir::Program *FrontEnd::parse(const std::string& file) {
+    if (file == "-") {
+        std::string text;
+        if (!readAll(STDIN_FILENO, text)) {
+            logger::err << "cannot read standard input\n";
+            exit(EXIT_FAILURE);
+        }
+        return parseBuffer(text.data(), text.size(), "<stdin>");
+    }
+
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1) {
         logger::err << "cannot open input file `" << file << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t len = st.st_size;
+        size_t page = sysconf(_SC_PAGESIZE);
+        // the hand-written scanner (also used by parallel parses) reads the
+        // mapping as it is. The end of the last page of the file reads as
+        // zeros: when it holds the two NULs flex expects, flex scans the
+        // file in place too (the mapping is private, flex writes to its own
+        // copy of the pages)
+        bool inPlace = lexerType == FLEX_LEXER &&
+            (nThreads <= 1 || sink != NULL) &&
+            len % page != 0 && page - len % page >= 2;
+        size_t size = inPlace ? len + 2 : len;
+        int prot = inPlace ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *map = mmap(NULL, size, prot, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            ir::Program *prog;
+            if (inPlace)
+                prog = parseInPlace(static_cast<char *>(map), size, file);
+            else
+                prog = parseBuffer(static_cast<char *>(map), len, file);
+            munmap(map, size);
+            return prog;
+        }
+    }
+
+    // pipes, terminals, or files that cannot be mapped
+    std::string text;
+    if (!readAll(fd, text)) {
+        logger::err << "cannot read input file `" << file << "'\n";
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return parseBuffer(text.data(), text.size(), file);
+}
+
+// runs the parser on the input the scanner has been given
+static ir::Program *run(ParseContext& ctx, yyscan_t scanner) {
+    ir::Arena *arena = new ir::Arena();
+    {
+        ir::Arena::Scope scope(arena);
+        yyparse(&ctx, scanner);
+    }
+    ctx.prog->setArena(arena);
+    return ctx.prog;
+}
+
+ir::Program *FrontEnd::parseBuffer(const char *buf, size_t len,
+        const std::string& name) {
+    if (ir::FlatIR::isBinary(buf, len))
+        return load(buf, len, name);
+
+    if (nThreads > 1 && sink == NULL) {
+        ir::Program *prog = parseParallel(buf, len, name);
+        if (prog)
+            return prog;
+    }
+
+    ParseContext ctx(name);
+    ctx.sink = sink;
+    ctx.frontEnd = this;
+    if (lexerType == HAND_LEXER) {
+        Lexer lexer(buf, len);
+        ctx.lexer = &lexer;
+        return run(ctx, NULL);
+    }
+
+    yyscan_t scanner;
+    yylex_init_extra(&ctx, &scanner);
+    void *buffer = scanBytes(buf, len, scanner);
+
+    ir::Program *prog = run(ctx, scanner);
+
+    deleteScanBuffer(buffer, scanner);
+    yylex_destroy(scanner);
+    return prog;
+}
+
+ir::Program *FrontEnd::parseInPlace(char *base, size_t size,
+        const std::string& name) {
+    if (ir::FlatIR::isBinary(base, size - 2))
+        return load(base, size - 2, name);
+
+    ParseContext ctx(name);
+    ctx.sink = sink;
+    ctx.frontEnd = this;
+    yyscan_t scanner;
+    yylex_init_extra(&ctx, &scanner);
+    void *buffer = scanBuffer(base, size, scanner);
+    if (buffer == NULL) {
+        logger::err << "input of `" << name << "' is not NUL terminated\n";
+        exit(EXIT_FAILURE);
+    }
+
+    ir::Program *prog = run(ctx, scanner);
+
+    deleteScanBuffer(buffer, scanner);
+    yylex_destroy(scanner);
+    return prog;
+}
+
+// shares the definition of a declaration, as the parser does
+static void shareDef(ir::ExprPool *pool, ir::Decl *d) {
+    ir::Node *&def = d->getChildren()[1];
+    def = pool->share(static_cast<ir::Expr *>(def));
+    def->setParent(d);
+}
+
+ir::Program *FrontEnd::load(const char *buf, size_t len,
+        const std::string& name) {
+    // flat programs are trees: the expressions are shared again, as they
+    // are by the parser
+    ParseContext ctx(name);
+    ir::FlatIR flat(buf, len, name);
+    if (sink == NULL) {
+        ir::Program *prog = flat.toProgram();
+        ir::ExprPool *pool = ctx.releaseExprPool();
+        {
+            ir::Arena::Scope scope(prog->getArena());
+            for (auto d: prog->getDecls())
+                shareDef(pool, d);
+            for (auto e: prog->getEqs())
+                pool->share(e);
+        }
+        prog->setExprPool(pool);
+        return prog;
+    }
+
+    // the equations are built and released one at a time, as in
+    // ParseContext::streamEquation
+    ir::Program *prog = flat.toProgram(false);
+    {
+        ir::Arena::Scope scope(prog->getArena());
+        sink->begin(prog);
+    }
+    ir::Arena *arena = new ir::Arena();
+    for (auto e: flat.getEqs()) {
+        ir::Arena::Scope scope(arena);
+        ir::Equation *eq = static_cast<ir::Equation *>(flat.toNode(e));
+        ir::ExprPool *pool = ctx.releaseExprPool();
+        pool->share(eq);
+        prog->addEquation(eq);
+        sink->equation(eq);
+        prog->removeEquation(eq);
+        delete pool;
+        arena->release();
+    }
+    delete arena;
+    return prog;
+}
+
+// key of a module in the cache: FNV-1a of the version of the precompiled
+// form, and of the file name and content of the module
+static uint64_t moduleKey(const std::string& file, const std::string& text) {
+    uint64_t h = 14695981039346656037ULL;
+    auto hash = [&h](const char *s, size_t len) {
+        for (size_t i=0; i<len; i++) {
+            h ^= static_cast<unsigned char>(s[i]);
+            h *= 1099511628211ULL;
+        }
+    };
+    uint32_t version = ir::FlatIR::version;
+    hash(reinterpret_cast<const char *>(&version), sizeof(version));
+    hash(file.c_str(), file.size() + 1);
+    hash(text.data(), text.size());
+    return h;
+}
+
+static bool readFile(const std::string& file, std::string& text) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    bool read = readAll(fd, text);
+    close(fd);
+    return read;
+}
+
+// creates a directory and its parents
+static bool makeDirs(const std::string& dir) {
+    for (size_t i = dir.find('/', 1); ; i = dir.find('/', i + 1)) {
+        if (mkdir(dir.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if (i == std::string::npos)
+            return true;
+    }
+}
+
+std::string FrontEnd::findModule(const std::string& module,
+        const std::string& from) const {
+    std::vector<std::string> dirs;
+    size_t slash = from.rfind('/');
+    dirs.push_back(slash == std::string::npos ? "." : from.substr(0, slash));
+    dirs.insert(dirs.end(), importPaths.begin(), importPaths.end());
+    for (auto& dir: dirs) {
+        std::string file = dir + "/" + module + ".edl";
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            return file;
+    }
+    return "";
+}
+
+ir::FlatIR *FrontEnd::loadModule(const std::string& file) {
+    std::string text;
+    if (!readFile(file, text)) {
+        logger::err << "cannot read module `" << file << "'\n";
+        exit(EXIT_FAILURE);
+    }
+
+    std::string cached;
+    if (!cacheDir.empty()) {
+        size_t slash = file.rfind('/');
+        std::string stem = file.substr(slash + 1, file.size() - slash - 5);
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx",
+                (unsigned long long) moduleKey(file, text));
+        cached = cacheDir + "/" + stem + "-" + key + ".edlb";
+        std::string bin;
+        if (readFile(cached, bin) &&
+                ir::FlatIR::isBinary(bin.data(), bin.size()))
+            return new ir::FlatIR(bin.data(), bin.size(), cached);
+    }
+
+    // modules start with a token of their own: they are scanned by the
+    // hand-written scanner, which can produce it
+    ParseContext ctx(file);
+    ctx.module = true;
+    Lexer lexer(text.data(), text.size());
+    lexer.setStartToken(START_MODULE);
+    ctx.lexer = &lexer;
+    ir::Arena *arena = new ir::Arena();
+    ir::Program *prog;
+    {
+        ir::Arena::Scope scope(arena);
+        yyparse(&ctx, NULL);
+        prog = ctx.buildProgram(ctx.decls, new ir::EqLst());
+        ctx.decls = NULL;
+    }
+    prog->setArena(arena);
+    ir::FlatIR *flat = new ir::FlatIR(prog);
+    for (auto& m: ctx.imports)
+        flat->addImport(m);
+    delete prog;
+
+    // the cache is only an optimization: a module that cannot be cached is
+    // parsed again the next time. It is written aside then renamed, so that
+    // concurrent runs never read a partial file
+    if (!cached.empty() && makeDirs(cacheDir)) {
+        std::string tmp = cached + "." + std::to_string(getpid());
+        std::ofstream os(tmp, std::ios::binary);
+        flat->write(os);
+        os.close();
+        if (!os || rename(tmp.c_str(), cached.c_str()) != 0)
+            unlink(tmp.c_str());
+    }
+    return flat;
+}
+
+ir::DeclLst *FrontEnd::import(ParseContext& ctx, const std::string& module,
+        const std::string& from, std::string& error) {
+    std::string file = findModule(module, from);
+    if (file.empty()) {
+        error = "cannot find module `" + module + "'";
+        return NULL;
+    }
+    // the same module can be reached through different paths
+    char real[PATH_MAX];
+    std::string id = realpath(file.c_str(), real) ? real : file;
+    if (std::find(ctx.importing.begin(), ctx.importing.end(), id) !=
+            ctx.importing.end()) {
+        error = "module `" + module + "' imports itself";
+        return NULL;
+    }
+    ir::DeclLst *decls = new ir::DeclLst();
+    if (!ctx.imported.insert(id).second)
+        return decls;
+
+    ir::FlatIR *flat = loadModule(file);
+    // the modules imported by the module come first
+    ctx.importing.push_back(id);
+    for (auto m: flat->getImports()) {
+        ir::DeclLst *d = import(ctx, flat->getString(m), file, error);
+        if (d == NULL) {
+            error += " (imported by `" + file + "')";
+            delete flat;
+            delete decls;
+            return NULL;
+        }
+        decls->splice(decls->end(), *d);
+        delete d;
+    }
+    ctx.importing.pop_back();
+
+    if (ctx.progParams == NULL)
+        ctx.progParams = new SymTab();
+    flat->addSymbols(*ctx.progParams);
+    for (auto d: flat->getDecls()) {
+        ir::Decl *decl = static_cast<ir::Decl *>(flat->toNode(d));
+        shareDef(ctx.getExprPool(), decl);
+        decls->push_back(decl);
+    }
+    delete flat;
+    return decls;
+}
+
+// section of the input parsed by a thread
+struct Section {
+    const char *begin;
+    const char *end;
+    int line;
+    const char *lineStart;
+    int startToken;
+    ParseContext *ctx;
+    ir::Arena *arena;
+    bool parsed;
+};
+
+static void parseSection(Section& s) {
+    Lexer lexer(s.begin, s.end - s.begin, s.line, s.lineStart);
+    lexer.setStartToken(s.startToken);
+    s.ctx->lexer = &lexer;
+    s.ctx->section = true;
+    s.arena = new ir::Arena();
+    try {
+        // the diagnostics are left to the sequential parser
+        logger::Printer::Intercept intercept;
+        ir::Arena::Scope scope(s.arena);
+        s.parsed = yyparse(s.ctx, NULL) == 0;
+        // the hashes are cached: sharing the expressions, done in order
+        // once the sections are merged, mostly looks them up
+        if (s.parsed && s.ctx->eqs)
+            for (auto e: *s.ctx->eqs)
+                e->getHash();
+    }
+    catch (logger::Interrupt&) {
+        s.parsed = false;
+    }
+    s.ctx->lexer = NULL;
+}
+
+ir::Program *FrontEnd::parseParallel(const char *buf, size_t len,
+        const std::string& name) {
+    // the declarations end at the first `in', then every equation starts
+    // with `equation': the split only needs the tokens, not their values
+    Lexer splitter(buf, len);
+    YYLTYPE loc;
+    int token;
+    while ((token = splitter.lex(NULL, &loc)) && token != KW_IN);
+    if (token != KW_IN)
+        return NULL;
+
+    struct Start {
+        const char *pos;
+        int line;
+        const char *lineStart;
+    };
+    std::vector<Start> eqs;
+    eqs.push_back({splitter.getText() + splitter.getLength(),
+            splitter.getLine(), splitter.getLineStart()});
+    bool first = true;
+    while ((token = splitter.lex(NULL, &loc))) {
+        // the first equation starts with the section
+        if (token == KW_EQ && !first)
+            eqs.push_back({splitter.getText(), splitter.getLine(),
+                    splitter.getLineStart()});
+        first = false;
+    }
+    if (eqs.size() < 2)
+        return NULL;
+
+    // a few sections per thread balance the load
+    size_t nSections = std::min(eqs.size(), (size_t) nThreads * 4);
+    std::vector<Section> sections;
+    sections.push_back({buf, eqs[0].pos, 1, buf, START_DECLARATIONS,
+            new ParseContext(name), NULL, false});
+    for (size_t i=0; i<nSections; i++) {
+        const Start& b = eqs[i * eqs.size() / nSections];
+        size_t e = (i + 1) * eqs.size() / nSections;
+        const char *end = e < eqs.size() ? eqs[e].pos : buf + len;
+        sections.push_back({b.pos, end, b.line, b.lineStart, START_EQUATIONS,
+                new ParseContext(name), NULL, false});
+    }
+    // only the declarations import modules
+    sections[0].ctx->frontEnd = this;
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        size_t i;
+        while ((i = next++) < sections.size())
+            parseSection(sections[i]);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t=1; t<std::min((size_t) nThreads, sections.size()); t++)
+        threads.push_back(std::thread(work));
+    work();
+    for (auto& t: threads)
+        t.join();
+
+    bool parsed = true;
+    for (auto& s: sections)
+        parsed = parsed && s.parsed;
+
+    ir::Program *prog = NULL;
+    if (parsed) {
+        ParseContext *decl = sections[0].ctx;
+        ir::Arena *arena = sections[0].arena;
+        ir::EqLst *eqList = new ir::EqLst();
+        for (size_t i=1; i<sections.size(); i++) {
+            arena->adopt(sections[i].arena);
+            sections[i].arena = NULL;
+            eqList->splice(eqList->end(), *sections[i].ctx->eqs);
+        }
+        // shared in the order of the sequential parser
+        ir::ExprPool *pool = decl->getExprPool();
+        {
+            ir::Arena::Scope scope(arena);
+            for (auto e: *eqList)
+                pool->share(e);
+        }
+        prog = decl->buildProgram(decl->decls, eqList);
+        prog->setArena(arena);
+        decl->decls = NULL;
+        sections[0].arena = NULL;
+    }
+
+    for (auto& s: sections) {
+        // the symbols and the pool refer to nodes of the arena
+        delete s.ctx;
+        delete s.arena;
     }
-    yyparse();
     return prog;
 }
@@ -3,16 +3,119 @@
 
 #include "config.h"
 #include "IR.h"
-extern FILE *yyin;
-extern int yyparse();
-extern ir::Program *prog;
 
+#include <string>
+#include <vector>
+
+class ParseContext;
+namespace ir {
+class FlatIR;
+}
+
+/// scanner used by the frontend
+typedef enum {
+    /// generated by flex (scanner.lpp)
+    FLEX_LEXER,
+    /// hand-written (Lexer.h), reads the input in place
+    HAND_LEXER
+} LexerType;
+
+///
+/// Receives a program one equation at a time (see FrontEnd::stream).
+///
+class EquationSink {
+    public:
+        virtual ~EquationSink() { }
+        /// the declarations are parsed: the program has no equation yet
+        virtual void begin(ir::Program *prog) = 0;
+        /// an equation is parsed: it belongs to the program until this
+        /// returns, then it is released
+        virtual void equation(ir::Equation *eq) = 0;
+        /// the whole input is parsed
+        virtual void end() = 0;
+};
+
+///
+/// Parses EDL files.
+///
+/// Each call to parse has its own parser state: a FrontEnd can parse several
+/// files, and different FrontEnds can parse concurrently.
+///
+/// With several threads, the equations are parsed in parallel: the input is
+/// split after the declarations and at `equation' keywords, and the sections
+/// are parsed concurrently then merged in source order. A section that does
+/// not parse silently makes the whole input parse again on a single thread,
+/// so the diagnostics are those of the sequential parser.
+///
+/// When streamed, the equations are handed to a sink as soon as they are
+/// parsed, and released before the next one is parsed: the memory used does
+/// not depend on the number of equations (streams are parsed on a single
+/// thread).
+///
+/// Every input can also be a precompiled model (see ir::FlatIR::write): it
+/// is recognized by its first bytes and loaded instead of being parsed.
+///
+/// `import name' among the declarations imports the module `name.edl', an
+/// EDL file that only has declarations: its symbols and definitions are
+/// merged into the program, where it is imported. Modules are searched in
+/// the directory of the importing file, then in the import paths. Each
+/// module is parsed once: it is precompiled in a cache, keyed by a hash of
+/// its file name and content, and loaded from there afterwards. A module
+/// is imported at most once per program.
+///
 class FrontEnd {
     public:
-        FrontEnd();
+        FrontEnd(LexerType lexerType = FLEX_LEXER, int nThreads = 1);
+        /// parses a file ("-" reads the standard input); regular files are
+        /// mapped in memory and scanned from the mapping
         ir::Program *parse(char *filename);
         ir::Program *parse(std::string& filename);
         ir::Program *parse(const std::string& filename);
+        /// parses the len bytes at buf, name is the file name reported in
+        /// the diagnostics and the source locations
+        ir::Program *parseBuffer(const char *buf, size_t len,
+                const std::string& name);
+        /// parses a file, giving its equations to the sink one at a time:
+        /// the returned program only has the declarations
+        ir::Program *stream(const std::string& filename, EquationSink& sink);
+
+        /// directory searched for the imported modules
+        void addImportPath(const std::string& dir);
+        /// directory of the precompiled modules, "" disables the cache. It
+        /// defaults to $EDL_CACHE, or to ~/.cache/edl
+        void setCacheDir(const std::string& dir);
+
+    private:
+        friend class ParseContext;
+
+        LexerType lexerType;
+        int nThreads;
+        /// sink of the stream being parsed, NULL when not streaming
+        EquationSink *sink;
+        std::vector<std::string> importPaths;
+        std::string cacheDir;
+
+        /// returns NULL if a section does not parse
+        ir::Program *parseParallel(const char *buf, size_t len,
+                const std::string& name);
+
+        /// parses base without copying it: its size bytes end with two NULs
+        ir::Program *parseInPlace(char *base, size_t size,
+                const std::string& name);
+
+        /// loads the precompiled model held by the len bytes at buf
+        ir::Program *load(const char *buf, size_t len,
+                const std::string& name);
+
+        /// see ParseContext::import, from is the importing file
+        ir::DeclLst *import(ParseContext& ctx, const std::string& module,
+                const std::string& from, std::string& error);
+        /// returns the file of a module, "" if it is not found
+        std::string findModule(const std::string& module,
+                const std::string& from) const;
+        /// the declarations, symbols and imports of a module, from the
+        /// cache if it is there
+        ir::FlatIR *loadModule(const std::string& file);
 };
 
 #endif
@@ -0,0 +1,168 @@
+#include "Lexer.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+struct Keyword {
+    const char *text;
+    size_t length;
+    int token;
+};
+
+static const Keyword keywordList[] = {
+    {"fp", 2, KW_LAMBDA},
+    {"div", 3, KW_DIV},
+    {"grad", 4, KW_GRAD},
+    {"cross", 5, KW_CROSS},
+    {"let", 3, KW_LET},
+    {"equation", 8, KW_EQ},
+    {"param", 5, KW_PARAM},
+    {"input", 5, KW_PARAM},
+    {"var", 3, KW_VAR},
+    {"field", 5, KW_FIELD},
+    {"scalar", 6, KW_SCAL},
+    {"in", 2, KW_IN},
+    {"with", 4, KW_WITH},
+    {"at", 2, KW_AT},
+    {"import", 6, KW_IMPORT},
+    {"int", 3, KW_TYPE},
+    {"double", 6, KW_TYPE},
+    {"string", 6, KW_TYPE},
+};
+
+static const size_t minKeywordLength = 2;
+static const size_t maxKeywordLength = 8;
+static const size_t keywordTableSize = 64;
+
+// perfect on the keywords above (adding a keyword may require new factors)
+static inline size_t keywordHash(const char *s, size_t len) {
+    return (len + static_cast<unsigned char>(s[0]) +
+            11 * static_cast<unsigned char>(s[1])) & (keywordTableSize - 1);
+}
+
+// built before any parse can start
+static const struct KeywordTable {
+    const Keyword *slots[keywordTableSize];
+
+    KeywordTable() : slots() {
+        for (const Keyword& k: keywordList) {
+            size_t h = keywordHash(k.text, k.length);
+            assert(slots[h] == NULL);
+            slots[h] = &k;
+        }
+    }
+} keywords;
+
+// token of a keyword, or ID
+static inline int keyword(const char *s, size_t len) {
+    if (len < minKeywordLength || len > maxKeywordLength)
+        return ID;
+    const Keyword *k = keywords.slots[keywordHash(s, len)];
+    if (k && k->length == len && memcmp(k->text, s, len) == 0)
+        return k->token;
+    return ID;
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool isLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// the number is not NUL terminated in the input
+static double toReal(const char *s, size_t len) {
+    char buf[64];
+    if (len < sizeof(buf)) {
+        memcpy(buf, s, len);
+        buf[len] = '\0';
+        return atof(buf);
+    }
+    return atof(std::string(s, len).c_str());
+}
+
+Lexer::Lexer(const char *buf, size_t len) :
+    cur(buf), end(buf + len), text(buf), length(0), line(1),
+    lineStart(buf), startToken(0) { }
+
+Lexer::Lexer(const char *buf, size_t len, int line, const char *lineStart) :
+    cur(buf), end(buf + len), text(buf), length(0), line(line),
+    lineStart(lineStart), startToken(0) { }
+
+void Lexer::setStartToken(int token) {
+    startToken = token;
+}
+
+int Lexer::lex(YYSTYPE *lval, YYLTYPE *lloc) {
+    if (startToken) {
+        int token = startToken;
+        startToken = 0;
+        lloc->first_line = lloc->last_line = line;
+        lloc->first_column = lloc->last_column = cur - lineStart + 1;
+        return token;
+    }
+
+    for (;;) {
+        while (cur < end && (*cur == ' ' || *cur == '\t'))
+            cur++;
+        if (cur == end) {
+            text = end;
+            length = 0;
+            return 0;
+        }
+        if (*cur == '\n') {
+            line++;
+            lineStart = ++cur;
+        }
+        else if (*cur == '#') {
+            const char *nl = static_cast<const char *>(
+                    memchr(cur, '\n', end - cur));
+            cur = nl ? nl : end;
+        }
+        else
+            break;
+    }
+
+    text = cur;
+    int token;
+    if (isLetter(*cur)) {
+        do {
+            cur++;
+        } while (cur < end && (isLetter(*cur) || isDigit(*cur)));
+        token = keyword(text, cur - text);
+        if (lval && (token == ID || token == KW_TYPE))
+            lval->name = ir::Name::intern(text, cur - text);
+    }
+    else if (isDigit(*cur) || (*cur == '.' && cur + 1 < end &&
+                isDigit(cur[1]))) {
+        unsigned int num = 0;
+        while (cur < end && isDigit(*cur))
+            num = 10 * num + (*cur++ - '0');
+        if (cur < end && *cur == '.') {
+            do {
+                cur++;
+            } while (cur < end && isDigit(*cur));
+            token = REAL;
+            if (lval)
+                lval->real = toReal(text, cur - text);
+        }
+        else {
+            token = NUM;
+            if (lval)
+                lval->num = num;
+        }
+    }
+    else {
+        // any other character is a token by itself
+        token = *cur++;
+    }
+    length = cur - text;
+
+    lloc->first_line = lloc->last_line = line;
+    lloc->first_column = text - lineStart + 1;
+    lloc->last_column = cur - lineStart;
+    return token;
+}
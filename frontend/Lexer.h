@@ -0,0 +1,59 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "config.h"
+#include "parser.hpp"
+
+#include <cstddef>
+
+///
+/// Hand-written scanner, producing the same tokens as the flex scanner
+/// (scanner.lpp).
+///
+/// The input is read in place: it is neither copied nor modified, and does
+/// not need to be NUL terminated. Comments are skipped with memchr, and
+/// keywords are recognized with a perfect hash.
+///
+class Lexer {
+    public:
+        Lexer(const char *buf, size_t len);
+        /// scans a section of a larger input: buf is on the given line, which
+        /// starts at lineStart (so that the locations are those in the whole
+        /// input)
+        Lexer(const char *buf, size_t len, int line, const char *lineStart);
+
+        /// token returned before the input (selects what the parser parses,
+        /// see parser.ypp)
+        void setStartToken(int token);
+
+        /// next token (0 at the end of the input), its value and its location
+        /// (with a NULL lval the values are not computed, and no name is
+        /// interned)
+        int lex(YYSTYPE *lval, YYLTYPE *lloc);
+
+        /// text of the last token, pointing into the input
+        inline const char *getText() const {
+            return text;
+        }
+        inline size_t getLength() const {
+            return length;
+        }
+        /// line of the last token, and where this line starts in the input
+        inline int getLine() const {
+            return line;
+        }
+        inline const char *getLineStart() const {
+            return lineStart;
+        }
+
+    private:
+        const char *cur;
+        const char *end;
+        const char *text;
+        size_t length;
+        int line;
+        const char *lineStart;
+        int startToken;
+};
+
+#endif // LEXER_H
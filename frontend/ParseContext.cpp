@@ -0,0 +1,87 @@
+#include "ParseContext.h"
+#include "FrontEnd.h"
+#include "SymTab.h"
+
+ParseContext::ParseContext(const std::string& filename) :
+    filename(filename), fileId(ir::SrcLoc::internFile(filename)),
+    prog(NULL), section(false), decls(NULL), eqs(NULL), progParams(NULL),
+    comment(false), column(1),
+    lexer(NULL), sink(NULL), frontEnd(NULL), module(false), exprPool(NULL),
+    equationArena(NULL) { }
+
+ParseContext::~ParseContext() {
+    // only left over if the program was not built
+    delete progParams;
+    delete exprPool;
+    delete decls;
+    delete eqs;
+    delete equationArena;
+}
+
+static ir::ExprPool *newExprPool() {
+    ir::ExprPool *pool = new ir::ExprPool();
+    // l dependent factors are located through their parent by the
+    // backends: they must stay unique
+    pool->pin("l");
+    return pool;
+}
+
+ir::ExprPool *ParseContext::getExprPool() {
+    if (exprPool == NULL)
+        exprPool = newExprPool();
+    return exprPool;
+}
+
+ir::ExprPool *ParseContext::releaseExprPool() {
+    ir::ExprPool *pool = getExprPool();
+    exprPool = NULL;
+    return pool;
+}
+
+ir::DeclLst *ParseContext::import(const std::string& name,
+        std::string& error) {
+    if (module) {
+        imports.push_back(name);
+        return new ir::DeclLst();
+    }
+    return frontEnd->import(*this, name, filename, error);
+}
+
+ir::Program *ParseContext::buildProgram(ir::DeclLst *decls, ir::EqLst *eqs) {
+    if (progParams == NULL)
+        progParams = new SymTab();
+    prog = new ir::Program(filename, progParams, decls, eqs);
+    prog->setExprPool(releaseExprPool());
+    progParams = NULL;
+    return prog;
+}
+
+void ParseContext::beginStream(ir::DeclLst *decls) {
+    buildProgram(decls, new ir::EqLst());
+    // the declarations stay in the arena of the parse, which is the arena of
+    // the program
+    prog->setArena(ir::Arena::getCurrent());
+    sink->begin(prog);
+    equationArena = new ir::Arena();
+    ir::Arena::setCurrent(equationArena);
+}
+
+void ParseContext::streamEquation(ir::Equation *eq) {
+    // expressions are only shared within the equation: its pool goes away
+    // with it
+    ir::ExprPool *pool = newExprPool();
+    pool->share(eq);
+    prog->addEquation(eq);
+    sink->equation(eq);
+    prog->removeEquation(eq);
+    delete pool;
+    equationArena->release();
+    ir::Arena::setCurrent(equationArena);
+}
+
+ir::Program *ParseContext::endStream() {
+    ir::Arena::setCurrent(prog->getArena());
+    delete equationArena;
+    equationArena = NULL;
+    return prog;
+}
@@ -0,0 +1,108 @@
+#ifndef PARSE_CONTEXT_H
+#define PARSE_CONTEXT_H
+
+#include "config.h"
+#include "IR.h"
+#include "Coord.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+/// scanner state (see scanner.lpp)
+typedef void *yyscan_t;
+
+class Lexer;
+class EquationSink;
+class FrontEnd;
+
+///
+/// State of one parse.
+///
+/// The parser and the scanner are reentrant: everything they share lives in
+/// the context of the parse, so several files can be parsed in turn, or
+/// concurrently on different threads.
+///
+class ParseContext {
+    public:
+        ParseContext(const std::string& filename);
+        ~ParseContext();
+        ParseContext(const ParseContext&) = delete;
+        ParseContext& operator=(const ParseContext&) = delete;
+
+        const std::string filename;
+        /// id of the file in the source location table
+        const uint16_t fileId;
+
+        /// the parsed program (owned by the caller once the parse is done)
+        ir::Program *prog;
+        /// only a section of the program is parsed (its declarations or some
+        /// of its equations), the caller builds the program
+        bool section;
+        ir::DeclLst *decls;
+        ir::EqLst *eqs;
+        /// symbols declared so far (owned by the program once it is built)
+        SymTab *progParams;
+        SphericalCoord spherical;
+
+        /// scanner state: the rest of the line is a comment, and the column
+        /// of the next token
+        bool comment;
+        int column;
+        /// hand-written scanner of the parse, NULL when flex scans the input
+        Lexer *lexer;
+        /// receives the equations one at a time instead of the program (see
+        /// FrontEnd::stream), NULL when the whole program is built
+        EquationSink *sink;
+
+        /// frontend of the parse, which imports the modules
+        FrontEnd *frontEnd;
+        /// the input is a module: the modules it imports are only recorded
+        /// (they are imported with it, see FrontEnd::import)
+        bool module;
+        std::vector<std::string> imports;
+        /// files of the modules imported so far (each is imported once), and
+        /// of those being imported
+        std::set<std::string> imported;
+        std::vector<std::string> importing;
+
+        /// returns the declarations of the module `name' and adds its
+        /// symbols to progParams (returns NULL and sets error if it cannot
+        /// be imported)
+        ir::DeclLst *import(const std::string& name, std::string& error);
+
+        /// pool of the shared expressions of the program
+        ir::ExprPool *getExprPool();
+        /// the program takes ownership of the pool
+        ir::ExprPool *releaseExprPool();
+
+        /// builds the program (which owns the symbols and the pool)
+        ir::Program *buildProgram(ir::DeclLst *decls, ir::EqLst *eqs);
+
+        /// builds the program from the declarations and gives it to the
+        /// sink: the equations that follow are parsed in their own arena
+        void beginStream(ir::DeclLst *decls);
+        /// gives an equation to the sink, then releases its nodes
+        void streamEquation(ir::Equation *eq);
+        /// the equations are all parsed, returns the program
+        ir::Program *endStream();
+
+    private:
+        ir::ExprPool *exprPool;
+        /// arena of the equation being streamed
+        ir::Arena *equationArena;
+};
+
+int yylex_init_extra(ParseContext *, yyscan_t *);
+int yylex_destroy(yyscan_t);
+int yyparse(ParseContext *, yyscan_t);
+
+/// makes the scanner read a copy of the len bytes at bytes
+void *scanBytes(const char *bytes, size_t len, yyscan_t scanner);
+/// makes the scanner read base in place: the last two of its size bytes must
+/// be NUL, and the scanner writes to the others while scanning
+/// (returns NULL if base is not terminated this way)
+void *scanBuffer(char *base, size_t size, yyscan_t scanner);
+void deleteScanBuffer(void *buffer, yyscan_t scanner);
+
+#endif // PARSE_CONTEXT_H
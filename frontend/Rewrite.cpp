@@ -0,0 +1,233 @@
+#include "Rewrite.h"
+#include "Analysis.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+ir::Expr *Bindings::get(const ir::Name& name) const {
+    for (auto& v: vars) {
+        if (v.first == name)
+            return v.second;
+    }
+    return NULL;
+}
+
+bool RewriteRules::Symbol::operator==(const Symbol& s) const {
+    return kind == s.kind && arity == s.arity && key == s.key &&
+        vectComponent == s.vectComponent;
+}
+
+size_t RewriteRules::SymbolHash::operator()(const Symbol& s) const {
+    size_t h = std::hash<uintptr_t>()(s.key);
+    h = h * 31 + s.kind;
+    h = h * 31 + s.arity;
+    return h * 31 + s.vectComponent;
+}
+
+RewriteRules::RewriteRules() : nRewrites(0) {
+    states.emplace_back(new State());
+}
+
+RewriteRules::~RewriteRules() { }
+
+RewriteRules::Symbol RewriteRules::symbolOf(ir::Node *n) {
+    Symbol s;
+    s.kind = n->getKind();
+    s.arity = n->getChildren().size();
+    s.key = 0;
+    s.vectComponent = 0;
+    switch (s.kind) {
+        case ir::UNARY:
+            s.key = static_cast<unsigned char>(
+                    static_cast<ir::UnaryExpr *>(n)->getOp());
+            break;
+        case ir::BINARY:
+            s.key = static_cast<unsigned char>(
+                    static_cast<ir::BinExpr *>(n)->getOp());
+            break;
+        case ir::IDENTIFIER:
+        case ir::FUNC_CALL:
+        case ir::ARRAY: {
+            ir::Identifier *id = static_cast<ir::Identifier *>(n);
+            s.key = reinterpret_cast<uintptr_t>(id->name.handle());
+            s.vectComponent = id->vectComponent;
+            break;
+        }
+        case ir::INT_VALUE:
+            s.key = static_cast<uintptr_t>(
+                    static_cast<ir::Value<int> *>(n)->getValue());
+            break;
+        case ir::FLOAT_VALUE: {
+            float v = static_cast<ir::Value<float> *>(n)->getValue();
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            s.key = bits;
+            break;
+        }
+        default:
+            break;
+    }
+    return s;
+}
+
+ir::Name RewriteRules::varName(ir::Node *n) {
+    if (n->getKind() == ir::IDENTIFIER) {
+        const std::string& name = static_cast<ir::Identifier *>(n)->name;
+        if (name.size() > 1 && name[0] == '?')
+            return ir::Name(name.substr(1));
+    }
+    return ir::Name();
+}
+
+void RewriteRules::add(const ir::Expr& pattern, Action action,
+        const VarKinds& kinds) {
+    // the pattern is compiled in preorder, from the root of the tree: each
+    // node of the pattern is an edge (a variable skips its subtree)
+    State *s = states.front().get();
+    Traversal().pre([this, &s, &kinds] (ir::Node *n) {
+            ir::Name var = varName(n);
+            if (var.empty()) {
+                Symbol sym = symbolOf(n);
+                auto it = s->next.find(sym);
+                if (it == s->next.end()) {
+                    states.emplace_back(new State());
+                    it = s->next.emplace(sym, states.back().get()).first;
+                }
+                s = it->second;
+                return VISIT_CONTINUE;
+            }
+            unsigned mask = 0;
+            auto k = kinds.find(var);
+            if (k != kinds.end()) {
+                for (auto kind: k->second)
+                    mask |= 1u << kind;
+            }
+            for (auto& v: s->vars) {
+                if (v.name == var && v.kinds == mask) {
+                    s = v.next;
+                    return VISIT_SKIP;
+                }
+            }
+            states.emplace_back(new State());
+            VarEdge v = {var, mask, states.back().get()};
+            s->vars.push_back(v);
+            s = v.next;
+            return VISIT_SKIP;
+        }).run(const_cast<ir::Expr *>(&pattern)); // only read
+    s->rules.push_back(actions.size());
+    actions.push_back(action);
+}
+
+void RewriteRules::match(const State *s, std::vector<ir::Node *>& pending,
+        Bindings& b, std::vector<std::pair<size_t, Bindings>>& found) const {
+    if (pending.empty()) {
+        if (s->rules.empty())
+            return;
+        // a variable bound twice matches equal subexpressions
+        for (size_t i=0; i<b.vars.size(); i++) {
+            for (size_t j=i+1; j<b.vars.size(); j++) {
+                if (b.vars[i].first == b.vars[j].first &&
+                        !(*b.vars[i].second == *b.vars[j].second))
+                    return;
+            }
+        }
+        for (auto r: s->rules)
+            found.push_back(std::make_pair(r, b));
+        return;
+    }
+
+    ir::Node *n = pending.back();
+    pending.pop_back();
+    auto it = s->next.find(symbolOf(n));
+    if (it != s->next.end()) {
+        // the children of the node come next
+        ir::ChildArray& children = n->getChildren();
+        for (size_t i=children.size(); i>0; i--)
+            pending.push_back(children[i-1]);
+        match(it->second, pending, b, found);
+        pending.resize(pending.size() - children.size());
+    }
+    for (auto& v: s->vars) {
+        if (v.kinds && !(v.kinds & (1u << n->getKind())))
+            continue;
+        assert(ir::isa<ir::Expr>(n));
+        b.vars.push_back(std::make_pair(v.name, static_cast<ir::Expr *>(n)));
+        match(v.next, pending, b, found);
+        b.vars.pop_back();
+    }
+    pending.push_back(n);
+}
+
+ir::Expr *RewriteRules::rewriteOnce(ir::Expr *e, Bindings& b) {
+    const State *root = states.front().get();
+    // most nodes are not the root of a pattern
+    if (root->vars.empty() && root->next.count(symbolOf(e)) == 0)
+        return NULL;
+
+    std::vector<ir::Node *> pending(1, e);
+    Bindings none;
+    std::vector<std::pair<size_t, Bindings>> found;
+    match(root, pending, none, found);
+    std::stable_sort(found.begin(), found.end(),
+            [] (const std::pair<size_t, Bindings>& a,
+                const std::pair<size_t, Bindings>& b) {
+                return a.first < b.first;
+            });
+    for (auto& m: found) {
+        if (ir::Expr *r = actions[m.first](e, m.second)) {
+            assert(r != e);
+            nRewrites++;
+            b = m.second;
+            return r;
+        }
+    }
+    return NULL;
+}
+
+ir::Expr *RewriteRules::rewriteTree(ir::Expr *root, const Bindings& normal) {
+    auto isNormal = [&root, &normal] (ir::Node *n) {
+        if (n->isShared())
+            return true;
+        if (n == root)
+            return false;
+        for (auto& v: normal.vars) {
+            if (v.second == n)
+                return true;
+        }
+        return false;
+    };
+    Traversal().pre([&isNormal] (ir::Node *n) {
+            return isNormal(n) ? VISIT_SKIP : VISIT_CONTINUE;
+        }).post([this, &root, &isNormal] (ir::Node *n) {
+            if (isNormal(n))
+                return VISIT_CONTINUE;
+            assert(ir::isa<ir::Expr>(n));
+            ir::Expr *e = static_cast<ir::Expr *>(n);
+            Bindings b;
+            ir::Expr *r = rewriteOnce(e, b);
+            if (r == NULL)
+                return VISIT_CONTINUE;
+            // the new nodes are rewritten in turn, and the new root until no
+            // rule applies
+            r = rewriteTree(r, b);
+            if (e == root)
+                root = r;
+            else
+                e->getParent()->replace(e, r);
+            return VISIT_CONTINUE;
+        }).run(root);
+    return root;
+}
+
+ir::Expr *RewriteRules::apply(ir::Expr *e) {
+    ir::Node *parent = e->getParent();
+    ir::Expr *r = rewriteTree(e, Bindings());
+    if (r != e && parent)
+        parent->replace(e, r);
+    return r;
+}
+
+int RewriteRules::getRewriteNumber() const {
+    return nRewrites;
+}
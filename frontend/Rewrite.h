@@ -0,0 +1,136 @@
+#ifndef REWRITE_H
+#define REWRITE_H
+
+#include "config.h"
+#include "IR.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+///
+/// Subexpressions bound to the variables of a pattern by a match.
+///
+class Bindings {
+    friend class RewriteRules;
+
+    private:
+        std::vector<std::pair<ir::Name, ir::Expr *>> vars;
+
+    public:
+        /// subexpression bound to the variable `?name' (NULL if the pattern
+        /// has no such variable)
+        ir::Expr *get(const ir::Name& name) const;
+        template<class T>
+        inline T *get(const ir::Name& name) const {
+            return ir::dyn_cast<T>(get(name));
+        }
+};
+
+///
+/// Rewrite rules, matched by a decision tree.
+///
+/// A rule rewrites the expressions matching a pattern. Patterns are IR
+/// expressions where the identifiers named `?x' are variables: a variable
+/// matches any subexpression (or only the kinds of nodes it is restricted
+/// to), and is bound to it; a variable used twice matches equal
+/// subexpressions. The other nodes match the nodes of the same kind and
+/// arity, with the same operator, name or value (the order of a DiffExpr is
+/// not compared: the action of the rule looks at it).
+///
+/// The patterns are compiled into one decision tree: the nodes of an
+/// expression are tested once for all the rules, in preorder, and the rules
+/// share the tests of their common prefix.
+///
+/// apply rewrites an expression bottom-up, in a single traversal: a node is
+/// rewritten once its children are, until no rule applies (the new nodes of
+/// a rewrite are rewritten in turn). When several rules match, the first
+/// one added whose action rewrites the node is applied. Shared
+/// subexpressions are immutable (see ir::ExprPool): they are not rewritten.
+///
+class RewriteRules {
+    public:
+        /// returns the node replacing the matched node e, or NULL to leave it
+        /// as it is (the rule does not apply). It may reuse the nodes of e
+        typedef std::function<ir::Expr *(ir::Expr *e, const Bindings&)>
+            Action;
+        /// kinds of nodes each variable matches (any kind when it is not
+        /// listed), by variable name (without `?')
+        typedef std::map<std::string, std::vector<ir::NodeKind>> VarKinds;
+
+        RewriteRules();
+        ~RewriteRules();
+        RewriteRules(const RewriteRules&) = delete;
+        RewriteRules& operator=(const RewriteRules&) = delete;
+
+        /// the pattern is only read (it can be a temporary)
+        void add(const ir::Expr& pattern, Action action,
+                const VarKinds& kinds = VarKinds());
+
+        /// rewrites the subtree of e (the parents of its nodes must be up to
+        /// date, see ir::Node::setParents) and returns its new root: the
+        /// root is replaced in its parent as well, if it has one
+        ir::Expr *apply(ir::Expr *e);
+
+        /// number of rewrites applied so far
+        int getRewriteNumber() const;
+
+    private:
+        /// what a node is tested on
+        struct Symbol {
+            ir::NodeKind kind;
+            size_t arity;
+            /// operator, value or name of the node (0 if it has none)
+            uintptr_t key;
+            int vectComponent;
+
+            bool operator==(const Symbol&) const;
+        };
+        struct SymbolHash {
+            size_t operator()(const Symbol&) const;
+        };
+        struct State;
+        /// matches a node whatever its subtree, and binds it
+        struct VarEdge {
+            ir::Name name;
+            /// bit set of the kinds matched, 0 for any kind
+            unsigned kinds;
+            State *next;
+        };
+        /// state of the decision tree: the next node (in preorder) of the
+        /// expression is tested on its symbol, then on the variables
+        struct State {
+            std::unordered_map<Symbol, State *, SymbolHash> next;
+            std::vector<VarEdge> vars;
+            /// rules whose pattern ends here
+            std::vector<size_t> rules;
+        };
+
+        std::vector<std::unique_ptr<State>> states;
+        std::vector<Action> actions;
+        int nRewrites;
+
+        static Symbol symbolOf(ir::Node *);
+        /// name of the variable if n is one, the empty name otherwise
+        static ir::Name varName(ir::Node *);
+
+        /// adds the matches of the nodes of pending (the next one last)
+        /// from state s to found
+        void match(const State *s, std::vector<ir::Node *>& pending,
+                Bindings& b,
+                std::vector<std::pair<size_t, Bindings>>& found) const;
+        /// the new root of e after applying the first matching rule (b gets
+        /// the bindings of the match), NULL if none applies
+        ir::Expr *rewriteOnce(ir::Expr *e, Bindings& b);
+        /// rewrites the subtree of root but the subexpressions bound in
+        /// normal (in normal form already), and returns its new root (not
+        /// replaced in its parent)
+        ir::Expr *rewriteTree(ir::Expr *root, const Bindings& normal);
+};
+
+#endif // REWRITE_H
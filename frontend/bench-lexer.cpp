@@ -0,0 +1,116 @@
+#include "ParseContext.h"
+#include "parser.hpp"
+#include "Lexer.h"
+#include "Printer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+extern "C" {
+#include <unistd.h>
+}
+
+extern int yylex(YYSTYPE *, YYLTYPE *, yyscan_t);
+
+// scans the input with flex, returns the number of tokens
+static size_t flexScan(const std::string& input) {
+    ParseContext ctx("bench.edl");
+    yyscan_t scanner;
+    yylex_init_extra(&ctx, &scanner);
+    void *buffer = scanBytes(input.data(), input.size(), scanner);
+    YYSTYPE lval;
+    YYLTYPE lloc;
+    size_t n = 0;
+    while (yylex(&lval, &lloc, scanner))
+        n++;
+    deleteScanBuffer(buffer, scanner);
+    yylex_destroy(scanner);
+    return n;
+}
+
+// scans the input with the hand-written scanner
+static size_t handScan(const std::string& input) {
+    Lexer lexer(input.data(), input.size());
+    YYSTYPE lval;
+    YYLTYPE lloc;
+    size_t n = 0;
+    while (lexer.lex(&lval, &lloc))
+        n++;
+    return n;
+}
+
+static void bench(const char *name, size_t (*scan)(const std::string&),
+        const std::string& input, int runs) {
+    double best = 0;
+    size_t tokens = 0;
+    for (int i=0; i<runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        tokens = scan(input);
+        std::chrono::duration<double> t =
+            std::chrono::steady_clock::now() - start;
+        double mbs = input.size() / t.count() / (1024 * 1024);
+        if (mbs > best)
+            best = mbs;
+    }
+    std::cout << std::left << std::setw(8) << name << std::right <<
+        std::setw(10) << tokens << " tokens " << std::fixed <<
+        std::setprecision(1) << std::setw(10) << best << " MB/s\n";
+}
+
+void usage(char *bin) {
+    fprintf(stderr, "Usage: %s [-s size_in_MB] [-r runs] <input>...\n", bin);
+}
+
+int main(int argc, char *argv[]) {
+    int size = 16, runs = 5;
+    char c;
+
+    logger::Printer::init();
+
+    while ((c = getopt(argc, argv, "s:r:h")) != EOF) {
+        switch (c) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::string text;
+    for (int i=optind; i<argc; i++) {
+        std::ifstream in(argv[i]);
+        if (!in) {
+            logger::err << "cannot open input file `" << argv[i] << "'\n";
+            exit(EXIT_FAILURE);
+        }
+        std::stringstream ss;
+        ss << in.rdbuf();
+        text += ss.str();
+        text += "\n";
+    }
+
+    // the inputs are repeated up to the requested size
+    std::string input;
+    while (input.size() < (size_t) size * 1024 * 1024)
+        input += text;
+    std::cout << "input: " << input.size() / 1024 << " kB, best of " <<
+        runs << " runs\n";
+
+    bench("flex", flexScan, input, runs);
+    bench("hand", handScan, input, runs);
+
+    return 0;
+}
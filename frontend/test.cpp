@@ -1,7 +1,43 @@
 #include "FrontEnd.h"
 #include "Analysis.h"
+#include "FlatIR.h"
+#include "Rewrite.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+}
+
+// the model of most tests
+static const char model[] =
+    "var u\n"
+    "field r\n"
+    "in\n"
+    "equation equ:\n"
+    "u'' = r * u\n";
+
+// the precompiled modules of a cache directory
+static std::vector<std::string> cachedModules(const std::string& dir) {
+    std::vector<std::string> files;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *f = readdir(d)) {
+            std::string name(f->d_name);
+            if (name.size() > 5 && name.substr(name.size() - 5) == ".edlb")
+                files.push_back(dir + "/" + name);
+        }
+        closedir(d);
+    }
+    return files;
+}
 
 int main(int argc, char *argv[]) {
     std::ofstream f;
@@ -14,5 +50,179 @@ int main(int argc, char *argv[]) {
         fe.parse(std::string("test.edl"));
     }
 
+    {
+        ir::Program *p = fe.parseBuffer(model, sizeof(model) - 1,
+                "buffer.edl");
+        FrontEnd hand(HAND_LEXER);
+        ir::Program *q = hand.parseBuffer(model, sizeof(model) - 1,
+                "buffer.edl");
+        std::cout << "buffer: " << p->filename << ", equations: " <<
+            p->getEqs().size() << ", hand-written scanner: " <<
+            q->getEqs().size() << "\n";
+        delete p;
+        delete q;
+    }
+
+    {
+        std::string edl = std::string(model) +
+            "equation eqv:\n"
+            "u' = r * u\n";
+        FrontEnd par(HAND_LEXER, 2);
+        ir::Program *p = par.parseBuffer(edl.data(), edl.size(), "buffer.edl");
+        std::cout << "parallel: " << p->getEqs().size() << " equations\n";
+        delete p;
+    }
+
+    {
+        // counts the equations of a stream
+        class Counter : public EquationSink {
+            public:
+                int n;
+                Counter() : n(0) { }
+                void begin(ir::Program *) { }
+                void equation(ir::Equation *) { n++; }
+                void end() { }
+        };
+        Counter counter;
+        ir::Program *p = fe.stream(argc == 2 ? argv[1] : "test.edl",
+                counter);
+        std::cout << "stream: " << counter.n << " equations, " <<
+            p->getEqs().size() << " left in the program\n";
+        delete p;
+    }
+
+    {
+        // a precompiled model is loaded instead of being parsed
+        ir::Program *p = fe.parseBuffer(model, sizeof(model) - 1,
+                "buffer.edl");
+        std::ostringstream os;
+        ir::FlatIR(p).write(os);
+        std::string bin = os.str();
+        ir::Program *q = fe.parseBuffer(bin.data(), bin.size(), "buffer.edlb");
+        std::cout << "precompiled: " << q->filename << ", equations: " <<
+            q->getEqs().size() << ", first: " <<
+            q->getEqs().front()->name << "\n";
+        delete p;
+        delete q;
+    }
+
+    {
+        // the module is precompiled in the cache by the first import, and
+        // loaded from there by the second one: parsing it again would
+        // replace the cached file
+        f.open("module.edl");
+        f << "input double a\n"
+            "field r\n";
+        f.close();
+        const char edl[] =
+            "import module\n"
+            "var u\n"
+            "in\n"
+            "equation equ:\n"
+            "u'' = a * r * u\n";
+        const std::string cache = "edl-cache";
+        for (auto& m: cachedModules(cache))
+            unlink(m.c_str());
+        FrontEnd mod;
+        mod.setCacheDir(cache);
+        ir::Program *p = mod.parseBuffer(edl, sizeof(edl) - 1, "buffer.edl");
+        // the cached file is dated back to the epoch
+        std::vector<std::string> cached = cachedModules(cache);
+        struct utimbuf epoch = {0, 0};
+        bool stored = cached.size() == 1 &&
+            utime(cached[0].c_str(), &epoch) == 0;
+        ir::Program *q = mod.parseBuffer(edl, sizeof(edl) - 1, "buffer.edl");
+        struct stat st;
+        bool reused = stored && stat(cached[0].c_str(), &st) == 0 &&
+            st.st_mtime == 0;
+        std::cout << "import: " << (p->getSymTab().search("a") != NULL) <<
+            ", cached: " << stored << ", from the cache: " <<
+            (reused && q->getSymTab().search("r") != NULL) << "\n";
+        delete p;
+        delete q;
+        for (auto& m: cached)
+            unlink(m.c_str());
+        rmdir(cache.c_str());
+        unlink("module.edl");
+    }
+
+    {
+        // depth of an equation, each node is evaluated once
+        ir::Program *p = fe.parseBuffer(model, sizeof(model) - 1,
+                "buffer.edl");
+        int nEval = 0;
+        Fold<int> depth([&nEval] (ir::Node *,
+                    const std::vector<const int *>& children) {
+                int d = 0;
+                for (auto c: children)
+                    d = std::max(d, *c);
+                nEval++;
+                return d + 1;
+            });
+        ir::Equation *eq = p->getEqs().front();
+        int lhs = depth(eq->getLHS());
+        std::cout << "fold: depth: " << lhs << ", equation: " <<
+            depth(eq) << ", evaluations: " << nEval << "\n";
+        delete p;
+    }
+
+    {
+        // the traversals do not recurse
+        ir::Expr *e = new ir::Identifier("x");
+        for (int i=0; i<10000; i++)
+            e = new ir::UnaryExpr(ir::scalar(e), '-');
+        e->setClearOnDelete(true);
+        int nUnary = 0;
+        forEach<ir::UnaryExpr>(e, [&nUnary] (ir::UnaryExpr *) { nUnary++; });
+        ir::Identifier *x = findFirst<ir::Identifier>(e,
+                [] (ir::Identifier *) { return true; });
+        int nVisited = 0;
+        Traversal().pre([&nVisited] (ir::Node *) {
+                return ++nVisited < 10 ? VISIT_CONTINUE : VISIT_SKIP;
+            }).run(e);
+        std::cout << "traversal: unary: " << nUnary << ", found: " <<
+            x->name << ", pruned after: " << nVisited << "\n";
+        delete e;
+    }
+
+    {
+        // rewrites to a fixpoint: -(-(-3)) is folded bottom-up, x - x is
+        // matched by a non-linear pattern once -(-x) is simplified. The
+        // nodes replaced are left to the arena, as in a program
+        ir::Arena arena;
+        ir::Arena::Scope scope(&arena);
+        RewriteRules rules;
+        ir::Identifier c("?c"), x("?x");
+        rules.add(ir::UnaryExpr(c, '-'),
+                [] (ir::Expr *, const Bindings& b) -> ir::Expr * {
+                    return new ir::Value<int>(
+                            -b.get<ir::Value<int> >("c")->getValue());
+                }, {{"c", {ir::INT_VALUE}}});
+        rules.add(ir::UnaryExpr(ir::UnaryExpr(x, '-'), '-'),
+                [] (ir::Expr *, const Bindings& b) -> ir::Expr * {
+                    return b.get("x")->copy();
+                });
+        rules.add(ir::BinExpr(x, '-', x),
+                [] (ir::Expr *, const Bindings&) -> ir::Expr * {
+                    return new ir::Value<int>(0);
+                });
+        ir::Expr *e = new ir::Value<int>(3);
+        for (int i=0; i<3; i++)
+            e = new ir::UnaryExpr(ir::scalar(e), '-');
+        e = rules.apply(e);
+        std::cout << "rewrite: constant: " <<
+            ir::dyn_cast<ir::Value<int> >(e)->getValue();
+        delete e;
+        e = new ir::BinExpr(new ir::Identifier("y"), '-',
+                new ir::UnaryExpr(new ir::UnaryExpr(new ir::Identifier("y"),
+                        '-'), '-'));
+        e->setParents();
+        e = rules.apply(e);
+        std::cout << ", difference: " <<
+            ir::dyn_cast<ir::Value<int> >(e)->getValue() << ", rewrites: " <<
+            rules.getRewriteNumber() << "\n";
+        delete e;
+    }
+
     return 0;
 }
@@ -0,0 +1,205 @@
+#include "Arena.h"
+#include "IR.h"
+
+#include <cassert>
+#include <new>
+
+namespace ir {
+
+thread_local Arena *Arena::current = NULL;
+thread_local bool Arena::releasing = false;
+std::atomic<size_t> Arena::liveNodeBytes(0);
+
+static size_t roundUp(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+size_t Arena::headerSize() {
+    return roundUp(sizeof(Header), align);
+}
+
+size_t Arena::chunkHeaderSize() {
+    return roundUp(sizeof(Chunk), align);
+}
+
+Arena::Arena(size_t chunkSize) : chunks(NULL), chunkSize(chunkSize),
+    bytesUsed(0), bytesReserved(0), nAlloc(0) {
+    for (size_t i=0; i<nFreeLists; i++)
+        freeLists[i] = NULL;
+}
+
+Arena::~Arena() {
+    release();
+}
+
+Arena::Header *Arena::newBlock(size_t size) {
+    size_t blockSize = headerSize() + size;
+    if (chunks == NULL || chunks->used + blockSize > chunks->size) {
+        size_t dataSize = blockSize > chunkSize ? blockSize : chunkSize;
+        Chunk *c = static_cast<Chunk *>(
+                ::operator new(chunkHeaderSize() + dataSize));
+        c->next = chunks;
+        c->size = dataSize;
+        c->used = 0;
+        chunks = c;
+        bytesReserved += chunkHeaderSize() + dataSize;
+    }
+    char *data = reinterpret_cast<char *>(chunks) + chunkHeaderSize();
+    Header *h = reinterpret_cast<Header *>(data + chunks->used);
+    chunks->used += blockSize;
+    bytesUsed += blockSize;
+    h->arena = this;
+    h->size = size;
+    return h;
+}
+
+void *Arena::allocate(size_t size) {
+    size = roundUp(size, align);
+    Header *h = NULL;
+    size_t slot = size / align;
+    if (slot < nFreeLists && freeLists[slot]) {
+        h = freeLists[slot];
+        freeLists[slot] = *reinterpret_cast<Header **>(
+                reinterpret_cast<char *>(h) + headerSize());
+    }
+    else {
+        h = newBlock(size);
+    }
+    h->live = 1;
+    nAlloc++;
+    return reinterpret_cast<char *>(h) + headerSize();
+}
+
+void *Arena::allocateNode(size_t size) {
+    if (current) {
+        void *ptr = current->allocate(size);
+        liveNodeBytes += reinterpret_cast<Header *>(
+                static_cast<char *>(ptr) - headerSize())->size;
+        return ptr;
+    }
+
+    Header *h = static_cast<Header *>(::operator new(headerSize() + size));
+    h->arena = NULL;
+    h->size = size;
+    h->live = 1;
+    liveNodeBytes += size;
+    return reinterpret_cast<char *>(h) + headerSize();
+}
+
+void Arena::deallocateNode(void *ptr) {
+    if (ptr == NULL)
+        return;
+    Header *h = reinterpret_cast<Header *>(
+            static_cast<char *>(ptr) - headerSize());
+    Arena *a = h->arena;
+    liveNodeBytes -= h->size;
+    if (a == NULL) {
+        ::operator delete(h);
+        return;
+    }
+    assert(h->live);
+    h->live = 0;
+    size_t slot = h->size / align;
+    if (slot < nFreeLists) {
+        *reinterpret_cast<Header **>(ptr) = a->freeLists[slot];
+        a->freeLists[slot] = h;
+    }
+}
+
+void Arena::release() {
+    bool wasReleasing = releasing;
+    releasing = true;
+    for (Chunk *c = chunks; c; c = c->next) {
+        char *data = reinterpret_cast<char *>(c) + chunkHeaderSize();
+        size_t offset = 0;
+        while (offset < c->used) {
+            Header *h = reinterpret_cast<Header *>(data + offset);
+            if (h->live) {
+                h->live = 0;
+                liveNodeBytes -= h->size;
+                Node *n = reinterpret_cast<Node *>(
+                        reinterpret_cast<char *>(h) + headerSize());
+                n->~Node();
+            }
+            offset += headerSize() + h->size;
+        }
+    }
+    releasing = wasReleasing;
+
+    for (auto a: adopted)
+        delete a;
+    adopted.clear();
+
+    while (chunks) {
+        Chunk *next = chunks->next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+    for (size_t i=0; i<nFreeLists; i++)
+        freeLists[i] = NULL;
+    if (current == this)
+        current = NULL;
+    bytesUsed = 0;
+    bytesReserved = 0;
+    nAlloc = 0;
+}
+
+void Arena::adopt(Arena *other) {
+    adopted.push_back(other);
+}
+
+size_t Arena::getBytesUsed() const {
+    size_t n = bytesUsed;
+    for (auto a: adopted)
+        n += a->getBytesUsed();
+    return n;
+}
+
+size_t Arena::getBytesReserved() const {
+    size_t n = bytesReserved;
+    for (auto a: adopted)
+        n += a->getBytesReserved();
+    return n;
+}
+
+size_t Arena::getAllocations() const {
+    size_t n = nAlloc;
+    for (auto a: adopted)
+        n += a->getAllocations();
+    return n;
+}
+
+void Arena::report(std::ostream& os, const std::string& name) const {
+    os << "arena";
+    if (name != "")
+        os << " (" << name << ")";
+    os << ": " << getBytesUsed() << " bytes used, " <<
+        getBytesReserved() << " bytes reserved, " <<
+        getAllocations() << " allocations\n";
+}
+
+Arena *Arena::getCurrent() {
+    return current;
+}
+
+void Arena::setCurrent(Arena *a) {
+    current = a;
+}
+
+size_t Arena::getLiveNodeBytes() {
+    return liveNodeBytes;
+}
+
+bool Arena::isReleasing() {
+    return releasing;
+}
+
+Arena::Scope::Scope(Arena *a) : previous(Arena::current) {
+    Arena::current = a;
+}
+
+Arena::Scope::~Scope() {
+    Arena::current = previous;
+}
+
+} // end namespace ir
@@ -0,0 +1,101 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "config.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ir {
+
+///
+/// Bump allocator owning the nodes of a program.
+///
+/// Every ir::Node allocated with `new` while an arena is current (see
+/// Arena::Scope) is carved out of large chunks owned by the arena. Deleting
+/// such a node only runs its destructor and recycles the block for the next
+/// node of the same size; the memory itself is given back in bulk when the
+/// arena is released. Releasing the arena also destroys the nodes that are
+/// still alive, so nodes dropped from the AST are not leaked.
+///
+class Arena {
+    private:
+        struct Chunk {
+            Chunk *next;
+            size_t size;
+            size_t used;
+        };
+
+        struct Header {
+            Arena *arena;
+            uint32_t size;
+            uint32_t live;
+        };
+
+        static const size_t align = 16;
+        static const size_t nFreeLists = 32;
+
+        static thread_local Arena *current;
+        static thread_local bool releasing;
+        /// shared by all the threads
+        static std::atomic<size_t> liveNodeBytes;
+
+        Chunk *chunks;
+        Header *freeLists[nFreeLists];
+        size_t chunkSize;
+        size_t bytesUsed;
+        size_t bytesReserved;
+        size_t nAlloc;
+        std::vector<Arena *> adopted;
+
+        Header *newBlock(size_t size);
+        static size_t headerSize();
+        static size_t chunkHeaderSize();
+
+    public:
+        Arena(size_t chunkSize = 64 * 1024);
+        ~Arena();
+
+        void *allocate(size_t size);
+        static void *allocateNode(size_t size);
+        static void deallocateNode(void *ptr);
+
+        /// destroys the nodes still alive and gives the chunks back
+        void release();
+        /// takes ownership of another arena (filled by another thread): its
+        /// nodes are released with this one
+        void adopt(Arena *);
+
+        size_t getBytesUsed() const;
+        size_t getBytesReserved() const;
+        size_t getAllocations() const;
+        void report(std::ostream&, const std::string& name = "") const;
+
+        /// bytes of the nodes alive, in every arena and on the heap
+        static size_t getLiveNodeBytes();
+
+        static Arena *getCurrent();
+        static void setCurrent(Arena *);
+        /// true while an arena is destroying its nodes: nodes must not
+        /// delete their children since the arena takes care of them
+        static bool isReleasing();
+
+        ///
+        /// Makes an arena current for the lifetime of the object
+        ///
+        class Scope {
+            private:
+                Arena *previous;
+            public:
+                Scope(Arena *);
+                ~Scope();
+        };
+};
+
+} // end namespace ir
+
+#endif // ARENA_H
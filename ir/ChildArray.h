@@ -0,0 +1,153 @@
+#ifndef CHILD_ARRAY_H
+#define CHILD_ARRAY_H
+
+#include "config.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace ir {
+
+class Node;
+
+///
+/// Children of a node.
+///
+/// Almost every node has at most three children (unary and binary
+/// expressions, vectors, equations...): they are stored inline, in the node
+/// itself, so that building a node does not allocate. Larger arities (sums,
+/// products, function calls with many arguments) fall back to the heap.
+///
+class ChildArray {
+    public:
+        typedef Node **iterator;
+        typedef Node *const *const_iterator;
+
+        static const uint32_t inlineCapacity = 3;
+
+    private:
+        uint32_t n;
+        uint32_t capacity;
+        union {
+            Node *inlined[inlineCapacity];
+            Node **heap;
+        };
+
+        inline Node **data() {
+            return capacity > inlineCapacity ? heap : inlined;
+        }
+        inline Node *const *data() const {
+            return capacity > inlineCapacity ? heap : inlined;
+        }
+        void reserve(uint32_t);
+
+    public:
+        ChildArray();
+        ChildArray(const ChildArray&);
+        ~ChildArray();
+        ChildArray& operator=(const ChildArray&);
+
+        inline size_t size() const {
+            return n;
+        }
+        inline bool empty() const {
+            return n == 0;
+        }
+        inline Node *& operator[](size_t i) {
+            assert(i < n);
+            return data()[i];
+        }
+        inline Node *operator[](size_t i) const {
+            assert(i < n);
+            return data()[i];
+        }
+        inline iterator begin() {
+            return data();
+        }
+        inline iterator end() {
+            return data() + n;
+        }
+        inline const_iterator begin() const {
+            return data();
+        }
+        inline const_iterator end() const {
+            return data() + n;
+        }
+
+        void push_back(Node *);
+        /// inserts before pos and returns an iterator to the new child
+        iterator insert(iterator pos, Node *);
+        /// removes the children (the heap storage is kept)
+        void clear();
+
+        bool operator==(const ChildArray&) const;
+        bool operator!=(const ChildArray&) const;
+};
+
+inline ChildArray::ChildArray() : n(0), capacity(inlineCapacity) { }
+
+inline ChildArray::ChildArray(const ChildArray& a) :
+    n(0), capacity(inlineCapacity) {
+    *this = a;
+}
+
+inline ChildArray::~ChildArray() {
+    if (capacity > inlineCapacity)
+        delete[] heap;
+}
+
+inline ChildArray& ChildArray::operator=(const ChildArray& a) {
+    if (this != &a) {
+        n = 0;
+        reserve(a.n);
+        std::memcpy(data(), a.data(), a.n * sizeof(Node *));
+        n = a.n;
+    }
+    return *this;
+}
+
+inline void ChildArray::reserve(uint32_t size) {
+    if (size <= capacity)
+        return;
+    uint32_t c = capacity * 2 > size ? capacity * 2 : size;
+    Node **d = new Node *[c];
+    std::memcpy(d, data(), n * sizeof(Node *));
+    if (capacity > inlineCapacity)
+        delete[] heap;
+    heap = d;
+    capacity = c;
+}
+
+inline void ChildArray::push_back(Node *c) {
+    reserve(n + 1);
+    data()[n++] = c;
+}
+
+inline ChildArray::iterator ChildArray::insert(iterator pos, Node *c) {
+    size_t i = pos - begin();
+    assert(i <= n);
+    reserve(n + 1);
+    Node **d = data();
+    std::memmove(d + i + 1, d + i, (n - i) * sizeof(Node *));
+    d[i] = c;
+    n++;
+    return d + i;
+}
+
+inline void ChildArray::clear() {
+    n = 0;
+}
+
+inline bool ChildArray::operator==(const ChildArray& a) const {
+    return n == a.n &&
+        std::memcmp(data(), a.data(), n * sizeof(Node *)) == 0;
+}
+
+inline bool ChildArray::operator!=(const ChildArray& a) const {
+    return !(*this == a);
+}
+
+} // end namespace ir
+
+#endif // CHILD_ARRAY_H
@@ -5,7 +5,7 @@
 
 class Coord {
     public:
-        virtual ir::BinExpr div(const ir::Expr&) = 0;
+        virtual ir::Sum div(const ir::Expr&) = 0;
         virtual ir::VectExpr grad(const ir::Expr&) = 0;
         virtual ir::VectExpr curl(const ir::Expr&) = 0;
 };
@@ -19,7 +19,7 @@ class CartesianCoord : public Coord {
     public:
         CartesianCoord();
 
-        virtual ir::BinExpr div(const ir::Expr&);
+        virtual ir::Sum div(const ir::Expr&);
         virtual ir::VectExpr grad(const ir::Expr&);
         virtual ir::VectExpr curl(const ir::Expr&);
 
@@ -37,7 +37,7 @@ class SphericalCoord : public Coord {
     public:
         SphericalCoord();
 
-        virtual ir::BinExpr div(const ir::Expr&);
+        virtual ir::Sum div(const ir::Expr&);
         virtual ir::VectExpr grad(const ir::Expr&);
         virtual ir::VectExpr curl(const ir::Expr&);
 
@@ -60,7 +60,7 @@ class SpheroidalCoord : public SphericalCoord {
     public:
         SpheroidalCoord();
 
-        virtual ir::BinExpr div(const ir::Expr&);
+        virtual ir::Sum div(const ir::Expr&);
         virtual ir::VectExpr grad(const ir::Expr&);
         virtual ir::VectExpr curl(const ir::Expr&);
 
@@ -11,6 +11,7 @@ class DOT {
         static void displayFile(const std::string& file);
 
     public:
+        virtual ~DOT() { }
         virtual void dumpDOT(std::ostream&, std::string = "", bool = true) const = 0;
         void display(std::string = "");
 };
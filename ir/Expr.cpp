@@ -1,84 +1,215 @@
 #include "IR.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace ir {
 
 bool isScalar(Expr *e) {
-    if (dynamic_cast<ScalarExpr *>(e))
-        return true;
-    return false;
+    return isa<ScalarExpr>(e);
 }
 
 bool isVect(Expr *e) {
-    if (dynamic_cast<VectExpr *>(e))
-        return true;
-    return false;
+    return isa<VectExpr>(e);
 }
 
 ScalarExpr *scalar(Expr *e) {
-    if (auto s = dynamic_cast<ScalarExpr *>(e))
+    if (auto s = dyn_cast<ScalarExpr>(e))
         return s;
     logger::err << "cannot cast vector expression to scalar expression\n";
     exit(EXIT_FAILURE);
 }
 
 ScalarExpr& scalar(Expr& e) {
-    return dynamic_cast<ScalarExpr&>(e);
+    return *scalar(&e);
 }
 
 VectExpr *vector(Expr *e) {
-    if (auto s = dynamic_cast<VectExpr *>(e))
+    if (auto s = dyn_cast<VectExpr>(e))
         return s;
     logger::err << "cannot cast scalar expression to vector expression\n";
     exit(EXIT_FAILURE);
 }
 
 VectExpr& vector(Expr& e) {
-    return dynamic_cast<VectExpr&>(e);
+    return *vector(&e);
 }
 
 Expr *Expr::copy() const {
-    if (auto e = dynamic_cast<const IndexRange *>(this)) {
-        return new IndexRange(*e);
-    }
-    else if (auto e = dynamic_cast<const BinExpr *>(this)) {
-        return new BinExpr(*e);
-    }
-    else if (auto e = dynamic_cast<const DiffExpr *>(this)) {
-        return new DiffExpr(*e);
-    }
-    else if (auto e = dynamic_cast<const ArrayExpr *>(this)) {
-        return new ArrayExpr(*e);
+    // shared expressions are immutable: no need to duplicate them
+    if (isShared()) {
+        return const_cast<Expr *>(this);
     }
-    else if (auto e = dynamic_cast<const FuncCall *>(this)) {
-        return new FuncCall(*e);
-    }
-    else if (auto e = dynamic_cast<const Identifier *>(this)) {
-        return new Identifier(*e);
-    }
-    else if (auto e = dynamic_cast<const UnaryExpr *>(this)) {
-        return new UnaryExpr(*e);
-    }
-    else if (auto e = dynamic_cast<const Value<int> *>(this)) {
-        return new Value<int>(*e);
-    }
-    else if (auto e = dynamic_cast<const Value<float> *>(this)) {
-        return new Value<float>(*e);
-    }
-    else if (auto e = dynamic_cast<const VectExpr *>(this)) {
-        return new VectExpr(*e);
+    switch (getKind()) {
+        case INDEX_RANGE:
+            return new IndexRange(*static_cast<const IndexRange *>(this));
+        case BINARY:
+            return new BinExpr(*static_cast<const BinExpr *>(this));
+        case SUM:
+            return new Sum(*static_cast<const Sum *>(this));
+        case PRODUCT:
+            return new Product(*static_cast<const Product *>(this));
+        case DIFF:
+            return new DiffExpr(*static_cast<const DiffExpr *>(this));
+        case ARRAY:
+            return new ArrayExpr(*static_cast<const ArrayExpr *>(this));
+        case FUNC_CALL:
+            return new FuncCall(*static_cast<const FuncCall *>(this));
+        case IDENTIFIER:
+            return new Identifier(*static_cast<const Identifier *>(this));
+        case UNARY:
+            return new UnaryExpr(*static_cast<const UnaryExpr *>(this));
+        case INT_VALUE:
+            return new Value<int>(*static_cast<const Value<int> *>(this));
+        case FLOAT_VALUE:
+            return new Value<float>(*static_cast<const Value<float> *>(this));
+        case VECTOR:
+            return new VectExpr(*static_cast<const VectExpr *>(this));
+        default:
+            break;
     }
     logger::err << "copy of node type not yet implemented\n";
     exit(EXIT_FAILURE);
 }
 
-Expr::Expr(Node *p) : Node(p), priority(5) {}
-Expr::Expr(int priority, Node *p) : Node(p), priority(priority) {}
+Expr::Expr(NodeKind kind, Node *p) : Node(kind, p), priority(5),
+    attrs(0), fpDegree(0), names(NULL) {}
+Expr::Expr(NodeKind kind, int priority, Node *p) :
+    Node(kind, p), priority(priority), attrs(0), fpDegree(0), names(NULL) {}
 Expr::~Expr() { };
 
-ScalarExpr::ScalarExpr(int priority, Node *p) : Expr(priority, p) { }
-ScalarExpr::ScalarExpr(Node *p) : Expr(p) { }
+static const Name lName("l");
+static const Name fpName("fp");
+
+// degrees that do not fit are not monomials
+static int fpMonomial(long d) {
+    if (d <= NOT_FP_MONOMIAL || d > INT16_MAX)
+        return NOT_FP_MONOMIAL;
+    return d;
+}
+
+void Expr::computeAttributes() const {
+    uint8_t a = ATTR_COMPUTED;
+    const NameSet *n = NameSet::empty();
+    // the flags and the names are those of the children, plus the node's own
+    for (auto c: children) {
+        if (Expr *e = dyn_cast<Expr>(c)) {
+            if (e->attrs == 0)
+                e->computeAttributes();
+            a |= e->attrs & ~ATTR_VECTOR;
+            n = NameSet::merge(n, e->names);
+        }
+    }
+    long d = 0;
+    switch (getKind()) {
+        case BINARY:
+        case INDEX_RANGE: {
+            const BinExpr *be = static_cast<const BinExpr *>(this);
+            int l = be->getLeftOp()->fpDegree;
+            int r = be->getRightOp()->fpDegree;
+            switch (be->getOp()) {
+                case '+':
+                case '-':
+                    d = l == r ? l : NOT_FP_MONOMIAL;
+                    break;
+                case '*':
+                    d = l == NOT_FP_MONOMIAL || r == NOT_FP_MONOMIAL ?
+                        NOT_FP_MONOMIAL : l + r;
+                    break;
+                case '^':
+                    if (auto v = dyn_cast<Value<int> >(be->getRightOp()))
+                        d = l == NOT_FP_MONOMIAL ?
+                            NOT_FP_MONOMIAL : (long) l * v->getValue();
+                    else
+                        d = NOT_FP_MONOMIAL;
+                    break;
+                case '/':
+                    d = be->getRightOp()->attrs & ATTR_FP ? NOT_FP_MONOMIAL : l;
+                    break;
+                default:
+                    d = NOT_FP_MONOMIAL;
+            }
+            break;
+        }
+        case SUM: {
+            const Sum *sum = static_cast<const Sum *>(this);
+            if (sum->getNOperands() > 0)
+                d = sum->getOperand(0)->fpDegree;
+            for (int i=1; i<sum->getNOperands(); i++) {
+                if (sum->getOperand(i)->fpDegree != d)
+                    d = NOT_FP_MONOMIAL;
+            }
+            break;
+        }
+        case PRODUCT: {
+            const Product *prod = static_cast<const Product *>(this);
+            for (int i=0; i<prod->getNOperands() && d != NOT_FP_MONOMIAL; i++) {
+                int f = prod->getOperand(i)->fpDegree;
+                d = f == NOT_FP_MONOMIAL ? NOT_FP_MONOMIAL : d + f;
+            }
+            break;
+        }
+        case IDENTIFIER:
+        case FUNC_CALL:
+        case ARRAY: {
+            // the arguments of a function call do not count in its degree
+            const Identifier *id = static_cast<const Identifier *>(this);
+            n = NameSet::merge(n, NameSet::get(id->name));
+            if (id->name == lName)
+                a |= ATTR_L;
+            if (id->name == fpName) {
+                a |= ATTR_FP;
+                d = 1;
+            }
+            if (id->getSymbolKind() == FIELD_SYMBOL)
+                a |= ATTR_FIELD;
+            else if (id->getSymbolKind() == UNRESOLVED_NAME)
+                a |= ATTR_UNRESOLVED;
+            break;
+        }
+        case UNARY: {
+            const UnaryExpr *ue = static_cast<const UnaryExpr *>(this);
+            Expr *op = ue->getExpr();
+            d = op->fpDegree;
+            if (ue->getOp() == '\'' && op->getKind() == IDENTIFIER &&
+                    static_cast<Identifier *>(op)->name == lName)
+                a |= ATTR_LL;
+            break;
+        }
+        case VECTOR:
+            a |= ATTR_VECTOR;
+            d = NOT_FP_MONOMIAL;
+            break;
+        default:
+            // values and derivatives (whatever they derive)
+            break;
+    }
+    fpDegree = fpMonomial(d);
+    names = n;
+    attrs = a;
+}
+
+bool Expr::hasAttr(ExprAttr a) const {
+    if (attrs == 0)
+        computeAttributes();
+    return attrs & a;
+}
+
+int Expr::getFpDegree() const {
+    if (attrs == 0)
+        computeAttributes();
+    return fpDegree;
+}
+
+const NameSet& Expr::getNames() const {
+    if (attrs == 0)
+        computeAttributes();
+    return *names;
+}
+
+ScalarExpr::ScalarExpr(NodeKind kind, int priority, Node *p) :
+    Expr(kind, priority, p) { }
+ScalarExpr::ScalarExpr(NodeKind kind, Node *p) : Expr(kind, p) { }
 
 int getPriority(char c) {
     switch(c) {
@@ -98,12 +229,16 @@ int getPriority(char c) {
     exit(EXIT_FAILURE);
 }
 
-BinExpr::BinExpr(ScalarExpr *lOp, char op, ScalarExpr *rOp, Node *p) : ScalarExpr(getPriority(op), p) {
-    children.push_back(lOp);
-    children.push_back(rOp);
+BinExpr::BinExpr(NodeKind kind, ScalarExpr *lOp, char op, ScalarExpr *rOp,
+        Node *p) : ScalarExpr(kind, getPriority(op), p) {
+    addChild(lOp);
+    addChild(rOp);
     this->op = op;
 }
 
+BinExpr::BinExpr(ScalarExpr *lOp, char op, ScalarExpr *rOp, Node *p) :
+    BinExpr(BINARY, lOp, op, rOp, p) { }
+
 BinExpr::BinExpr(const BinExpr& be) :
     BinExpr(*be.getLeftOp(),
             be.getOp(),
@@ -119,13 +254,13 @@ void BinExpr::dump(std::ostream &os) const {
 }
 
 ScalarExpr *BinExpr::getLeftOp() const {
-    assert(dynamic_cast<ScalarExpr *>(children[0]));
-    return dynamic_cast<ScalarExpr *>(children[0]);
+    assert(isa<ScalarExpr>(children[0]));
+    return static_cast<ScalarExpr *>(children[0]);
 }
 
 ScalarExpr *BinExpr::getRightOp() const {
-    assert(dynamic_cast<ScalarExpr *>(children[1]));
-    return dynamic_cast<ScalarExpr *>(children[1]);
+    assert(isa<ScalarExpr>(children[1]));
+    return static_cast<ScalarExpr *>(children[1]);
 }
 
 char BinExpr::getOp() const {
@@ -133,16 +268,223 @@ char BinExpr::getOp() const {
 }
 
 bool BinExpr::operator==(Node& n) {
-    try {
-        BinExpr& be = dynamic_cast<BinExpr&>(n);
-        return this->getOp() == be.getOp() &&
-            *this->getLeftOp() == *be.getLeftOp() &&
-            *this->getRightOp() == *be.getRightOp();
+    if (this == &n)
+        return true;
+    if (auto be = dyn_cast<BinExpr>(&n)) {
+        if (getHash() != n.getHash())
+            return false;
+        return this->getOp() == be->getOp() &&
+            *this->getLeftOp() == *be->getLeftOp() &&
+            *this->getRightOp() == *be->getRightOp();
+    }
+    return false;
+}
 
+static int rank(Node *n) {
+    switch (n->getKind()) {
+        case INT_VALUE:
+        case FLOAT_VALUE:
+            return 0;
+        case UNARY:
+            // negated factors come first, as a sign would
+            return static_cast<UnaryExpr *>(n)->getOp() == '-' ? 1 : 4;
+        case IDENTIFIER:
+        case FUNC_CALL:
+        case ARRAY:
+            return 2;
+        case DIFF:
+            return 3;
+        case BINARY:
+        case INDEX_RANGE:
+            return 5;
+        case SUM:
+            return 6;
+        case PRODUCT:
+            return 7;
+        default:
+            return 8;
     }
-    catch (std::bad_cast) {
+}
+
+template <class T>
+static int cmp(const T& a, const T& b) {
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+int compare(Node *n0, Node *n1) {
+    if (n0 == n1)
+        return 0;
+    int r = cmp(rank(n0), rank(n1));
+    if (r)
+        return r;
+    switch (n0->getKind()) {
+        case INT_VALUE:
+        case FLOAT_VALUE: {
+            // 2 and 2.0 are sorted by value
+            double v0 = isa<Value<int> >(n0) ?
+                static_cast<Value<int> *>(n0)->getValue() :
+                static_cast<Value<float> *>(n0)->getValue();
+            double v1 = isa<Value<int> >(n1) ?
+                static_cast<Value<int> *>(n1)->getValue() :
+                static_cast<Value<float> *>(n1)->getValue();
+            r = cmp(v0, v1);
+            break;
+        }
+        case IDENTIFIER:
+        case FUNC_CALL:
+        case ARRAY:
+            r = static_cast<Identifier *>(n0)->name.str().compare(
+                    static_cast<Identifier *>(n1)->name);
+            if (r == 0)
+                r = cmp(static_cast<Identifier *>(n0)->vectComponent,
+                        static_cast<Identifier *>(n1)->vectComponent);
+            break;
+        case DIFF:
+            r = static_cast<DiffExpr *>(n0)->getOrder().compare(
+                    static_cast<DiffExpr *>(n1)->getOrder());
+            break;
+        case UNARY:
+            r = cmp(static_cast<UnaryExpr *>(n0)->getOp(),
+                    static_cast<UnaryExpr *>(n1)->getOp());
+            break;
+        case BINARY:
+        case INDEX_RANGE:
+            r = cmp(static_cast<BinExpr *>(n0)->getOp(),
+                    static_cast<BinExpr *>(n1)->getOp());
+            break;
+        default:
+            break;
+    }
+    if (r)
+        return r;
+    r = cmp(n0->getKind(), n1->getKind());
+    if (r)
+        return r;
+    ChildArray& c0 = n0->getChildren();
+    ChildArray& c1 = n1->getChildren();
+    r = cmp(c0.size(), c1.size());
+    for (size_t i=0; r == 0 && i<c0.size(); i++) {
+        r = compare(c0[i], c1[i]);
+    }
+    return r;
+}
+
+NaryExpr::NaryExpr(NodeKind kind, Node *p) :
+    ScalarExpr(kind, getPriority(kind == SUM ? '+' : '*'), p) { }
+
+char NaryExpr::getOp() const {
+    return getKind() == SUM ? '+' : '*';
+}
+
+int NaryExpr::getNOperands() const {
+    return children.size();
+}
+
+ScalarExpr *NaryExpr::getOperand(int i) const {
+    assert(isa<ScalarExpr>(children[i]));
+    return static_cast<ScalarExpr *>(children[i]);
+}
+
+void NaryExpr::addOperand(ScalarExpr *e) {
+    assert(e);
+    if (e->getKind() == getKind()) {
+        for (auto c: e->getChildren()) {
+            addOperand(static_cast<ScalarExpr *>(c));
+        }
+        // shared operations (and their operands) belong to their pool
+        if (!e->isShared()) {
+            e->getChildren().clear();
+            delete e;
+        }
+        return;
+    }
+    auto pos = children.end();
+    if (getKind() == PRODUCT) {
+        // equivalent factors stay in source order
+        pos = std::upper_bound(children.begin(), children.end(), e,
+                [] (Node *n0, Node *n1) {
+                    return compare(n0, n1) < 0;
+                });
+    }
+    children.insert(pos, e);
+    e->setParent(this);
+    invalidate();
+}
+
+void NaryExpr::dump(std::ostream &os) const {
+    os << getOp();
+}
+
+bool NaryExpr::operator==(Node& n) {
+    // sums with operands in different orders are different shared nodes: only
+    // the same node is known to be equal without comparing
+    if (this == &n)
+        return true;
+    if (n.getKind() != getKind() || getHash() != n.getHash())
+        return false;
+    ChildArray& c0 = children;
+    ChildArray& c1 = n.getChildren();
+    if (c0.size() != c1.size())
         return false;
+    size_t i = 0;
+    while (i < c0.size() && *c0[i] == *c1[i])
+        i++;
+    if (i == c0.size())
+        return true;
+    // operands commute: match the remaining ones in any order
+    std::vector<bool> matched(c1.size(), false);
+    for (size_t j=i; j<c0.size(); j++) {
+        bool found = false;
+        for (size_t k=i; k<c1.size() && !found; k++) {
+            if (!matched[k] && c0[j]->getHash() == c1[k]->getHash() &&
+                    *c0[j] == *c1[k]) {
+                matched[k] = true;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+Sum::Sum(Node *p) : NaryExpr(SUM, p) { }
+
+Sum::Sum(ScalarExpr *lOp, ScalarExpr *rOp, Node *p) : NaryExpr(SUM, p) {
+    addOperand(lOp);
+    addOperand(rOp);
+}
+
+Sum::Sum(const ScalarExpr& lOp, const ScalarExpr& rOp, Node *p) :
+    Sum(scalar(lOp.copy()), scalar(rOp.copy()), p) {
+    clearOnDelete = true;
+}
+
+Sum::Sum(const Sum& s) : NaryExpr(SUM) {
+    for (auto c: s.children) {
+        addChild(static_cast<Expr *>(c)->copy());
+    }
+    clearOnDelete = true;
+}
+
+Product::Product(Node *p) : NaryExpr(PRODUCT, p) { }
+
+Product::Product(ScalarExpr *lOp, ScalarExpr *rOp, Node *p) :
+    NaryExpr(PRODUCT, p) {
+    addOperand(lOp);
+    addOperand(rOp);
+}
+
+Product::Product(const ScalarExpr& lOp, const ScalarExpr& rOp, Node *p) :
+    Product(scalar(lOp.copy()), scalar(rOp.copy()), p) {
+    clearOnDelete = true;
+}
+
+Product::Product(const Product& pr) : NaryExpr(PRODUCT) {
+    for (auto c: pr.children) {
+        addChild(static_cast<Expr *>(c)->copy());
     }
+    clearOnDelete = true;
 }
 
 BinExpr ScalarExpr::op(const ScalarExpr& s, char op) const {
@@ -150,27 +492,26 @@ BinExpr ScalarExpr::op(const ScalarExpr& s, char op) const {
 }
 
 VectExpr ScalarExpr::op(const VectExpr& v, char op) const {
-    ir::BinExpr x1 = BinExpr(*this, op, *v.getX());
-    ir::BinExpr x2 = BinExpr(*this, op, *v.getY());
-    ir::BinExpr x3 = BinExpr(*this, op, *v.getZ());
-
-    return VectExpr(x1, x2, x3);
+    Expr *e = binOp(this->copy(), op, v.copy());
+    VectExpr ret(*static_cast<VectExpr *>(e));
+    delete e;
+    return ret;
 }
 
-BinExpr ScalarExpr::operator+(const ScalarExpr& s) const {
-    return this->op(s, '+');
+Sum ScalarExpr::operator+(const ScalarExpr& s) const {
+    return Sum(*this, s);
 }
 VectExpr ScalarExpr::operator+(const VectExpr& v) const {
     return this->op(v, '+');
 }
-BinExpr ScalarExpr::operator-(const ScalarExpr& s) const {
-    return this->op(s, '-');
+Sum ScalarExpr::operator-(const ScalarExpr& s) const {
+    return Sum(*this, UnaryExpr(s, '-'));
 }
 VectExpr ScalarExpr::operator-(const VectExpr& v) const {
     return this->op(v, '-');
 }
-BinExpr ScalarExpr::operator*(const ScalarExpr& s) const {
-    return this->op(s, '*');
+Product ScalarExpr::operator*(const ScalarExpr& s) const {
+    return Product(*this, s);
 }
 VectExpr ScalarExpr::operator*(const VectExpr& v) const {
     return this->op(v, '*');
@@ -189,19 +530,17 @@ VectExpr ScalarExpr::operator^(const VectExpr& v) const {
 }
 
 VectExpr VectExpr::op(const ScalarExpr& s, char op) const {
-    BinExpr v1 = BinExpr(*this->getX(), op, s);
-    BinExpr v2 = BinExpr(*this->getY(), op, s);
-    BinExpr v3 = BinExpr(*this->getZ(), op, s);
-
-    return VectExpr(v1, v2, v3);
+    Expr *e = binOp(this->copy(), op, s.copy());
+    VectExpr ret(*static_cast<VectExpr *>(e));
+    delete e;
+    return ret;
 }
 
 VectExpr VectExpr::op(const VectExpr& v, char op) const {
-    BinExpr v1 = BinExpr(*this->getX(), op, *v.getX());
-    BinExpr v2 = BinExpr(*this->getY(), op, *v.getY());
-    BinExpr v3 = BinExpr(*this->getZ(), op, *v.getZ());
-
-    return VectExpr(v1, v2, v3);
+    Expr *e = binOp(this->copy(), op, v.copy());
+    VectExpr ret(*static_cast<VectExpr *>(e));
+    delete e;
+    return ret;
 }
 
 VectExpr VectExpr::operator+(const VectExpr& v) const {
@@ -241,8 +580,8 @@ VectExpr VectExpr::operator^(const ScalarExpr& s) const {
     return this->op(s, '^');
 }
 
-UnaryExpr::UnaryExpr(ScalarExpr *expr, char op, Node *p) : ScalarExpr(p) {
-    children.push_back(expr);
+UnaryExpr::UnaryExpr(ScalarExpr *expr, char op, Node *p) : ScalarExpr(UNARY, p) {
+    addChild(expr);
     this->op = op;
 }
 
@@ -256,8 +595,8 @@ UnaryExpr::UnaryExpr(const UnaryExpr& ue) :
             ue.getOp()) {}
 
 ScalarExpr *UnaryExpr::getExpr() const {
-    assert(dynamic_cast<ScalarExpr *>(children[0]));
-    return dynamic_cast<ScalarExpr *>(children[0]);
+    assert(isa<ScalarExpr>(children[0]));
+    return static_cast<ScalarExpr *>(children[0]);
 }
 
 char UnaryExpr::getOp() const {
@@ -269,20 +608,19 @@ void UnaryExpr::dump(std::ostream& os) const {
 }
 
 bool UnaryExpr::operator==(Node& n) {
-    try {
-        UnaryExpr& ue = dynamic_cast<UnaryExpr&>(n);
-        return getOp() == ue.getOp() &&
-            *this->getExpr() == *ue.getExpr();
-    }
-    catch (std::bad_cast) {
-        return false;
+    if (auto ue = dyn_cast<UnaryExpr>(&n)) {
+        if (getHash() != n.getHash())
+            return false;
+        return getOp() == ue->getOp() &&
+            *this->getExpr() == *ue->getExpr();
     }
+    return false;
 }
 
 DiffExpr::DiffExpr(Expr *expr, Identifier *id,
-        std::string order, Node *p) : ScalarExpr(p) {
-    this->children.push_back(expr);
-    this->children.push_back(id);
+        std::string order, Node *p) : ScalarExpr(DIFF, p) {
+    addChild(expr);
+    addChild(id);
     this->order = order;
 }
 
@@ -292,46 +630,75 @@ DiffExpr::DiffExpr(const DiffExpr& de) :
             de.getOrder()) { }
 
 DiffExpr::DiffExpr(const Expr& e, const Identifier& id, std::string order, Node *p) :
-    DiffExpr(e.copy(), dynamic_cast<Identifier *>(id.copy()), order, p) {
+    DiffExpr(e.copy(), static_cast<Identifier *>(id.copy()), order, p) {
         clearOnDelete = true;
     }
 
 Expr *DiffExpr::getExpr() const {
-    assert(dynamic_cast<Expr *>(this->children[0]));
-    return dynamic_cast<Expr *>(this->children[0]);
+    assert(isa<Expr>(this->children[0]));
+    return static_cast<Expr *>(this->children[0]);
 }
 
 bool DiffExpr::operator==(Node& n) {
-    try {
-        DiffExpr& de = dynamic_cast<DiffExpr&>(n);
-        return this->getVar() == de.getVar() &&
-            *this->getExpr() == *de.getExpr() &&
-            this->getOrder() == de.getOrder();
-    }
-    catch (std::bad_cast) {
-        return false;
+    if (auto de = dyn_cast<DiffExpr>(&n)) {
+        if (getHash() != n.getHash())
+            return false;
+        return this->getVar() == de->getVar() &&
+            *this->getExpr() == *de->getExpr() &&
+            this->getOrder() == de->getOrder();
     }
+    return false;
 }
 
 Identifier *DiffExpr::getVar() const {
-    assert(dynamic_cast<Identifier *>(this->children[1]));
-    return dynamic_cast<Identifier *>(this->children[1]);
+    assert(isa<Identifier>(this->children[1]));
+    return static_cast<Identifier *>(this->children[1]);
 }
 
 void DiffExpr::setOrder(std::string order) {
     this->order = order;
+    invalidate();
 }
 
 std::string DiffExpr::getOrder() const {
     return order;
 }
 
-Identifier::Identifier(std::string n, int vectComponent, Node *p) :
-    ScalarExpr(p), name(n), vectComponent(vectComponent) { }
+Identifier::Identifier(NodeKind kind, Name n, int vectComponent,
+        Node *p) : ScalarExpr(kind, p), name(n), vectComponent(vectComponent),
+    symbol(NULL), symbolKind(UNRESOLVED_NAME), index(0) { }
+
+Identifier::Identifier(Name n, int vectComponent, Node *p) :
+    Identifier(IDENTIFIER, n, vectComponent, p) { }
 
 Identifier::Identifier(const Identifier& id) :
     Identifier(id.name, id.vectComponent) {
         this->srcLoc = id.srcLoc;
+        bind(id.symbol, id.symbolKind, id.index);
+}
+
+void Identifier::bind(Symbol *s, SymbolKind k, int i) {
+    symbol = s;
+    symbolKind = k;
+    index = i;
+    // the field attribute depends on the binding
+    invalidate();
+}
+
+bool Identifier::isResolved() const {
+    return symbolKind != UNRESOLVED_NAME;
+}
+
+Symbol *Identifier::getSymbol() const {
+    return symbol;
+}
+
+SymbolKind Identifier::getSymbolKind() const {
+    return symbolKind;
+}
+
+int Identifier::getIndex() const {
+    return index;
 }
 
 void Identifier::dump(std::ostream& os) const {
@@ -339,29 +706,45 @@ void Identifier::dump(std::ostream& os) const {
 }
 
 bool Identifier::operator==(Node& n) {
-    try {
-        Identifier& id = dynamic_cast<Identifier&>(n);
-        return this->name == id.name;
+    if (this == &n)
+        return true;
+    // a function call or an array is not equal to a plain identifier, even
+    // with the same name
+    if (n.getKind() == IDENTIFIER) {
+        return this->name == static_cast<Identifier&>(n).name;
     }
-    catch (std::bad_cast) {
-        return false;
+    return false;
+}
+
+FuncCall::FuncCall(Name name, ExprLst *args, Node *p) :
+    Identifier(FUNC_CALL, name, 0, p) {
+    if (args) {
+        for (auto c: *args) {
+            addChild(c->copy());
+        }
     }
 }
 
-FuncCall::FuncCall(std::string name, ExprLst *args, Node *p) : Identifier(name, 0, p) {
-    for (auto c: *args) {
-        children.push_back(c->copy());
+FuncCall::FuncCall(Name name, ExprLst&& args, Node *p) :
+    Identifier(FUNC_CALL, name, 0, p) {
+    for (auto c: args) {
+        addChild(c);
     }
+    args.clear();
 }
 
-FuncCall::FuncCall(std::string name, Expr *arg, Node *p) : Identifier(name, 0, p) {
-    children.push_back(arg);
+FuncCall::FuncCall(Name name, Expr *arg, Node *p) :
+    Identifier(FUNC_CALL, name, 0, p) {
+    addChild(arg);
 }
 
-FuncCall::FuncCall(const FuncCall& fc) :
-    FuncCall(fc.name, new ExprLst(fc.getArgs())) { }
+FuncCall::FuncCall(const FuncCall& fc) : Identifier(FUNC_CALL, fc.name, 0) {
+    for (auto c: fc.children) {
+        addChild(static_cast<Expr *>(c)->copy());
+    }
+}
 
-FuncCall::FuncCall(std::string name, const Expr& arg, Node *p) :
+FuncCall::FuncCall(Name name, const Expr& arg, Node *p) :
     FuncCall(name, arg.copy(), p) {
         clearOnDelete = true;
     }
@@ -373,47 +756,51 @@ void FuncCall::dump(std::ostream& os) const {
 ExprLst FuncCall::getArgs() const {
     ExprLst ret;
     for (auto arg: children) {
-        if (!dynamic_cast<Expr *>(arg)) {
+        if (!isa<Expr>(arg)) {
             logger::err << "arg is not an expression\n";
             exit(EXIT_FAILURE);
         }
-        ret.push_back(dynamic_cast<Expr *>(arg));
+        ret.push_back(static_cast<Expr *>(arg));
     }
     return ret;
 }
 
 bool FuncCall::operator==(Node& n) {
-    try {
-        FuncCall& fc = dynamic_cast<FuncCall&>(n);
+    if (this == &n)
+        return true;
+    if (auto fc = dyn_cast<FuncCall>(&n)) {
+        if (getHash() != n.getHash())
+            return false;
         bool sameArgs;
-        if (this->name != fc.name)
+        if (this->name != fc->name)
             return false;
-        if (this->getArgs().size() == fc.getArgs().size())
+        if (this->getArgs().size() == fc->getArgs().size())
             sameArgs = true;
         else
             return false;
         for (int i=0; i<this->getArgs().size(); i++) {
-            sameArgs = sameArgs && *this->getArgs()[i] == *fc.getArgs()[i];
+            sameArgs = sameArgs && *this->getArgs()[i] == *fc->getArgs()[i];
         }
         return sameArgs;
     }
-    catch (std::bad_cast) {
-        return false;
-    }
+    return false;
 }
 
-ArrayExpr::ArrayExpr(std::string name, ExprLst *indices, Node *p) : Identifier(name, 0, p) {
+ArrayExpr::ArrayExpr(Name name, ExprLst *indices, Node *p) :
+    Identifier(ARRAY, name, 0, p) {
     for(auto c: *indices)
-        children.push_back(c);
+        addChild(c);
 }
 
-ArrayExpr::ArrayExpr(const ArrayExpr& ae) :
-    ArrayExpr(ae.name, new ExprLst(ae.getIndices())) { }
+ArrayExpr::ArrayExpr(const ArrayExpr& ae) : Identifier(ARRAY, ae.name, 0) {
+    for (auto c: ae.children)
+        addChild(c);
+}
 
 ExprLst ArrayExpr::getIndices() const {
     ExprLst ret;
     for (auto c: children) {
-        ret.push_back(dynamic_cast<Expr *>(c));
+        ret.push_back(dyn_cast<Expr>(c));
     }
     return ret;
 }
@@ -424,7 +811,7 @@ bool ArrayExpr::operator==(Node& n) {
 }
 
 IndexRange::IndexRange(ScalarExpr *lb, ScalarExpr *ub, Node *p) :
-    BinExpr(lb, ':', ub, p) { }
+    BinExpr(INDEX_RANGE, lb, ':', ub, p) { }
 
 IndexRange::IndexRange(const IndexRange& ir) :
     IndexRange(
@@ -432,23 +819,23 @@ IndexRange::IndexRange(const IndexRange& ir) :
             scalar(ir.getUB()->copy())) { }
 
 ScalarExpr *IndexRange::getLB() const {
-    assert(dynamic_cast<ScalarExpr *>(children[0]));
-    return dynamic_cast<ScalarExpr *>(children[0]);
+    assert(isa<ScalarExpr>(children[0]));
+    return static_cast<ScalarExpr *>(children[0]);
 }
 
 ScalarExpr *IndexRange::getUB() const {
-    assert(dynamic_cast<ScalarExpr *>(children[1]));
-    return dynamic_cast<ScalarExpr *>(children[1]);
+    assert(isa<ScalarExpr>(children[1]));
+    return static_cast<ScalarExpr *>(children[1]);
 }
 
 void DiffExpr::dump(std::ostream &os) const {
     os << "Diff (order: " << this->order << ")";
 }
 
-VectExpr::VectExpr(ScalarExpr *x, ScalarExpr *y, ScalarExpr *z) : Expr() {
-    children.push_back(x);
-    children.push_back(y);
-    children.push_back(z);
+VectExpr::VectExpr(ScalarExpr *x, ScalarExpr *y, ScalarExpr *z) : Expr(VECTOR) {
+    addChild(x);
+    addChild(y);
+    addChild(z);
 }
 
 VectExpr::VectExpr(const ScalarExpr& x, const ScalarExpr& y, const ScalarExpr& z) :
@@ -473,7 +860,7 @@ ScalarExpr *VectExpr::getZ() const {
 
 ScalarExpr *VectExpr::getComponent(int n) const {
     assert(n >= 0 && n <= 3);
-    if (auto c = dynamic_cast<ScalarExpr *>(children[n])) {
+    if (auto c = dyn_cast<ScalarExpr>(children[n])) {
         return c;
     }
     else {
@@ -487,33 +874,34 @@ void VectExpr::dump(std::ostream& os) const {
 }
 
 bool VectExpr::operator==(Node& n) {
-    try {
-        VectExpr& ve = dynamic_cast<VectExpr&>(n);
+    if (this == &n)
+        return true;
+    if (auto ve = dyn_cast<VectExpr>(&n)) {
+        if (getHash() != n.getHash())
+            return false;
         return
-            *getX() == *ve.getX() &&
-            *getY() == *ve.getY() &&
-            *getZ() == *ve.getZ();
-    }
-    catch (std::bad_cast) {
-        return false;
+            *getX() == *ve->getX() &&
+            *getY() == *ve->getY() &&
+            *getZ() == *ve->getZ();
     }
+    return false;
 }
 
-BinExpr *div(Expr &e) {
-    try {
-        VectExpr& ve = dynamic_cast<VectExpr&>(e);
-        ScalarExpr *x = ve.getX();
-        ScalarExpr *y = ve.getY();
-        ScalarExpr *z = ve.getZ();
-        ScalarExpr *dx = new DiffExpr(x, new Identifier("r"));
-        ScalarExpr *dy = new DiffExpr(y, new Identifier("theta"));
-        ScalarExpr *dz = new DiffExpr(z, new Identifier("phi"));
-        return new BinExpr(dx, '+', new BinExpr(dy, '+', dz));
-    }
-    catch (std::bad_cast) {
+Sum *div(Expr &e) {
+    VectExpr *ve = dyn_cast<VectExpr>(&e);
+    if (!ve) {
         logger::err << "div can only be applied to vector expression\n";
         exit(EXIT_FAILURE);
     }
+    ScalarExpr *x = ve->getX();
+    ScalarExpr *y = ve->getY();
+    ScalarExpr *z = ve->getZ();
+    ScalarExpr *dx = new DiffExpr(x, new Identifier("r"));
+    ScalarExpr *dy = new DiffExpr(y, new Identifier("theta"));
+    ScalarExpr *dz = new DiffExpr(z, new Identifier("phi"));
+    Sum *s = new Sum(dx, dy);
+    s->addOperand(dz);
+    return s;
 }
 
 UnaryExpr operator-(ScalarExpr& s) {
@@ -562,178 +950,162 @@ FuncCall cos(const ScalarExpr& s) {
     return FuncCall("cos", s);
 }
 
-Expr& operator+(const Expr& e1, const Expr& e2) {
-    try {
-        const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-        const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-        return *(s1 + s2).copy();
-    }
-    catch (std::bad_cast) {
-        try {
-            const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-            const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-            return *(v1 + v2).copy();
-        }
-        catch (std::bad_cast) {
-            try {
-                const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-                const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-                return *(s1 + v2).copy();
-            }
-            catch (std::bad_cast) {
-                const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-                const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-                return *(v1 + s2).copy();
-            }
-        }
+// takes the components of a vector built by the caller and frees the vector
+static void release(VectExpr *v, ScalarExpr *comps[3]) {
+    for (int i=0; i<3; i++)
+        comps[i] = v->getComponent(i);
+    // shared nodes belong to their pool, their components as well
+    if (!v->isShared()) {
+        v->getChildren().clear();
+        delete v;
     }
 }
 
-Expr& operator-(const Expr& e1, const Expr& e2) {
-    try {
-        const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-        const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-        return *(s1 - s2).copy();
-    }
-    catch (std::bad_cast) {
-        try {
-            const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-            const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-            return *(v1 - v2).copy();
-        }
-        catch (std::bad_cast) {
-            try {
-                const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-                const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-                return *(s1 - v2).copy();
-            }
-            catch (std::bad_cast) {
-                const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-                const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-                return *(v1 - s2).copy();
-            }
-        }
-    }
+static UnaryExpr *newUnaryExpr(ScalarExpr *expr, char op) {
+    UnaryExpr *ue = new UnaryExpr(expr, op);
+    ue->setClearOnDelete(true);
+    return ue;
 }
 
-Expr& operator*(const Expr& e1, const Expr& e2) {
-    try {
-        const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-        const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-        return *(s1 * s2).copy();
-    }
-    catch (std::bad_cast) {
-        try {
-            const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-            const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-            return *(v1 * v2).copy();
-        }
-        catch (std::bad_cast) {
-            try {
-                const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-                const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-                return *(s1 * v2).copy();
+// nodes built from adopted operands own them
+// `+', `-' and `*' extend the sum or product given as left operand (if it
+// is not shared) instead of nesting a new node
+static ScalarExpr *newOp(ScalarExpr *lOp, char op, ScalarExpr *rOp) {
+    NaryExpr *ne = NULL;
+    switch (op) {
+        case '-':
+            rOp = newUnaryExpr(rOp, '-');
+            // fall through
+        case '+':
+            if (isa<Sum>(lOp) && !lOp->isShared()) {
+                ne = static_cast<Sum *>(lOp);
             }
-            catch (std::bad_cast) {
-                const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-                const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-                return *(v1 * s2).copy();
+            else {
+                ne = new Sum();
+                ne->addOperand(lOp);
             }
-        }
-    }
-}
-
-Expr& operator/(const Expr& e1, const Expr& e2) {
-    try {
-        const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-        const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-        return *(s1 / s2).copy();
-    }
-    catch (std::bad_cast) {
-        try {
-            const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-            const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-            return *(v1 / v2).copy();
-        }
-        catch (std::bad_cast) {
-            try {
-                const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-                const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-                return *(s1 / v2).copy();
+            break;
+        case '*':
+            if (isa<Product>(lOp) && !lOp->isShared()) {
+                ne = static_cast<Product *>(lOp);
             }
-            catch (std::bad_cast) {
-                const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-                const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-                return *(v1 / s2).copy();
+            else {
+                ne = new Product();
+                ne->addOperand(lOp);
             }
+            break;
+        default: {
+            BinExpr *be = new BinExpr(lOp, op, rOp);
+            be->setClearOnDelete(true);
+            return be;
         }
     }
+    ne->addOperand(rOp);
+    ne->setClearOnDelete(true);
+    return ne;
 }
 
-Expr& operator^(const Expr& e1, const Expr& e2) {
-    try {
-        const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-        const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-        return *(s1 ^ s2).copy();
-    }
-    catch (std::bad_cast) {
-        try {
-            const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-            const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-            return *(v1 ^ v2).copy();
-        }
-        catch (std::bad_cast) {
-            try {
-                const ScalarExpr& s1 = dynamic_cast<const ScalarExpr&>(e1);
-                const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-                return *(s1 ^ v2).copy();
-            }
-            catch (std::bad_cast) {
-                const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-                const ScalarExpr& s2 = dynamic_cast<const ScalarExpr&>(e2);
-                return *(v1 ^ s2).copy();
-            }
-        }
+static VectExpr *newVectExpr(ScalarExpr *x, ScalarExpr *y, ScalarExpr *z) {
+    VectExpr *ve = new VectExpr(x, y, z);
+    ve->setClearOnDelete(true);
+    return ve;
+}
+
+Expr *binOp(Expr *lOp, char op, Expr *rOp) {
+    assert(lOp && rOp);
+    ScalarExpr *s1 = dyn_cast<ScalarExpr>(lOp);
+    ScalarExpr *s2 = dyn_cast<ScalarExpr>(rOp);
+    ScalarExpr *v1[3], *v2[3];
+
+    if (s1 && s2)
+        return newOp(s1, op, s2);
+
+    if (s1) {
+        release(static_cast<VectExpr *>(rOp), v2);
+        return newVectExpr(
+                newOp(s1, op, v2[0]),
+                newOp(scalar(s1->copy()), op, v2[1]),
+                newOp(scalar(s1->copy()), op, v2[2]));
+    }
+    if (s2) {
+        release(static_cast<VectExpr *>(lOp), v1);
+        return newVectExpr(
+                newOp(v1[0], op, s2),
+                newOp(v1[1], op, scalar(s2->copy())),
+                newOp(v1[2], op, scalar(s2->copy())));
     }
+    release(static_cast<VectExpr *>(lOp), v1);
+    release(static_cast<VectExpr *>(rOp), v2);
+    return newVectExpr(
+            newOp(v1[0], op, v2[0]),
+            newOp(v1[1], op, v2[1]),
+            newOp(v1[2], op, v2[2]));
+}
+
+Expr *negate(Expr *e) {
+    assert(e);
+    if (auto s = dyn_cast<ScalarExpr>(e))
+        return newUnaryExpr(s, '-');
+    ScalarExpr *v[3];
+    release(static_cast<VectExpr *>(e), v);
+    return newVectExpr(
+            newUnaryExpr(v[0], '-'),
+            newUnaryExpr(v[1], '-'),
+            newUnaryExpr(v[2], '-'));
 }
 
+Expr& operator+(const Expr& e1, const Expr& e2) {
+    return *binOp(e1.copy(), '+', e2.copy());
+}
 
-VectExpr crossProduct(const Expr& e1, const Expr& e2) {
-    try {
-        const VectExpr& u = dynamic_cast<const VectExpr&>(e1);
-        const VectExpr& v = dynamic_cast<const VectExpr&>(e2);
+Expr& operator-(const Expr& e1, const Expr& e2) {
+    return *binOp(e1.copy(), '-', e2.copy());
+}
 
-        ScalarExpr& u1 = *u.getX();
-        ScalarExpr& u2 = *u.getY();
-        ScalarExpr& u3 = *u.getZ();
+Expr& operator*(const Expr& e1, const Expr& e2) {
+    return *binOp(e1.copy(), '*', e2.copy());
+}
 
-        ScalarExpr& v1 = *v.getX();
-        ScalarExpr& v2 = *v.getY();
-        ScalarExpr& v3 = *v.getZ();
+Expr& operator/(const Expr& e1, const Expr& e2) {
+    return *binOp(e1.copy(), '/', e2.copy());
+}
 
-        return ir::VectExpr(
-                u2*v3 - u3*v2,
-                u3*v1 - u1*v3,
-                u1*v2 - u2*v1);
-    }
-    catch (std::bad_cast) {
+Expr& operator^(const Expr& e1, const Expr& e2) {
+    return *binOp(e1.copy(), '^', e2.copy());
+}
+
+VectExpr crossProduct(const Expr& e1, const Expr& e2) {
+    if (!isa<VectExpr>(&e1) || !isa<VectExpr>(&e2)) {
         logger::err << "cross product con only be applied to vectors\n";
         exit(EXIT_FAILURE);
     }
+    const VectExpr& u = static_cast<const VectExpr&>(e1);
+    const VectExpr& v = static_cast<const VectExpr&>(e2);
+
+    ScalarExpr& u1 = *u.getX();
+    ScalarExpr& u2 = *u.getY();
+    ScalarExpr& u3 = *u.getZ();
+
+    ScalarExpr& v1 = *v.getX();
+    ScalarExpr& v2 = *v.getY();
+    ScalarExpr& v3 = *v.getZ();
+
+    return ir::VectExpr(
+            u2*v3 - u3*v2,
+            u3*v1 - u1*v3,
+            u1*v2 - u2*v1);
 }
 
-BinExpr dotProduct(const Expr& e1, const Expr& e2) {
-    try {
-        const VectExpr& v1 = dynamic_cast<const VectExpr&>(e1);
-        const VectExpr& v2 = dynamic_cast<const VectExpr&>(e2);
-        return *v1.getX() * *v2.getX() +
-            *v1.getY() * *v2.getY() +
-            *v1.getZ() * *v2.getZ();
-    }
-    catch (std::bad_cast) {
+Sum dotProduct(const Expr& e1, const Expr& e2) {
+    if (!isa<VectExpr>(&e1) || !isa<VectExpr>(&e2)) {
         logger::err << "dot product con only be applied to vectors\n";
         exit(EXIT_FAILURE);
     }
+    const VectExpr& v1 = static_cast<const VectExpr&>(e1);
+    const VectExpr& v2 = static_cast<const VectExpr&>(e2);
+    return *v1.getX() * *v2.getX() +
+        *v1.getY() * *v2.getY() +
+        *v1.getZ() * *v2.getZ();
 }
 
 } // end namespace ir
@@ -0,0 +1,159 @@
+#include "ExprPool.h"
+#include "IR.h"
+
+#include <cassert>
+#include <functional>
+
+namespace ir {
+
+static const Name drName("dr");
+
+static bool sameNode(Node *n0, Node *n1) {
+    if (n0->getKind() != n1->getKind())
+        return false;
+    if (n0->getChildren() != n1->getChildren())
+        return false;
+    switch (n0->getKind()) {
+        case INT_VALUE:
+            return static_cast<Value<int> *>(n0)->getValue() ==
+                static_cast<Value<int> *>(n1)->getValue();
+        case FLOAT_VALUE:
+            return static_cast<Value<float> *>(n0)->getValue() ==
+                static_cast<Value<float> *>(n1)->getValue();
+        case BINARY:
+            return static_cast<BinExpr *>(n0)->getOp() ==
+                static_cast<BinExpr *>(n1)->getOp();
+        case IDENTIFIER:
+        case FUNC_CALL:
+            return static_cast<Identifier *>(n0)->name ==
+                static_cast<Identifier *>(n1)->name;
+        default:
+            return true;
+    }
+}
+
+ExprPool::ExprPool() : nShared(0), nMerged(0) { }
+
+ExprPool::~ExprPool() {
+    // the children of a shared node are shared as well: they are detached
+    // before any node is deleted, so that a node deleting its children
+    // (see Node::clear) never reads one that is already deleted
+    for (auto e: table) {
+        e.second->getChildren().clear();
+    }
+    for (auto e: table) {
+        delete e.second;
+    }
+}
+
+void ExprPool::pin(const Name& name) {
+    pinned.insert(name);
+}
+
+bool ExprPool::isInternable(Node *n) const {
+    switch (n->getKind()) {
+        case IDENTIFIER:
+        case FUNC_CALL: {
+            Identifier *id = static_cast<Identifier *>(n);
+            if (id->name == drName)
+                return false;
+            return pinned.find(id->name) == pinned.end();
+        }
+        case BINARY:
+        case SUM:
+        case PRODUCT:
+        case VECTOR:
+        case INT_VALUE:
+        case FLOAT_VALUE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ExprPool::isDerivative(Node *n) const {
+    switch (n->getKind()) {
+        case UNARY:
+            return static_cast<UnaryExpr *>(n)->getOp() == '\'';
+        case FUNC_CALL:
+            return static_cast<FuncCall *>(n)->name == drName;
+        case DIFF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Expr *ExprPool::intern(Expr *e) {
+    assert(e);
+    if (e->isShared())
+        return e;
+
+    for (auto& c: e->getChildren()) {
+        assert(isa<Expr>(c));
+        c = intern(static_cast<Expr *>(c));
+    }
+
+    // children are canonical, so nodes with the same structural hash only
+    // need a shallow comparison
+    size_t h = e->getHash();
+    auto range = table.equal_range(h);
+    for (auto it = range.first; it != range.second; it++) {
+        if (sameNode(it->second, e)) {
+            // children are shared: deleting e does not affect them
+            delete e;
+            nMerged++;
+            return it->second;
+        }
+    }
+    e->shared = true;
+    table.insert(std::make_pair(h, e));
+    nShared++;
+    return e;
+}
+
+bool ExprPool::shareChildren(Node *n) {
+    // ArrayExpr may reference the same index node twice: leave them alone
+    if (isa<ArrayExpr>(n))
+        return false;
+
+    ChildArray& children = n->getChildren();
+    std::vector<bool> internable(children.size());
+    bool all = isInternable(n);
+    for (size_t i=0; i<children.size(); i++) {
+        internable[i] = shareChildren(children[i]);
+        all = all && internable[i];
+    }
+    if (!all && !isDerivative(n)) {
+        for (size_t i=0; i<children.size(); i++) {
+            if (internable[i])
+                children[i] = intern(static_cast<Expr *>(children[i]));
+        }
+    }
+    return all;
+}
+
+Node *ExprPool::share(Node *n) {
+    assert(n);
+    if (auto e = dyn_cast<Expr>(n))
+        return share(e);
+    shareChildren(n);
+    return n;
+}
+
+Expr *ExprPool::share(Expr *e) {
+    assert(e);
+    if (shareChildren(e))
+        return intern(e);
+    return e;
+}
+
+int ExprPool::getSharedNumber() const {
+    return nShared;
+}
+
+int ExprPool::getMergedNumber() const {
+    return nMerged;
+}
+
+} // end namespace ir
@@ -0,0 +1,67 @@
+#ifndef EXPR_POOL_H
+#define EXPR_POOL_H
+
+#include "config.h"
+#include "Name.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ir {
+
+class Node;
+class Expr;
+
+///
+/// Hash-consing factory for expressions.
+///
+/// Structurally identical immutable subexpressions are interned once and
+/// shared (the AST becomes a DAG). Shared nodes are owned by the pool: they
+/// are never modified and copying them returns the node itself.
+///
+/// Within a pool, nodes with the same children in the same order are the
+/// same node. Equality is structural though, and the operands of sums and
+/// products commute: sums whose operands come in different orders are
+/// different nodes of the pool, so are their ancestors, and they are all
+/// equal. Two shared nodes are equal if they are the same node, otherwise
+/// they are compared (as nodes of different pools, e.g. of two streamed
+/// equations, are).
+///
+/// Subexpressions whose context is inspected through their parent by the
+/// backends stay unique: operands of derivatives (`u'`, `dr(u, n)`,
+/// DiffExpr) and subexpressions refering to a pinned name.
+///
+class ExprPool {
+    private:
+        std::unordered_multimap<size_t, Expr *> table;
+        std::unordered_set<Name> pinned;
+        int nShared;
+        int nMerged;
+
+        bool isInternable(Node *) const;
+        bool isDerivative(Node *) const;
+        bool shareChildren(Node *);
+
+    public:
+        ExprPool();
+        ~ExprPool();
+
+        /// expressions refering to `name' are never shared
+        void pin(const Name& name);
+
+        /// returns the canonical node structurally identical to the given
+        /// expression (which is deleted if a canonical node already exists)
+        Expr *intern(Expr *);
+
+        /// interns all maximal immutable subexpressions of the tree
+        Node *share(Node *);
+        Expr *share(Expr *);
+
+        int getSharedNumber() const;
+        int getMergedNumber() const;
+};
+
+} // end namespace ir
+
+#endif // EXPR_POOL_H
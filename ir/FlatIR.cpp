@@ -0,0 +1,750 @@
+#include "FlatIR.h"
+#include "SymTab.h"
+#include "Printer.h"
+
+#include <cassert>
+#include <cstring>
+#include <unordered_set>
+#include <utility>
+
+namespace ir {
+
+static int32_t floatBits(float f) {
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(int32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+const FlatIR::Index FlatIR::none;
+const uint32_t FlatIR::version;
+
+FlatIR::FlatIR() { }
+
+FlatIR::FlatIR(Program *p) : filename(p->filename) {
+    assert(p);
+    for (auto d: p->getDecls()) {
+        decls.push_back(add(d));
+    }
+    for (auto e: p->getEqs()) {
+        eqs.push_back(add(e));
+    }
+    for (auto s: p->getSymTab()) {
+        Symbol fs;
+        fs.name = intern(s->name);
+        fs.paramType = intern("");
+        fs.info = 0;
+        fs.internal = s->isInternal();
+        fs.def = s->getDef() ? add(s->getDef()) : none;
+        if (auto param = dynamic_cast<ir::Param *>(s)) {
+            fs.type = PARAM_SYMBOL;
+            fs.paramType = intern(param->getType());
+        }
+        else if (auto array = dynamic_cast<ir::Array *>(s)) {
+            fs.type = ARRAY_SYMBOL;
+            fs.info = array->getNDim();
+        }
+        else if (auto var = dynamic_cast<ir::Variable *>(s)) {
+            fs.type = VARIABLE_SYMBOL;
+            fs.info = var->vectComponent;
+        }
+        else if (auto func = dynamic_cast<ir::Function *>(s)) {
+            fs.type = FUNCTION_SYMBOL;
+            fs.info = func->getNParams();
+        }
+        else if (dynamic_cast<ir::Field *>(s)) {
+            fs.type = FIELD_SYMBOL;
+        }
+        else if (dynamic_cast<ir::Scalar *>(s)) {
+            fs.type = SCALAR_SYMBOL;
+        }
+        else {
+            logger::err << "unknown symbol type: " << s->name << "\n";
+            exit(EXIT_FAILURE);
+        }
+        symbols.push_back(fs);
+    }
+}
+
+int32_t FlatIR::intern(const std::string& s) {
+    auto it = stringIds.find(s);
+    if (it != stringIds.end())
+        return it->second;
+    int32_t id = strings.size();
+    strings.push_back(s);
+    stringIds[s] = id;
+    return id;
+}
+
+const std::string& FlatIR::getString(int32_t id) const {
+    return strings[id];
+}
+
+FlatIR::Index FlatIR::newNode(NodeKind k, char o, int32_t p, int32_t a,
+        SrcLoc loc) {
+    Index n = kind.size();
+    kind.push_back(k);
+    op.push_back(o);
+    firstChild.push_back(none);
+    nextSibling.push_back(none);
+    subtreeEnd.push_back(n + 1);
+    payload.push_back(p);
+    aux.push_back(a);
+    srcLoc.push_back(loc);
+    return n;
+}
+
+void FlatIR::addChild(Index parent, Index& last, Index child) {
+    if (last == none)
+        firstChild[parent] = child;
+    else
+        nextSibling[last] = child;
+    last = child;
+    subtreeEnd[parent] = subtreeEnd[child];
+}
+
+FlatIR::Index FlatIR::add(Node *node) {
+    Index last = none;
+    return add(node, none, last);
+}
+
+FlatIR::Index FlatIR::add(Node *node, Index parent, Index& last) {
+    assert(node);
+    char o = 0;
+    int32_t p = 0;
+    int32_t a = 0;
+    switch (node->getKind()) {
+        case BINARY:
+        case INDEX_RANGE:
+            o = static_cast<BinExpr *>(node)->getOp();
+            break;
+        case SUM:
+        case PRODUCT:
+            o = static_cast<NaryExpr *>(node)->getOp();
+            break;
+        case UNARY:
+            o = static_cast<UnaryExpr *>(node)->getOp();
+            break;
+        case DIFF:
+            p = intern(static_cast<DiffExpr *>(node)->getOrder());
+            break;
+        case IDENTIFIER:
+        case FUNC_CALL:
+        case ARRAY:
+            p = intern(static_cast<Identifier *>(node)->name);
+            a = static_cast<Identifier *>(node)->vectComponent;
+            break;
+        case INT_VALUE:
+            p = static_cast<Value<int> *>(node)->getValue();
+            break;
+        case FLOAT_VALUE:
+            p = floatBits(static_cast<Value<float> *>(node)->getValue());
+            break;
+        case EQUATION:
+            p = intern(static_cast<Equation *>(node)->name);
+            break;
+        case BOUNDARY_COND:
+            a = static_cast<BC *>(node)->getEqLoc();
+            break;
+        default:
+            break;
+    }
+    Index n = newNode(node->getKind(), o, p, a, node->srcLoc);
+    Index lastChild = none;
+    for (auto c: node->getChildren()) {
+        add(c, n, lastChild);
+    }
+    if (parent != none)
+        addChild(parent, last, n);
+    return n;
+}
+
+FlatIR::Index FlatIR::getChild(Index n, int i) const {
+    Index c = firstChild[n];
+    while (i-- > 0 && c != none)
+        c = nextSibling[c];
+    return c;
+}
+
+const std::string& FlatIR::getName(Index n) const {
+    return strings[payload[n]];
+}
+
+int FlatIR::getIntValue(Index n) const {
+    assert(kind[n] == INT_VALUE);
+    return payload[n];
+}
+
+float FlatIR::getFloatValue(Index n) const {
+    assert(kind[n] == FLOAT_VALUE);
+    return bitsFloat(payload[n]);
+}
+
+SrcLoc FlatIR::getSrcLoc(Index n) const {
+    return srcLoc[n];
+}
+
+size_t FlatIR::size() const {
+    return kind.size();
+}
+
+size_t FlatIR::getBytesUsed() const {
+    size_t bytes = kind.size() * (sizeof(uint8_t) + sizeof(char) +
+            3 * sizeof(Index) + 2 * sizeof(int32_t) + sizeof(SrcLoc));
+    for (auto& s: strings)
+        bytes += sizeof(std::string) + s.size();
+    return bytes;
+}
+
+const std::vector<FlatIR::Index>& FlatIR::getDecls() const {
+    return decls;
+}
+
+const std::vector<FlatIR::Index>& FlatIR::getEqs() const {
+    return eqs;
+}
+
+void FlatIR::setEq(size_t i, Index eq) {
+    assert(kind[eq] == EQUATION);
+    eqs[i] = eq;
+}
+
+const std::vector<int32_t>& FlatIR::getImports() const {
+    return imports;
+}
+
+void FlatIR::addImport(const std::string& module) {
+    imports.push_back(intern(module));
+}
+
+static ScalarExpr *scalarChild(Node *n) {
+    return scalar(static_cast<Expr *>(n));
+}
+
+Node *FlatIR::toNode(Index root) const {
+    // names of the strings interned so far, so that building an identifier
+    // does not look its name up (strings are only ever appended)
+    for (size_t i=names.size(); i<strings.size(); i++)
+        names.push_back(Name(strings[i]));
+
+    // the children of a node follow it in its subtree: built from the end of
+    // the subtree, the children of a node are built before it, and are found
+    // by index
+    std::vector<Node *> nodes(subtreeEnd[root] - root);
+    std::vector<Node *> children;
+    for (Index n = subtreeEnd[root] - 1; n >= root; n--) {
+        children.clear();
+        for (Index c = firstChild[n]; c != none; c = nextSibling[c])
+            children.push_back(nodes[c - root]);
+        nodes[n - root] = build(n, children);
+    }
+    return nodes[0];
+}
+
+Node *FlatIR::build(Index n, const std::vector<Node *>& children) const {
+    Node *node = NULL;
+    switch (kind[n]) {
+        case BINARY:
+            node = new BinExpr(scalarChild(children[0]), op[n],
+                    scalarChild(children[1]));
+            break;
+        case SUM:
+        case PRODUCT:
+            // operands are already flattened and sorted: adopt them
+            node = kind[n] == SUM ? (Node *) new Sum() : new Product();
+            for (auto c: children)
+                node->addChild(c);
+            break;
+        case INDEX_RANGE:
+            node = new IndexRange(scalarChild(children[0]),
+                    scalarChild(children[1]));
+            break;
+        case UNARY:
+            node = new UnaryExpr(scalarChild(children[0]), op[n]);
+            break;
+        case DIFF:
+            node = new DiffExpr(static_cast<Expr *>(children[0]),
+                    static_cast<Identifier *>(children[1]),
+                    strings[payload[n]]);
+            break;
+        case IDENTIFIER:
+            node = new Identifier(names[payload[n]], aux[n]);
+            break;
+        case FUNC_CALL: {
+            ExprLst args;
+            for (auto c: children)
+                args.push_back(static_cast<Expr *>(c));
+            node = new FuncCall(names[payload[n]], std::move(args));
+            break;
+        }
+        case ARRAY: {
+            ExprLst indices;
+            for (auto c: children)
+                indices.push_back(static_cast<Expr *>(c));
+            node = new ArrayExpr(names[payload[n]], &indices);
+            break;
+        }
+        case INT_VALUE:
+            node = new Value<int>(payload[n]);
+            break;
+        case FLOAT_VALUE:
+            node = new Value<float>(bitsFloat(payload[n]));
+            break;
+        case VECTOR:
+            node = new VectExpr(scalarChild(children[0]),
+                    scalarChild(children[1]),
+                    scalarChild(children[2]));
+            break;
+        case DECLARATION:
+            node = new Decl(static_cast<Expr *>(children[0]),
+                    static_cast<Expr *>(children[1]));
+            break;
+        case EQUATION: {
+            BCLst bcs;
+            for (size_t i=2; i<children.size(); i++)
+                bcs.push_back(static_cast<BC *>(children[i]));
+            node = new Equation(names[payload[n]],
+                    static_cast<Expr *>(children[0]),
+                    static_cast<Expr *>(children[1]),
+                    &bcs);
+            break;
+        }
+        case BOUNDARY_COND: {
+            BC *bc = new BC(static_cast<Equation *>(children[0]),
+                    static_cast<Equation *>(children[1]));
+            bc->setEqLoc(aux[n]);
+            node = bc;
+            break;
+        }
+        default:
+            logger::err << "unknown node kind in flat IR\n";
+            exit(EXIT_FAILURE);
+    }
+    node->srcLoc = srcLoc[n];
+    return node;
+}
+
+Program *FlatIR::toProgram(bool withEqs) const {
+    Arena *arena = new Arena();
+    Program *p;
+    {
+        Arena::Scope scope(arena);
+        DeclLst *declLst = new DeclLst();
+        EqLst *eqLst = new EqLst();
+        SymTab *symTab = new SymTab();
+
+        for (auto d: decls)
+            declLst->push_back(static_cast<Decl *>(toNode(d)));
+        if (withEqs)
+            for (auto e: eqs)
+                eqLst->push_back(static_cast<Equation *>(toNode(e)));
+
+        addSymbols(*symTab);
+        p = new Program(filename, symTab, declLst, eqLst);
+    }
+    p->setArena(arena);
+    return p;
+}
+
+void FlatIR::addSymbols(SymTab& symTab) const {
+    for (auto& s: symbols) {
+        const std::string& name = strings[s.name];
+        Expr *def = s.def != none ?
+            static_cast<Expr *>(toNode(s.def)) : NULL;
+        switch (s.type) {
+            case PARAM_SYMBOL:
+                symTab.add(new ir::Param(name,
+                            strings[s.paramType], def));
+                break;
+            case VARIABLE_SYMBOL:
+                symTab.add(new ir::Variable(name, s.info, def,
+                            s.internal));
+                break;
+            case ARRAY_SYMBOL:
+                symTab.add(new ir::Array(name, s.info, def,
+                            s.internal));
+                break;
+            case FUNCTION_SYMBOL:
+                symTab.add(new ir::Function(name, s.info));
+                break;
+            case FIELD_SYMBOL:
+                symTab.add(new ir::Field(name));
+                break;
+            case SCALAR_SYMBOL:
+                symTab.add(new ir::Scalar(name));
+                break;
+        }
+    }
+}
+
+std::vector<FlatIR::Index> FlatIR::getIds(Index root, bool uniq) const {
+    std::vector<Index> ret;
+    std::unordered_set<int32_t> seen;
+    for (Index n = root; n < subtreeEnd[root]; n++) {
+        switch (kind[n]) {
+            case IDENTIFIER:
+            case FUNC_CALL:
+            case ARRAY:
+                if (!uniq || seen.insert(payload[n]).second)
+                    ret.push_back(n);
+                break;
+            default:
+                break;
+        }
+    }
+    return ret;
+}
+
+// binary form: a header, then the arrays one after the other:
+//  - the strings: offsets (one more than strings) then characters
+//  - the files: the program name, then the files of the source locations
+//    (stored as strings)
+//  - the nodes: kind, op, subtreeEnd, payload, aux, then the locations as
+//    file (index in the files, 0 is unknown), column and line. The links
+//    to the children are not stored: they follow from the subtree ends
+//    (see link)
+//  - the declarations, the equations, the symbols (6 int32 each), then the
+//    imported modules
+// everything is in the byte order of the machine that wrote it: the byte
+// order field of a file written by another machine does not match
+static const char magic[8] = {'\x7f', 'E', 'D', 'L', 'F', 'L', 'A', 'T'};
+static const uint32_t byteOrder = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nNodes;
+    uint32_t nStrings;
+    uint32_t stringBytes;
+    uint32_t nFiles;
+    uint32_t fileBytes;
+    uint32_t nDecls;
+    uint32_t nEqs;
+    uint32_t nSymbols;
+    uint32_t nImports;
+};
+
+static const int symbolFields = 6;
+
+template <typename T>
+static void put(std::ostream& os, const std::vector<T>& v) {
+    os.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+
+static uint32_t stringBytes(const std::vector<std::string>& strings) {
+    uint32_t bytes = 0;
+    for (auto& s: strings)
+        bytes += s.size();
+    return bytes;
+}
+
+static void putStrings(std::ostream& os,
+        const std::vector<std::string>& strings) {
+    std::vector<uint32_t> offsets(1, 0);
+    for (auto& s: strings)
+        offsets.push_back(offsets.back() + s.size());
+    put(os, offsets);
+    for (auto& s: strings)
+        os.write(s.data(), s.size());
+}
+
+bool FlatIR::isBinary(const char *buf, size_t len) {
+    return len >= sizeof(magic) && memcmp(buf, magic, sizeof(magic)) == 0;
+}
+
+void FlatIR::write(std::ostream& os) const {
+    // file ids are only valid in this process: the locations refer to the
+    // names of their files
+    std::vector<std::string> files(1, filename);
+    std::unordered_map<uint16_t, uint16_t> fileIndex;
+    std::vector<uint16_t> locFile(size());
+    std::vector<uint16_t> locColumn(size());
+    std::vector<uint32_t> locLine(size());
+    for (size_t n=0; n<size(); n++) {
+        const SrcLoc& loc = srcLoc[n];
+        if (loc.isKnown()) {
+            auto it = fileIndex.find(loc.getFileId());
+            if (it == fileIndex.end()) {
+                it = fileIndex.insert(std::make_pair(loc.getFileId(),
+                            files.size())).first;
+                files.push_back(SrcLoc::getFile(loc.getFileId()));
+            }
+            locFile[n] = it->second;
+        }
+        locColumn[n] = loc.getColumn();
+        locLine[n] = loc.getLine();
+    }
+
+    std::vector<int32_t> syms;
+    for (auto& s: symbols) {
+        int32_t fields[symbolFields] = {s.type, s.name, s.paramType, s.info,
+            s.internal, s.def};
+        syms.insert(syms.end(), fields, fields + symbolFields);
+    }
+
+    Header h;
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byteOrder = byteOrder;
+    h.nNodes = size();
+    h.nStrings = strings.size();
+    h.stringBytes = stringBytes(strings);
+    h.nFiles = files.size();
+    h.fileBytes = stringBytes(files);
+    h.nDecls = decls.size();
+    h.nEqs = eqs.size();
+    h.nSymbols = symbols.size();
+    h.nImports = imports.size();
+    os.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+    putStrings(os, strings);
+    putStrings(os, files);
+    put(os, kind);
+    put(os, op);
+    put(os, subtreeEnd);
+    put(os, payload);
+    put(os, aux);
+    put(os, locFile);
+    put(os, locColumn);
+    put(os, locLine);
+    put(os, decls);
+    put(os, eqs);
+    put(os, syms);
+    put(os, imports);
+}
+
+// reads the arrays of the binary form, checking that they are not truncated
+class Reader {
+    private:
+        const char *pos;
+        const char *end;
+
+    public:
+        Reader(const char *buf, size_t len) : pos(buf), end(buf + len) { }
+
+        bool atEnd() const {
+            return pos == end;
+        }
+
+        template <typename T>
+        bool get(std::vector<T>& v, size_t n) {
+            if (n > (size_t) (end - pos) / sizeof(T))
+                return false;
+            v.resize(n);
+            // the data of an empty vector may be NULL
+            if (n)
+                memcpy(v.data(), pos, n * sizeof(T));
+            pos += n * sizeof(T);
+            return true;
+        }
+
+        bool getStrings(std::vector<std::string>& strings, size_t n,
+                size_t bytes) {
+            std::vector<uint32_t> offsets;
+            if (!get(offsets, n + 1) || bytes > (size_t) (end - pos) ||
+                    offsets[0] != 0 || offsets[n] != bytes)
+                return false;
+            strings.resize(n);
+            for (size_t i=0; i<n; i++) {
+                if (offsets[i+1] < offsets[i] || offsets[i+1] > bytes)
+                    return false;
+                strings[i].assign(pos + offsets[i], offsets[i+1] - offsets[i]);
+            }
+            pos += bytes;
+            return true;
+        }
+};
+
+FlatIR::FlatIR(const char *buf, size_t len, const std::string& name) {
+    Header h;
+    if (!isBinary(buf, len) || len < sizeof(h)) {
+        logger::err << "`" << name << "' is not a precompiled model\n";
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&h, buf, sizeof(h));
+    if (h.version != version || h.byteOrder != byteOrder) {
+        logger::err << "`" << name << "' was precompiled by another " <<
+            "version or on another machine, it must be precompiled again\n";
+        exit(EXIT_FAILURE);
+    }
+
+    Reader r(buf + sizeof(h), len - sizeof(h));
+    std::vector<std::string> files;
+    std::vector<uint16_t> locFile;
+    std::vector<uint16_t> locColumn;
+    std::vector<uint32_t> locLine;
+    std::vector<int32_t> syms;
+    bool read = r.getStrings(strings, h.nStrings, h.stringBytes) &&
+        r.getStrings(files, h.nFiles, h.fileBytes) && h.nFiles > 0 &&
+        r.get(kind, h.nNodes) && r.get(op, h.nNodes) &&
+        r.get(subtreeEnd, h.nNodes) && link() && r.get(payload, h.nNodes) &&
+        r.get(aux, h.nNodes) && r.get(locFile, h.nNodes) &&
+        r.get(locColumn, h.nNodes) && r.get(locLine, h.nNodes) &&
+        r.get(decls, h.nDecls) && r.get(eqs, h.nEqs) &&
+        r.get(syms, (size_t) h.nSymbols * symbolFields) &&
+        r.get(imports, h.nImports) && r.atEnd();
+
+    if (read) {
+        filename = files[0];
+        std::vector<uint16_t> fileIds(1, 0);
+        for (size_t i=1; i<files.size(); i++)
+            fileIds.push_back(SrcLoc::internFile(files[i]));
+        srcLoc.reserve(h.nNodes);
+        for (size_t n=0; n<h.nNodes && read; n++) {
+            read = locFile[n] < fileIds.size();
+            if (read)
+                srcLoc.push_back(SrcLoc(fileIds[locFile[n]], locLine[n],
+                            locColumn[n]));
+        }
+        for (size_t i=0; i<h.nSymbols; i++) {
+            const int32_t *f = &syms[i * symbolFields];
+            Symbol s = {f[0], f[1], f[2], f[3], f[4] != 0, f[5]};
+            symbols.push_back(s);
+        }
+    }
+    if (!read || !isValid()) {
+        logger::err << "`" << name << "' is not a valid precompiled model\n";
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i=0; i<strings.size(); i++)
+        stringIds[strings[i]] = i;
+}
+
+bool FlatIR::link() {
+    // in preorder, the parent of a node is the closest node before it whose
+    // subtree is not over
+    Index nNodes = size();
+    firstChild.assign(nNodes, none);
+    nextSibling.assign(nNodes, none);
+    std::vector<Index> parents;
+    std::vector<Index> lastChild(nNodes, none);
+    for (Index n=0; n<nNodes; n++) {
+        if (subtreeEnd[n] <= n || subtreeEnd[n] > nNodes)
+            return false;
+        while (!parents.empty() && subtreeEnd[parents.back()] <= n)
+            parents.pop_back();
+        if (!parents.empty()) {
+            Index p = parents.back();
+            if (subtreeEnd[n] > subtreeEnd[p])
+                return false;
+            if (lastChild[p] == none)
+                firstChild[p] = n;
+            else
+                nextSibling[lastChild[p]] = n;
+            lastChild[p] = n;
+        }
+        parents.push_back(n);
+    }
+    return true;
+}
+
+// number of children of the nodes of a kind, -1 if it varies
+static int arity(NodeKind k) {
+    switch (k) {
+        case BINARY:
+        case INDEX_RANGE:
+        case DIFF:
+        case DECLARATION:
+        case BOUNDARY_COND:
+            return 2;
+        case UNARY:
+            return 1;
+        case VECTOR:
+            return 3;
+        case IDENTIFIER:
+        case INT_VALUE:
+        case FLOAT_VALUE:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// checks what toNode relies on: the nodes of every subtree are contiguous
+// and in preorder, and every node has the children its kind expects
+bool FlatIR::isValid() const {
+    Index nNodes = size();
+    int32_t nStrings = strings.size();
+    auto isString = [&](int32_t s) {
+        return s >= 0 && s < nStrings;
+    };
+    auto isExpr = [&](Index n) {
+        return n >= 0 && n < nNodes && kind[n] <= VECTOR;
+    };
+    for (Index n=0; n<nNodes; n++) {
+        if (kind[n] > BOUNDARY_COND)
+            return false;
+        NodeKind k = (NodeKind) kind[n];
+        int nChildren = 0;
+        Index end = n + 1;
+        for (Index c = firstChild[n]; c != none; c = nextSibling[c]) {
+            // the first child follows its parent, the others follow the
+            // subtree of their previous sibling
+            if (c != end || c >= nNodes || subtreeEnd[c] <= c ||
+                    subtreeEnd[c] > nNodes)
+                return false;
+            bool ok;
+            switch (k) {
+                case DIFF:
+                    ok = nChildren == 0 ? isExpr(c) :
+                        kind[c] == IDENTIFIER || kind[c] == FUNC_CALL ||
+                        kind[c] == ARRAY;
+                    break;
+                case EQUATION:
+                    ok = nChildren < 2 ? isExpr(c) : kind[c] == BOUNDARY_COND;
+                    break;
+                case BOUNDARY_COND:
+                    ok = kind[c] == EQUATION;
+                    break;
+                default:
+                    ok = isExpr(c);
+                    break;
+            }
+            if (!ok)
+                return false;
+            end = subtreeEnd[c];
+            nChildren++;
+        }
+        // the backends read the first operand of sums and products
+        if (subtreeEnd[n] != end ||
+                (arity(k) >= 0 && nChildren != arity(k)) ||
+                ((k == SUM || k == PRODUCT) && nChildren < 2) ||
+                (k == EQUATION && nChildren < 2))
+            return false;
+        switch (k) {
+            case DIFF:
+            case IDENTIFIER:
+            case FUNC_CALL:
+            case ARRAY:
+            case EQUATION:
+                if (!isString(payload[n]))
+                    return false;
+                break;
+            default:
+                break;
+        }
+    }
+    for (auto d: decls)
+        if (d < 0 || d >= nNodes || kind[d] != DECLARATION)
+            return false;
+    for (auto e: eqs)
+        if (e < 0 || e >= nNodes || kind[e] != EQUATION)
+            return false;
+    for (auto& s: symbols)
+        if (s.type < PARAM_SYMBOL || s.type > SCALAR_SYMBOL ||
+                !isString(s.name) || !isString(s.paramType) ||
+                (s.def != none && !isExpr(s.def)))
+            return false;
+    for (auto m: imports)
+        if (!isString(m))
+            return false;
+    return true;
+}
+
+} // end namespace ir
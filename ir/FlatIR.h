@@ -0,0 +1,152 @@
+#ifndef FLAT_IR_H
+#define FLAT_IR_H
+
+#include "config.h"
+#include "IR.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ir {
+
+///
+/// Flat (structure of arrays) representation of a program.
+///
+/// Nodes are stored in preorder in parallel arrays indexed by node number:
+/// the nodes of a subtree are contiguous, from the root of the subtree to
+/// `subtreeEnd' (excluded), so passes that only look at nodes kinds or
+/// payloads are linear scans of a few arrays.
+/// Names are interned: identifiers with the same name have the same
+/// payload.
+///
+/// Shared subexpressions of the pointer based IR are duplicated: a flat
+/// program is always a tree.
+///
+/// A flat program can be written in binary form (a precompiled model, see
+/// write): reading it back copies the arrays as they are, no text is
+/// scanned nor parsed.
+///
+class FlatIR {
+    public:
+        typedef int32_t Index;
+        static const Index none = -1;
+        /// version of the binary form (see write)
+        static const uint32_t version = 2;
+
+    private:
+        struct Symbol {
+            int32_t type;       // symbol class (SymbolKind)
+            int32_t name;
+            int32_t paramType;
+            int32_t info;       // vector component, array dimension or
+                                // number of function parameters
+            bool internal;
+            Index def;
+        };
+
+        std::vector<uint8_t> kind;
+        std::vector<char> op;
+        std::vector<Index> firstChild;
+        std::vector<Index> nextSibling;
+        std::vector<Index> subtreeEnd;
+        /// interned string (identifier, derivative order or equation name),
+        /// integer value or bits of the float value
+        std::vector<int32_t> payload;
+        /// vector component of identifiers, equation location of BCs
+        std::vector<int32_t> aux;
+        std::vector<SrcLoc> srcLoc;
+
+        std::vector<std::string> strings;
+        std::unordered_map<std::string, int32_t> stringIds;
+
+        std::string filename;
+        std::vector<Index> decls;
+        std::vector<Index> eqs;
+        std::vector<Symbol> symbols;
+        /// names of the modules imported by a module (see FrontEnd::import)
+        std::vector<int32_t> imports;
+
+        /// names of the strings, see toNode
+        mutable std::vector<Name> names;
+
+        /// sets the links to the children from the subtree ends, false if
+        /// they do not nest
+        bool link();
+        bool isValid() const;
+        Node *build(Index, const std::vector<Node *>& children) const;
+
+        Index newNode(NodeKind, char op, int32_t payload, int32_t aux,
+                SrcLoc srcLoc);
+        void addChild(Index parent, Index &last, Index child);
+        Index add(Node *, Index parent, Index& last);
+
+    public:
+        FlatIR();
+        /// flattens the declarations, equations and symbols of a program
+        FlatIR(Program *);
+        /// reads the binary form of a flat program from the len bytes at
+        /// buf, name is the file name reported if they do not hold one
+        FlatIR(const char *buf, size_t len, const std::string& name);
+
+        /// true if the len bytes at buf start like the binary form
+        static bool isBinary(const char *buf, size_t len);
+        /// writes the binary form, in the byte order of the machine
+        void write(std::ostream&) const;
+
+        /// returns the id of an interned string
+        int32_t intern(const std::string&);
+        const std::string& getString(int32_t) const;
+
+        /// appends a copy of a tree and returns its root
+        Index add(Node *);
+        /// builds the pointer based tree rooted at the given node
+        Node *toNode(Index) const;
+        /// builds a program (owning an arena holding its nodes), without
+        /// its equations if withEqs is false
+        Program *toProgram(bool withEqs = true) const;
+        /// adds the symbols to a symbol table, their definitions are built in
+        /// the current arena
+        void addSymbols(SymTab&) const;
+
+        size_t size() const;
+        size_t getBytesUsed() const;
+
+        inline NodeKind getKind(Index n) const {
+            return (NodeKind) kind[n];
+        }
+        inline char getOp(Index n) const {
+            return op[n];
+        }
+        inline Index getFirstChild(Index n) const {
+            return firstChild[n];
+        }
+        inline Index getNextSibling(Index n) const {
+            return nextSibling[n];
+        }
+        inline Index getSubtreeEnd(Index n) const {
+            return subtreeEnd[n];
+        }
+        Index getChild(Index n, int i) const;
+        const std::string& getName(Index n) const;
+        int getIntValue(Index n) const;
+        float getFloatValue(Index n) const;
+        SrcLoc getSrcLoc(Index n) const;
+
+        const std::vector<Index>& getDecls() const;
+        const std::vector<Index>& getEqs() const;
+        void setEq(size_t i, Index eq);
+        /// the names of the imported modules are interned strings
+        const std::vector<int32_t>& getImports() const;
+        void addImport(const std::string& module);
+
+        /// identifiers (including function calls and arrays) of the subtree
+        /// in preorder, see ::getIds
+        std::vector<Index> getIds(Index root, bool uniq = true) const;
+};
+
+} // end namespace ir
+
+#endif // FLAT_IR_H
@@ -2,60 +2,231 @@
 #define IR_H
 
 #include "config.h"
+#include "Arena.h"
+#include "ChildArray.h"
+#include "ExprPool.h"
+#include "Name.h"
+#include "SrcLoc.h"
 #include "SymTab.h"
 #include "Printer.h"
 
+#include <atomic>
+#include <cstdint>
 #include <list>
 #include <vector>
 #include <string>
-#include <typeinfo>
 #include <iostream>
+#include <unordered_map>
 
 namespace ir {
 
+///
+/// Concrete type of a node: dispatching on it (with `switch' or
+/// isa/dyn_cast) avoids RTTI.
+/// Scalar expressions come first, then vectors and then the non expression
+/// nodes, so that each class hierarchy maps to a range of kinds.
+///
+typedef enum {
+    BINARY,
+    INDEX_RANGE,
+    SUM,
+    PRODUCT,
+    UNARY,
+    DIFF,
+    IDENTIFIER,
+    FUNC_CALL,
+    ARRAY,
+    INT_VALUE,
+    FLOAT_VALUE,
+    VECTOR,
+    DECLARATION,
+    EQUATION,
+    BOUNDARY_COND
+} NodeKind;
+
+///
+/// What a name refers to (see Program::resolveNames).
+/// The symbol classes come first, in the order of their class hierarchy.
+///
+typedef enum {
+    PARAM_SYMBOL,
+    VARIABLE_SYMBOL,
+    ARRAY_SYMBOL,
+    FUNCTION_SYMBOL,
+    FIELD_SYMBOL,
+    SCALAR_SYMBOL,
+    /// not a symbol: the name of an equation (as in `leq(eq)')
+    EQUATION_NAME,
+    UNDEFINED_NAME,
+    /// the name has not been resolved yet
+    UNRESOLVED_NAME
+} SymbolKind;
+
+///
+/// Attributes of an expression (see Expr::hasAttr): they are inferred
+/// bottom-up the first time one of them is queried, cached in every node of
+/// the subtree, and dropped when the subtree is modified (see
+/// Node::invalidate).
+///
+typedef enum {
+    /// the attributes are computed
+    ATTR_COMPUTED = 1 << 0,
+    /// the expression is a vector
+    ATTR_VECTOR = 1 << 1,
+    /// refers to a field: depends on the radius (and on theta in 2D)
+    ATTR_FIELD = 1 << 2,
+    /// refers to `l'
+    ATTR_L = 1 << 3,
+    /// has an l' term
+    ATTR_LL = 1 << 4,
+    /// refers to `fp'
+    ATTR_FP = 1 << 5,
+    /// refers to a name not resolved yet: ATTR_FIELD may be missing
+    ATTR_UNRESOLVED = 1 << 6
+} ExprAttr;
+
+/// fp degree of an expression that is not a monomial in fp
+/// (see Expr::getFpDegree)
+static const int NOT_FP_MONOMIAL = -32768;
+
+class Node;
+
+/// set of replacements (node -> new node), see Node::replace
+typedef std::unordered_map<Node *, Node *> Replacements;
+
 ///
 /// Base class to represent program's AST
 ///
 class Node : public DOT {
+    friend class ExprPool;
+    friend class FlatIR;
+
     private:
-        static int nNode;
+        /// number of live nodes (in all threads)
+        static std::atomic<int> nNode;
 
     protected:
         Node *parent;
-        std::vector<Node *> children;
+        ChildArray children;
+        const NodeKind kind;
         bool clearOnDelete;
+        /// the node is interned in an ExprPool (and owned by it)
+        bool shared;
+        /// cached structural hash (0: not computed yet)
+        mutable size_t hash;
+
+        size_t computeHash() const;
+        /// appends a child (the node becomes its parent)
+        void addChild(Node *);
+        bool replaceDescendants(const Replacements&);
 
     public:
-        Node(Node *par = NULL);
+        Node(NodeKind kind, Node *par = NULL);
         virtual ~Node();
+
+        inline NodeKind getKind() const {
+            return kind;
+        }
+        static inline bool classof(const Node *) {
+            return true;
+        }
+
+        /// nodes are allocated in the current Arena (if any)
+        static void *operator new(size_t);
+        static void operator delete(void *);
+
         Node *getParent() const;
         virtual void dump(std::ostream&) const;
         virtual void dumpDOT(std::ostream&,
                 std::string title="", bool root = true) const;
-        std::vector<Node *>& getChildren();
-        std::string srcLoc;
-        void setSourceLocation(std::string);
+        ChildArray& getChildren();
+        SrcLoc srcLoc;
+        void setSourceLocation(const SrcLoc&);
         void clear();
+        /// the node deletes its children when it is deleted
+        void setClearOnDelete(bool);
         static int getNodeNumber();
+        /// recomputes the parent of every node of the subtree
         void setParents();
         void setParent(ir::Node *);
 
+        /// replaces the child c with n (in time proportional to the number
+        /// of children), returns false if c is not a child of the node
+        bool replace(Node *c, Node *n);
+        /// applies a set of replacements to the descendants of the node in
+        /// one traversal (replacement nodes are not traversed)
+        void replace(const Replacements&);
+
         bool contains(ir::Node&);
+        bool isShared() const;
+
+        /// structural hash of the subtree: nodes that compare equal have the
+        /// same hash. It is computed on first use and cached.
+        size_t getHash() const;
+        /// must be called when the node (or one of its descendants) is
+        /// modified in place: drops the cached hash and attributes of the
+        /// node and of its ancestors
+        void invalidate();
 
         virtual bool operator==(ir::Node&) = 0;
         virtual bool operator!=(ir::Node&);
 };
 
+/// returns true if the node is of class T (or derived from T)
+template <class T>
+inline bool isa(const Node *n) {
+    return n && T::classof(n);
+}
+
+/// returns the node as a T (NULL if it is not of class T)
+template <class T>
+inline T *dyn_cast(Node *n) {
+    return isa<T>(n) ? static_cast<T *>(n) : NULL;
+}
+
+template <class T>
+inline const T *dyn_cast(const Node *n) {
+    return isa<T>(n) ? static_cast<const T *>(n) : NULL;
+}
+
 class BinExpr;
+class Sum;
+class Product;
 class Expr : public Node {
+    friend class Node;
+
     public:
-        Expr(Node *p = NULL);
-        Expr(int priority, Node *p = NULL);
+        Expr(NodeKind kind, Node *p = NULL);
+        Expr(NodeKind kind, int priority, Node *p = NULL);
         virtual ~Expr();
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() <= VECTOR;
+        }
+
         const int priority;
 
+    private:
+        /// cached attributes (ExprAttr flags, 0: not computed yet)
+        mutable uint8_t attrs;
+        mutable int16_t fpDegree;
+        mutable const NameSet *names;
+
+        void computeAttributes() const;
+
+    public:
         Expr *copy() const;
+
+        /// the attributes are computed once for the whole subtree, then
+        /// each query takes constant time
+        bool hasAttr(ExprAttr) const;
+        /// degree of the expression as a monomial in fp (as `fp^2*r*u'):
+        /// the terms of a sum must have the same degree, the divisor of a
+        /// quotient must not depend on fp, and the exponent of a power must
+        /// be an integer. NOT_FP_MONOMIAL otherwise
+        int getFpDegree() const;
+        /// names the expression refers to (variables, fields, functions...)
+        const NameSet& getNames() const;
 };
 
 class VectExpr;
@@ -65,12 +236,16 @@ class ScalarExpr : public Expr {
         VectExpr op(const VectExpr&, char) const;
 
     public:
-        ScalarExpr(Node *p = NULL);
-        ScalarExpr(int priority, Node *p = NULL);
+        ScalarExpr(NodeKind kind, Node *p = NULL);
+        ScalarExpr(NodeKind kind, int priority, Node *p = NULL);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() < VECTOR;
+        }
 
-        BinExpr operator+(const ScalarExpr&) const;
-        BinExpr operator-(const ScalarExpr&) const;
-        BinExpr operator*(const ScalarExpr&) const;
+        Sum operator+(const ScalarExpr&) const;
+        Sum operator-(const ScalarExpr&) const;
+        Product operator*(const ScalarExpr&) const;
         BinExpr operator/(const ScalarExpr&) const;
         BinExpr operator^(const ScalarExpr&) const;
 
@@ -91,6 +266,10 @@ class VectExpr : public Expr {
         VectExpr(const ScalarExpr&, const ScalarExpr&, const ScalarExpr&);
         VectExpr(const VectExpr&);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == VECTOR;
+        }
+
         ScalarExpr *getX() const;
         ScalarExpr *getY() const;
         ScalarExpr *getZ() const;
@@ -111,14 +290,26 @@ class VectExpr : public Expr {
         VectExpr operator^(const ScalarExpr&) const;
 };
 
+/// kind of the Value<T> nodes
+template <class T> struct ValueKind;
+template <> struct ValueKind<int> {
+    static const NodeKind kind = INT_VALUE;
+};
+template <> struct ValueKind<float> {
+    static const NodeKind kind = FLOAT_VALUE;
+};
+
 template <class T>
 class Value : public ScalarExpr {
     T value;
     public:
-        inline Value(T val, Node *p = NULL) {
+        inline Value(T val, Node *p = NULL) : ScalarExpr(ValueKind<T>::kind, p) {
             value = val;
         }
         inline Value(const Value<T>& v) : Value<T>(v.getValue()) { }
+        static inline bool classof(const Node *n) {
+            return n->getKind() == ValueKind<T>::kind;
+        }
         inline T getValue() const {
             return value;
         }
@@ -126,13 +317,11 @@ class Value : public ScalarExpr {
             os << "Val: " << value;
         }
         inline bool operator==(Node& node) {
-            try {
-                Value& v = dynamic_cast<Value<T>&>(node);
-                return value == v.value;
-            }
-            catch (std::bad_cast) {
-                return false;
-            }
+            if (this == &node)
+                return true;
+            if (auto v = dyn_cast<Value<T> >(&node))
+                return value == v->value;
+            return false;
         }
         inline Value<T> operator=(T v) {
             return Value(v);
@@ -143,11 +332,18 @@ class BinExpr : public ScalarExpr {
     protected:
         char op;
 
+        BinExpr(NodeKind kind, ScalarExpr *lOp, char op, ScalarExpr *rOp,
+                Node *parent = NULL);
+
     public:
         BinExpr(ScalarExpr *lOp, char op, ScalarExpr *rOp, Node *parent = NULL);
         BinExpr(const ScalarExpr& lOp, char op, const ScalarExpr& rOp, Node *parent = NULL);
         BinExpr(const BinExpr&);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == BINARY || n->getKind() == INDEX_RANGE;
+        }
+
         ScalarExpr *getRightOp() const;
         ScalarExpr *getLeftOp() const;
         char getOp() const;
@@ -155,6 +351,68 @@ class BinExpr : public ScalarExpr {
         bool operator==(Node&);
 };
 
+///
+/// Operation with any number of scalar operands: Sum or Product.
+/// Operations of the same kind are flattened when an operand is added, so
+/// `a + (b + c)' and `(a + b) + c' are the same node.
+/// Operands commute: the structural hash and equality do not depend on their
+/// order (so shared sums or products are compared structurally).
+///
+class NaryExpr : public ScalarExpr {
+    protected:
+        NaryExpr(NodeKind kind, Node *parent = NULL);
+
+    public:
+        static inline bool classof(const Node *n) {
+            return n->getKind() == SUM || n->getKind() == PRODUCT;
+        }
+
+        /// `+' or `*'
+        char getOp() const;
+        int getNOperands() const;
+        ScalarExpr *getOperand(int) const;
+        /// adopts the operand (the operands of a Sum added to a Sum, or of
+        /// a Product added to a Product, are adopted instead)
+        void addOperand(ScalarExpr *);
+        virtual void dump(std::ostream&) const;
+        bool operator==(Node&);
+};
+
+///
+/// Sum of its operands, kept in source order: the backends number the terms
+/// of equations in this order. Subtracted operands are negated with a `-'
+/// UnaryExpr.
+///
+class Sum : public NaryExpr {
+    public:
+        Sum(Node *parent = NULL);
+        Sum(ScalarExpr *lOp, ScalarExpr *rOp, Node *parent = NULL);
+        Sum(const ScalarExpr& lOp, const ScalarExpr& rOp, Node *parent = NULL);
+        Sum(const Sum&);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == SUM;
+        }
+};
+
+///
+/// Product of its operands, kept in canonical order (see ir::compare):
+/// numbers first, then negated factors, identifiers sorted by name and
+/// compound expressions.
+///
+class Product : public NaryExpr {
+    public:
+        Product(Node *parent = NULL);
+        Product(ScalarExpr *lOp, ScalarExpr *rOp, Node *parent = NULL);
+        Product(const ScalarExpr& lOp, const ScalarExpr& rOp,
+                Node *parent = NULL);
+        Product(const Product&);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == PRODUCT;
+        }
+};
+
 class UnaryExpr : public ScalarExpr {
     protected:
         char op;
@@ -164,6 +422,10 @@ class UnaryExpr : public ScalarExpr {
         UnaryExpr(const ScalarExpr& lOp, char op, Node *parent = NULL);
         UnaryExpr(const UnaryExpr&);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == UNARY;
+        }
+
         ScalarExpr *getExpr() const;
         char getOp() const;
         virtual void dump(std::ostream&) const;
@@ -181,6 +443,10 @@ class DiffExpr : public ScalarExpr {
         DiffExpr(const Expr&, const Identifier&, std::string order = std::string("1"),
                 Node *p = NULL);
         DiffExpr(const DiffExpr&);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == DIFF;
+        }
         Expr *getExpr() const;
         Identifier *getVar() const;
         void setOrder(std::string);
@@ -194,24 +460,53 @@ class ExprLst : public std::vector<Expr *> {
 
 class Identifier : public ScalarExpr {
     protected:
+        Identifier(NodeKind kind, Name n, int vectComponent = 0,
+                Node *parent = NULL);
 
     public:
-        Identifier(std::string n, int vectComponent = 0, Node *parent = NULL);
+        Identifier(Name n, int vectComponent = 0, Node *parent = NULL);
         Identifier(const Identifier&);
 
-        const std::string name;
+        static inline bool classof(const Node *n) {
+            return n->getKind() == IDENTIFIER ||
+                n->getKind() == FUNC_CALL ||
+                n->getKind() == ARRAY;
+        }
+
+        const Name name;
         virtual void dump(std::ostream& os) const;
         bool operator==(Node&);
         const int vectComponent;
+
+        /// binds the name (see Program::resolveNames): index is the index
+        /// of the variable or of the equation (starting at 1), 0 otherwise
+        void bind(Symbol *, SymbolKind, int index = 0);
+        bool isResolved() const;
+        /// NULL if the name is not a symbol of the program
+        Symbol *getSymbol() const;
+        SymbolKind getSymbolKind() const;
+        int getIndex() const;
+
+    protected:
+        Symbol *symbol;
+        SymbolKind symbolKind;
+        int index;
 };
 
 class FuncCall : public Identifier {
     public:
-        FuncCall(std::string name, ExprLst *args = NULL, Node *p = NULL);
-        FuncCall(std::string name, Expr *arg, Node *p = NULL);
-        FuncCall(std::string name, const Expr& arg, Node *p = NULL);
+        /// copies the arguments
+        FuncCall(Name name, ExprLst *args = NULL, Node *p = NULL);
+        /// adopts the arguments
+        FuncCall(Name name, ExprLst&& args, Node *p = NULL);
+        FuncCall(Name name, Expr *arg, Node *p = NULL);
+        FuncCall(Name name, const Expr& arg, Node *p = NULL);
         FuncCall(const FuncCall&);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == FUNC_CALL;
+        }
+
         virtual void dump(std::ostream& os) const;
         ExprLst getArgs() const;
         bool operator==(Node&);
@@ -219,11 +514,15 @@ class FuncCall : public Identifier {
 
 class ArrayExpr : public Identifier {
     public:
-        ArrayExpr(std::string name, ExprLst *indices, Node *p = NULL);
-        ArrayExpr(std::string name, ScalarExpr *index, Node *p = NULL);
-        ArrayExpr(std::string name, ScalarExpr& index, Node *p = NULL);
+        ArrayExpr(Name name, ExprLst *indices, Node *p = NULL);
+        ArrayExpr(Name name, ScalarExpr *index, Node *p = NULL);
+        ArrayExpr(Name name, ScalarExpr& index, Node *p = NULL);
         ArrayExpr(const ArrayExpr&);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == ARRAY;
+        }
+
         ExprLst getIndices() const;
         bool operator==(Node&);
 };
@@ -235,6 +534,10 @@ class Decl : public Node {
     public:
         Decl(Expr *, Expr *);
 
+        static inline bool classof(const Node *n) {
+            return n->getKind() == DECLARATION;
+        }
+
         Expr *getLHS() const;
         Expr *getDef() const;
         virtual void dump(std::ostream& os) const;
@@ -245,19 +548,31 @@ class DeclLst : public std::list<Decl *> { };
 
 class BCLst;
 class Equation : public Node {
+    friend class Node;
+    private:
+        unsigned generation;
+
     public:
-        Equation(std::string name, Expr *lhs, Expr *rhs, BCLst *bc, Node *p = NULL);
-        Equation(std::string name, const Expr& lhs, const Expr& rhs,
+        Equation(Name name, Expr *lhs, Expr *rhs, BCLst *bc, Node *p = NULL);
+        Equation(Name name, const Expr& lhs, const Expr& rhs,
                 BCLst *bc, Node *p = NULL);
-        Equation(std::string name, Equation &eq);
+        Equation(Name name, Equation &eq);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == EQUATION;
+        }
 
-        const std::string name;
+        const Name name;
         virtual void dump(std::ostream& os) const;
         Expr *getLHS() const;
         Expr *getRHS() const;
-        BCLst *getBCs() const;
+        BCLst getBCs() const;
         bool operator==(Node&);
         void setBCs(ir::BCLst *);
+        /// number of modifications of the equation (or of its nodes) seen
+        /// by Node::invalidate: they are only counted once the hash of the
+        /// equation is computed
+        unsigned getGeneration() const;
 };
 
 class EqLst : public std::list<Equation *> { };
@@ -269,6 +584,10 @@ class BC : public Node {
 
     public:
         BC(Equation *cond, Equation *loc, Node *p = NULL);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == BOUNDARY_COND;
+        }
         virtual void dump(std::ostream& os) const;
         bool operator==(Node&);
         Equation *getLoc() const;
@@ -285,6 +604,12 @@ class Program : public DOT {
         SymTab *symTab;
         DeclLst *decls;
         EqLst *eqs;
+        Arena *arena;
+        ExprPool *exprPool;
+        /// indices of the variables and equations (computed by
+        /// resolveNames)
+        std::unordered_map<Name, int> varIndex;
+        std::unordered_map<Name, int> eqIndex;
 
     public:
         Program(std::string, SymTab *, DeclLst *decls, EqLst *eqs);
@@ -295,7 +620,35 @@ class Program : public DOT {
         EqLst& getEqs();
         DeclLst& getDecls();
 
-        void replace(Node *, Node *);
+        /// the program takes ownership of the arena holding its nodes
+        void setArena(Arena *);
+        Arena *getArena() const;
+        /// the program takes ownership of the pool of its shared expressions
+        void setExprPool(ExprPool *);
+        ExprPool *getExprPool() const;
+
+        /// replaces n0 with n1: n0 is spliced out of its parent, unless it
+        /// is shared (every occurrence of a shared node is replaced)
+        void replace(Node *n0, Node *n1);
+        /// applies a set of replacements to the equations and BCs in one
+        /// traversal
+        void replace(const Replacements&);
+
+        /// binds every identifier of the declarations and equations to its
+        /// symbol (and its variable or equation index). Identifiers built
+        /// afterwards are bound on demand with resolve.
+        void resolveNames();
+        /// binds the identifiers of a subtree
+        void resolveNames(Node *);
+        /// binds an identifier, returns its kind
+        SymbolKind resolve(Identifier *);
+
+        /// adds an equation parsed after the program was built (see
+        /// FrontEnd::stream): it is numbered after the equations added
+        /// before, even those removed since
+        void addEquation(Equation *);
+        /// removes an equation from the program, without deleting it
+        void removeEquation(Equation *);
 
         const std::string filename;
 };
@@ -304,6 +657,10 @@ class IndexRange : public BinExpr {
     public:
         IndexRange(ScalarExpr *lb, ScalarExpr *ub, Node *p = NULL);
         IndexRange(const IndexRange&);
+
+        static inline bool classof(const Node *n) {
+            return n->getKind() == INDEX_RANGE;
+        }
         ScalarExpr *getLB() const;
         ScalarExpr *getUB() const;
 };
@@ -315,25 +672,34 @@ class Symbol {
     protected:
         Expr *expr;
         bool internal;
+        const SymbolKind kind;
+
+        Symbol(SymbolKind kind, Name name, Expr *def = NULL,
+                bool internal = false);
     public:
-        Symbol(std::string name, Expr *def = NULL, bool internal = false);
-        ~Symbol();
-        const std::string name;
+        virtual ~Symbol();
+        const Name name;
         virtual Expr *getDef();
         bool isInternal();
+        SymbolKind getKind() const;
+        /// variables and arrays
+        bool isVariable() const;
 };
 
 class Param : public Symbol {
     protected:
         std::string type;
     public:
-        Param(std::string n, std::string t, Expr *def = NULL);
+        Param(Name n, std::string t, Expr *def = NULL);
         std::string getType();
 };
 
 class Variable : public Symbol {
+    protected:
+        Variable(SymbolKind kind, Name n, int vc, Expr *def,
+                bool internal);
     public:
-        Variable(std::string n, int vc = 0, Expr *def = NULL, bool internal = false);
+        Variable(Name n, int vc = 0, Expr *def = NULL, bool internal = false);
         const int vectComponent;
 };
 
@@ -341,28 +707,30 @@ class Array : public Variable {
     protected:
         int ndim;
     public:
-        Array(std::string n, int ndim, Expr *def = NULL, bool internal = false);
+        Array(Name n, int ndim, Expr *def = NULL, bool internal = false);
+        int getNDim() const;
 };
 
 class Function : public Symbol {
     protected:
         int nparams;
     public:
-        Function(std::string n, int nparams);
+        Function(Name n, int nparams);
+        int getNParams() const;
 };
 
 class Field : public Symbol {
     public:
-        Field(std::string n);
+        Field(Name n);
 };
 
 class Scalar : public Symbol {
     public:
-        Scalar(std::string n);
+        Scalar(Name n);
 };
 
 VectExpr crossProduct(const Expr&, const Expr&);
-BinExpr dotProduct(const Expr&, const Expr&);
+Sum dotProduct(const Expr&, const Expr&);
 
 UnaryExpr operator-(ScalarExpr&);
 VectExpr operator-(VectExpr&);
@@ -380,6 +748,13 @@ Expr& operator*(const Expr&, const Expr&);
 Expr& operator/(const Expr&, const Expr&);
 Expr& operator^(const Expr&, const Expr&);
 
+/// Ownership taking versions of the operators above: the operands are
+/// adopted by the new expression (they must not be used or deleted by the
+/// caller afterwards), so no node is copied except for a scalar operand
+/// distributed over the components of a vector.
+Expr *binOp(Expr *lOp, char op, Expr *rOp);
+Expr *negate(Expr *);
+
 ScalarExpr *scalar(Expr *);
 VectExpr *vector(Expr *);
 ScalarExpr& scalar(Expr&);
@@ -388,6 +763,10 @@ VectExpr& vector(Expr&);
 bool isScalar(Expr *);
 bool isVect(Expr *);
 
+/// total order on expressions (negative, 0 or positive as for strcmp):
+/// used to sort the factors of products
+int compare(Node *, Node *);
+
 FuncCall sin(const ScalarExpr&);
 FuncCall cos(const ScalarExpr&);
 
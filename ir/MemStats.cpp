@@ -0,0 +1,58 @@
+#include "MemStats.h"
+#include "IR.h"
+
+#include <cassert>
+#include <iomanip>
+
+namespace ir {
+
+MemUsage MemUsage::current() {
+    MemUsage u;
+    u.nodes = Node::getNodeNumber();
+    u.bytes = Arena::getLiveNodeBytes();
+    return u;
+}
+
+MemStats::MemStats() : running(false) { }
+
+void MemStats::begin(const std::string& phase) {
+    if (running)
+        end();
+    Phase p;
+    p.name = phase;
+    p.start = MemUsage::current();
+    p.end = p.start;
+    phases.push_back(p);
+    running = true;
+}
+
+void MemStats::end() {
+    assert(running);
+    phases.back().end = MemUsage::current();
+    running = false;
+}
+
+const std::vector<MemStats::Phase>& MemStats::getPhases() const {
+    return phases;
+}
+
+void MemStats::report(std::ostream& os) const {
+    for (auto& p: phases) {
+        os << std::left << std::setw(16) << p.name << std::right <<
+            std::setw(10) << p.end.nodes << " nodes (" <<
+            std::showpos << p.end.nodes - p.start.nodes << std::noshowpos <<
+            "), " << p.end.bytes << " bytes (" <<
+            std::showpos << p.end.bytes - p.start.bytes << std::noshowpos <<
+            ")\n";
+    }
+}
+
+MemStats::Scope::Scope(MemStats& s, const std::string& phase) : stats(s) {
+    stats.begin(phase);
+}
+
+MemStats::Scope::~Scope() {
+    stats.end();
+}
+
+} // end namespace ir
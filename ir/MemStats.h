@@ -0,0 +1,67 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include "config.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ir {
+
+///
+/// Nodes alive at a given time (in every arena and on the heap) and the
+/// bytes they use.
+///
+struct MemUsage {
+    long nodes;
+    long bytes;
+
+    static MemUsage current();
+};
+
+///
+/// Per-phase accounting of the live nodes.
+///
+/// The usage is recorded when a phase begins and when it ends, so the
+/// nodes a phase leaves behind (those it builds for the next phases, or
+/// leaks) are attributed to it.
+///
+class MemStats {
+    public:
+        struct Phase {
+            std::string name;
+            MemUsage start;
+            MemUsage end;
+        };
+
+    private:
+        std::vector<Phase> phases;
+        bool running;
+
+    public:
+        MemStats();
+
+        void begin(const std::string& phase);
+        void end();
+
+        const std::vector<Phase>& getPhases() const;
+        /// one line per phase: live nodes and bytes at the end of the
+        /// phase, and their variation during the phase
+        void report(std::ostream&) const;
+
+        ///
+        /// Accounts for a phase for the lifetime of the object
+        ///
+        class Scope {
+            private:
+                MemStats& stats;
+            public:
+                Scope(MemStats&, const std::string& phase);
+                ~Scope();
+        };
+};
+
+} // end namespace ir
+
+#endif // MEM_STATS_H
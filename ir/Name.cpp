@@ -0,0 +1,176 @@
+#include "Name.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ir {
+
+// characters of a name, possibly in the scanner's input buffer: a name is
+// looked up without being copied, it is only copied the first time it is
+// interned
+struct Slice {
+    const char *str;
+    size_t len;
+};
+
+struct SliceHash {
+    size_t operator()(const Slice& s) const {
+        // FNV-1a
+        size_t h = 14695981039346656037ULL;
+        for (size_t i=0; i<s.len; i++) {
+            h ^= static_cast<unsigned char>(s.str[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+struct SliceEq {
+    bool operator()(const Slice& a, const Slice& b) const {
+        return a.len == b.len && memcmp(a.str, b.str, a.len) == 0;
+    }
+};
+
+// the keys point to the characters of the interned strings, which are never
+// modified nor freed
+typedef std::unordered_map<Slice, Name::Handle, SliceHash, SliceEq> Table;
+
+// names are interned by concurrent parses: the table is split in shards
+// with their own lock, so that parsing threads seldom wait for each other
+struct Shard {
+    std::mutex mutex;
+    Table table;
+};
+
+static const size_t nShards = 16;
+
+static Shard *shards() {
+    static Shard *s = new Shard[nShards];
+    return s;
+}
+
+static Name::Handle emptyName() {
+    static Name::Handle e = Name::intern("", 0);
+    return e;
+}
+
+Name::Name() : s(emptyName()) { }
+
+Name::Name(Handle h) : s(h) { }
+
+Name::Name(const std::string& str) : s(intern(str)) { }
+
+Name::Name(const char *str) : s(intern(str, std::char_traits<char>::length(str))) { }
+
+Name::Handle Name::intern(const std::string& str) {
+    return intern(str.data(), str.size());
+}
+
+Name::Handle Name::intern(const char *str, size_t len) {
+    Slice key = {str, len};
+    size_t h = SliceHash()(key);
+    Shard& shard = shards()[h % nShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Table::iterator it = shard.table.find(key);
+    if (it != shard.table.end())
+        return it->second;
+    std::string *s = new std::string(str, len);
+    Slice stored = {s->data(), s->size()};
+    shard.table.insert(std::make_pair(stored, s));
+    return s;
+}
+
+size_t Name::getInternedNumber() {
+    size_t n = 0;
+    for (size_t i=0; i<nShards; i++) {
+        std::lock_guard<std::mutex> lock(shards()[i].mutex);
+        n += shards()[i].table.size();
+    }
+    return n;
+}
+
+static bool byHandle(const Name& a, const Name& b) {
+    return std::less<Name::Handle>()(a.handle(), b.handle());
+}
+
+struct NameSetHash {
+    size_t operator()(const NameSet *s) const {
+        size_t h = s->size();
+        for (auto n: *s)
+            h = h * 31 + std::hash<Name>()(n);
+        return h;
+    }
+};
+
+struct NameSetEq {
+    bool operator()(const NameSet *a, const NameSet *b) const {
+        return a->size() == b->size() &&
+            std::equal(a->begin(), a->end(), b->begin());
+    }
+};
+
+static std::mutex& nameSetMutex() {
+    static std::mutex *m = new std::mutex;
+    return *m;
+}
+
+typedef std::unordered_set<const NameSet *, NameSetHash, NameSetEq>
+    NameSetTable;
+
+static NameSetTable& nameSets() {
+    static NameSetTable *t = new NameSetTable;
+    return *t;
+}
+
+NameSet::NameSet(std::vector<Name>&& n) : names(std::move(n)) { }
+
+const NameSet *NameSet::intern(std::vector<Name>&& n) {
+    NameSet key(std::move(n));
+    std::lock_guard<std::mutex> lock(nameSetMutex());
+    auto it = nameSets().find(&key);
+    if (it != nameSets().end())
+        return *it;
+    NameSet *s = new NameSet(std::move(key.names));
+    nameSets().insert(s);
+    return s;
+}
+
+const NameSet *NameSet::empty() {
+    static const NameSet *e = intern(std::vector<Name>());
+    return e;
+}
+
+const NameSet *NameSet::get(const Name& n) {
+    return intern(std::vector<Name>(1, n));
+}
+
+const NameSet *NameSet::merge(const NameSet *a, const NameSet *b) {
+    if (a == b || b->size() == 0)
+        return a;
+    if (a->size() == 0)
+        return b;
+    std::vector<Name> u;
+    u.reserve(a->size() + b->size());
+    std::set_union(a->begin(), a->end(), b->begin(), b->end(),
+            std::back_inserter(u), byHandle);
+    if (u.size() == a->size())
+        return a;
+    if (u.size() == b->size())
+        return b;
+    return intern(std::move(u));
+}
+
+size_t NameSet::getInternedNumber() {
+    std::lock_guard<std::mutex> lock(nameSetMutex());
+    return nameSets().size();
+}
+
+bool NameSet::contains(const Name& n) const {
+    return std::binary_search(names.begin(), names.end(), n, byHandle);
+}
+
+} // end namespace ir
@@ -0,0 +1,177 @@
+#ifndef NAME_H
+#define NAME_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ir {
+
+///
+/// Interned name (of an identifier, a symbol...).
+///
+/// Every name is stored once, in a process-wide table, and a Name is a
+/// pointer to this unique copy: copying a name does not allocate, and two
+/// names are equal if and only if they point to the same string.
+/// Interning is thread safe.
+///
+class Name {
+    public:
+        /// stable pointer to an interned string (what the scanner passes to
+        /// the parser)
+        typedef const std::string *Handle;
+
+    private:
+        Handle s;
+
+    public:
+        /// the empty name
+        Name();
+        Name(Handle);
+        Name(const std::string&);
+        Name(const char *);
+
+        /// returns the unique copy of a string (the table is never emptied):
+        /// the characters are only copied the first time they are interned
+        static Handle intern(const char *, size_t);
+        static Handle intern(const std::string&);
+        /// number of distinct names interned so far
+        static size_t getInternedNumber();
+
+        inline Handle handle() const {
+            return s;
+        }
+        inline const std::string& str() const {
+            return *s;
+        }
+        inline operator const std::string&() const {
+            return *s;
+        }
+        inline const char *c_str() const {
+            return s->c_str();
+        }
+        inline size_t size() const {
+            return s->size();
+        }
+        inline bool empty() const {
+            return s->empty();
+        }
+
+        inline bool operator==(const Name& n) const {
+            return s == n.s;
+        }
+        inline bool operator!=(const Name& n) const {
+            return s != n.s;
+        }
+        /// comparisons with plain strings compare the characters
+        inline bool operator==(const std::string& str) const {
+            return *s == str;
+        }
+        inline bool operator!=(const std::string& str) const {
+            return *s != str;
+        }
+        inline bool operator==(const char *str) const {
+            return *s == str;
+        }
+        inline bool operator!=(const char *str) const {
+            return *s != str;
+        }
+        /// alphabetical order (to sort names)
+        inline bool operator<(const Name& n) const {
+            return s != n.s && *s < *n.s;
+        }
+};
+
+inline bool operator==(const std::string& a, const Name& b) {
+    return b == a;
+}
+
+inline bool operator!=(const std::string& a, const Name& b) {
+    return b != a;
+}
+
+inline bool operator==(const char *a, const Name& b) {
+    return b == a;
+}
+
+inline bool operator!=(const char *a, const Name& b) {
+    return b != a;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Name& n) {
+    return os << n.str();
+}
+
+inline std::string operator+(const std::string& a, const Name& b) {
+    return a + b.str();
+}
+
+inline std::string operator+(const Name& a, const std::string& b) {
+    return a.str() + b;
+}
+
+inline std::string operator+(const char *a, const Name& b) {
+    return a + b.str();
+}
+
+inline std::string operator+(const Name& a, const char *b) {
+    return a.str() + b;
+}
+
+///
+/// Interned set of names.
+///
+/// Every distinct set is stored once, in a process-wide table (never
+/// emptied), so a set is handled through a pointer: two sets are equal if
+/// and only if they are the same object. The names are sorted by handle,
+/// not alphabetically. Interning is thread safe.
+///
+class NameSet {
+    private:
+        std::vector<Name> names;
+
+        explicit NameSet(std::vector<Name>&&);
+        static const NameSet *intern(std::vector<Name>&&);
+
+    public:
+        typedef std::vector<Name>::const_iterator const_iterator;
+
+        /// the empty set
+        static const NameSet *empty();
+        /// the set of one name
+        static const NameSet *get(const Name&);
+        /// union of two sets
+        static const NameSet *merge(const NameSet *, const NameSet *);
+        /// number of distinct sets interned so far
+        static size_t getInternedNumber();
+
+        bool contains(const Name&) const;
+        inline size_t size() const {
+            return names.size();
+        }
+        inline const_iterator begin() const {
+            return names.begin();
+        }
+        inline const_iterator end() const {
+            return names.end();
+        }
+};
+
+} // end namespace ir
+
+namespace std {
+
+template<>
+struct hash<ir::Name> {
+    inline size_t operator()(const ir::Name& n) const {
+        return std::hash<const std::string *>()(n.handle());
+    }
+};
+
+} // end namespace std
+
+#endif // NAME_H
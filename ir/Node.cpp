@@ -4,9 +4,9 @@
 #include "Printer.h"
 
 #include <functional>
-#include <typeinfo>
 #include <cassert>
 #include <algorithm>
+#include <unordered_set>
 
 namespace ir {
 
@@ -15,7 +15,7 @@ bool Node::operator!=(Node& n) {
 }
 
 bool Node::contains(ir::Node& node) {
-    if (*this == node) {
+    if (this->getHash() == node.getHash() && *this == node) {
         return true;
     }
     for (auto c: this->getChildren()) {
@@ -32,40 +32,185 @@ void Program::replace(Node *n0, Node *n1) {
     assert(n0);
     assert(n1);
 
-    std::function<void (ir::Node *)> replaceNode = [n0, n1, &replaceNode] (ir::Node *n) {
-        assert(n);
-        for (auto c: n->getChildren()) {
-            assert(c);
-            replaceNode(c);
-            c->setParent(n);
-        }
-        std::replace(n->getChildren().begin(), n->getChildren().end(), n0, n1);
-    };
+    // the parent of a shared node is one of its parents: all of them are
+    // found by a traversal of the program
+    if (!n0->isShared() && n0->getParent() &&
+            n0->getParent()->replace(n0, n1))
+        return;
+
+    Replacements r;
+    r[n0] = n1;
+    replace(r);
+}
 
+void Program::replace(const Replacements& r) {
+    // BCs are children of their equation
     for (auto e: this->getEqs()) {
-        replaceNode(e);
-        for (auto bc: *e->getBCs()) {
-            replaceNode(bc);
-        }
+        e->replace(r);
     }
-    for (auto e: this->getEqs()) {
-        e->setParents();
-        for (auto bc: *e->getBCs()) {
-            bc->setParents();
+}
+
+static void resolveSubtree(Program *p, Node *n,
+        std::unordered_set<Node *>& sharedDone) {
+    // shared subtrees are bound once
+    if (n->isShared() && !sharedDone.insert(n).second)
+        return;
+    if (auto id = dyn_cast<Identifier>(n))
+        p->resolve(id);
+    for (auto c: n->getChildren())
+        resolveSubtree(p, c, sharedDone);
+}
+
+void Program::resolveNames() {
+    varIndex.clear();
+    eqIndex.clear();
+    // same numbering as the code generators: declaration order, starting
+    // at 1
+    int i = 1;
+    for (auto s: *symTab) {
+        if (s->isVariable())
+            varIndex[s->name] = i++;
+    }
+    i = 1;
+    for (auto e: *eqs) {
+        eqIndex[e->name] = i++;
+    }
+
+    std::unordered_set<Node *> sharedDone;
+    for (auto d: *decls)
+        resolveSubtree(this, d, sharedDone);
+    for (auto e: *eqs)
+        resolveSubtree(this, e, sharedDone);
+}
+
+void Program::resolveNames(Node *n) {
+    std::unordered_set<Node *> sharedDone;
+    resolveSubtree(this, n, sharedDone);
+}
+
+void Program::addEquation(Equation *e) {
+    int index = eqIndex.size() + 1;
+    eqIndex[e->name] = index;
+    eqs->push_back(e);
+}
+
+void Program::removeEquation(Equation *e) {
+    eqs->remove(e);
+}
+
+SymbolKind Program::resolve(Identifier *id) {
+    assert(id);
+    if (Symbol *s = symTab->search(id->name)) {
+        int index = 0;
+        if (s->isVariable()) {
+            auto it = varIndex.find(s->name);
+            if (it != varIndex.end())
+                index = it->second;
         }
+        id->bind(s, s->getKind(), index);
+    }
+    else {
+        auto it = eqIndex.find(id->name);
+        if (it != eqIndex.end())
+            id->bind(NULL, EQUATION_NAME, it->second);
+        else
+            id->bind(NULL, UNDEFINED_NAME);
     }
+    return id->getSymbolKind();
 }
 
-int Node::nNode = 0;
+std::atomic<int> Node::nNode(0);
 
 int Node::getNodeNumber() {
     return Node::nNode;
 }
 
-Node::Node(Node *p) : children(), srcLoc("unknown") {
+Node::Node(NodeKind kind, Node *p) : children(), kind(kind), srcLoc() {
     nNode++;
     parent = p;
     clearOnDelete = false;
+    shared = false;
+    hash = 0;
+}
+
+bool Node::isShared() const {
+    return shared;
+}
+
+static size_t combine(size_t seed, size_t h) {
+    return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+size_t Node::computeHash() const {
+    size_t h = std::hash<int>()(kind);
+    switch (kind) {
+        case BINARY:
+        case INDEX_RANGE:
+            // BinExpr::operator== accepts both kinds
+            h = combine(std::hash<int>()(BINARY),
+                    static_cast<const BinExpr *>(this)->getOp());
+            break;
+        case SUM:
+        case PRODUCT: {
+            // operands commute: their hashes are combined in an order
+            // independent way
+            size_t sum = 0;
+            for (auto c: children) {
+                sum += combine(0, c->getHash());
+            }
+            h = combine(h, sum);
+            return h ? h : 1;
+        }
+        case UNARY:
+            h = combine(h, static_cast<const UnaryExpr *>(this)->getOp());
+            break;
+        case DIFF:
+            h = combine(h, std::hash<std::string>()(
+                        static_cast<const DiffExpr *>(this)->getOrder()));
+            break;
+        case IDENTIFIER:
+        case FUNC_CALL:
+        case ARRAY:
+            h = combine(h, std::hash<Name>()(
+                        static_cast<const Identifier *>(this)->name));
+            break;
+        case INT_VALUE:
+            h = combine(h, std::hash<int>()(
+                        static_cast<const Value<int> *>(this)->getValue()));
+            break;
+        case FLOAT_VALUE:
+            h = combine(h, std::hash<float>()(
+                        static_cast<const Value<float> *>(this)->getValue()));
+            break;
+        default:
+            break;
+    }
+    for (auto c: children) {
+        h = combine(h, c->getHash());
+    }
+    // 0 means "not computed"
+    return h ? h : 1;
+}
+
+size_t Node::getHash() const {
+    if (hash == 0)
+        hash = computeHash();
+    return hash;
+}
+
+void Node::invalidate() {
+    // the hash and the attributes are computed bottom-up: the ancestors of
+    // a node that has neither have none either
+    for (Node *n = this; n; n = n->parent) {
+        Expr *e = dyn_cast<Expr>(n);
+        if (n->hash == 0 && (e == NULL || e->attrs == 0))
+            break;
+        n->hash = 0;
+        if (e)
+            e->attrs = 0;
+        else if (Equation *eq = dyn_cast<Equation>(n))
+            eq->generation++;
+    }
 }
 
 Node *Node::getParent() const {
@@ -77,7 +222,66 @@ void Node::dump(std::ostream& os) const {
 }
 
 void Node::setParent(ir::Node *p) {
-    this->parent = this;
+    this->parent = p;
+}
+
+void Node::addChild(Node *c) {
+    assert(c);
+    children.push_back(c);
+    c->parent = this;
+}
+
+bool Node::replace(Node *c, Node *n) {
+    assert(c && n);
+    bool found = false;
+    for (auto& child: children) {
+        if (child == c) {
+            child = n;
+            found = true;
+        }
+    }
+    if (found) {
+        n->parent = this;
+        invalidate();
+    }
+    return found;
+}
+
+// returns true if a descendant was replaced: the hashes and attributes of the
+// modified nodes are dropped on the way up
+bool Node::replaceDescendants(const Replacements& r) {
+    bool modified = false;
+    for (auto& c: children) {
+        auto it = r.find(c);
+        if (it != r.end()) {
+            c = it->second;
+            c->parent = this;
+            modified = true;
+        }
+        else if (c->replaceDescendants(r)) {
+            modified = true;
+            // the child was adopted by another node (or is shared): the
+            // caches of that node are dropped as well
+            if (c->parent && c->parent != this)
+                c->parent->invalidate();
+        }
+    }
+    if (modified) {
+        hash = 0;
+        if (Expr *e = dyn_cast<Expr>(this))
+            e->attrs = 0;
+        else if (Equation *eq = dyn_cast<Equation>(this))
+            eq->generation++;
+    }
+    return modified;
+}
+
+void Node::replace(const Replacements& r) {
+    if (r.empty())
+        return;
+    // the cache of the node itself is already dropped
+    if (replaceDescendants(r) && parent)
+        parent->invalidate();
 }
 
 void Node::setParents() {
@@ -111,12 +315,19 @@ void Node::dumpDOT(std::ostream& os, std::string title, bool root) const {
     }
 }
 
-std::vector<Node *>& Node::getChildren() {
+ChildArray& Node::getChildren() {
     return children;
 }
 
+void Node::setSourceLocation(const SrcLoc& loc) {
+    srcLoc = loc;
+}
+
 void Node::clear() {
     for(auto c: children) {
+        // shared nodes belong to their ExprPool
+        if (c->isShared())
+            continue;
         c->clear();
         // if (this->clearOnDelete)
         delete c;
@@ -124,38 +335,78 @@ void Node::clear() {
     children.clear();
 }
 
+void Node::setClearOnDelete(bool c) {
+    clearOnDelete = c;
+}
+
 Node::~Node() {
-    if (clearOnDelete) {
+    if (clearOnDelete && !Arena::isReleasing()) {
         this->clear();
     }
     nNode--;
 }
 
+void *Node::operator new(size_t size) {
+    return Arena::allocateNode(size);
+}
+
+void Node::operator delete(void *ptr) {
+    Arena::deallocateNode(ptr);
+}
+
 Program::Program(std::string filename, SymTab *symTab, DeclLst *decls, EqLst *eqs) :
 filename(filename) {
     this->symTab = symTab;
     this->decls = decls;
     this->eqs = eqs;
+    this->arena = NULL;
+    this->exprPool = NULL;
 }
 
 Program::~Program() {
-    for (auto d: *decls) {
-        d->clear();
-        delete d;
+    if (arena) {
+        // symbols can refer to definitions living in the arena: delete them
+        // first, then all nodes are destroyed in bulk with the arena
+        delete symTab;
+        delete exprPool;
+        delete arena;
     }
-    for (auto e: *eqs) {
-        e->clear();
-        delete e;
+    else {
+        for (auto d: *decls) {
+            d->clear();
+            delete d;
+        }
+        for (auto e: *eqs) {
+            e->clear();
+            delete e;
+        }
+        delete symTab;
+        delete exprPool;
     }
-    delete symTab;
     delete decls;
     delete eqs;
 }
 
+void Program::setArena(Arena *a) {
+    this->arena = a;
+}
+
+Arena *Program::getArena() const {
+    return arena;
+}
+
+void Program::setExprPool(ExprPool *pool) {
+    this->exprPool = pool;
+}
+
+ExprPool *Program::getExprPool() const {
+    return exprPool;
+}
+
 void Program::buildSymTab() {
     // First add definitions
     for (auto d: *decls) {
-        if (ir::Identifier *id = dynamic_cast<ir::Identifier *>(d->getLHS())) {
+        if (ir::Identifier *id = dyn_cast<ir::Identifier>(d->getLHS())) {
             ir::Variable *var = new ir::Variable(id->name, id->vectComponent,
                     d->getDef());
             symTab->add(var);
@@ -167,13 +418,12 @@ void Program::buildSymTab() {
 
     // Look for undefined symbols
     for (auto e:*eqs) {
-        Analysis<ir::Identifier> a = Analysis<ir::Identifier>();
         auto checkDefined = [this] (ir::Identifier *s) -> void {
             std::string name = s->name;
             if (this->symTab->search(name) == NULL)
                 logger::err << "undefined symbol: `" << name << "'\n";
         };
-        a.run(checkDefined, e);
+        forEach<ir::Identifier>(e, checkDefined);
     }
 }
 
@@ -216,9 +466,9 @@ DeclLst& Program::getDecls() {
     return *decls;
 }
 
-Decl::Decl(Expr *lhs, Expr *rhs) {
-    children.push_back(lhs);
-    children.push_back(rhs);
+Decl::Decl(Expr *lhs, Expr *rhs) : Node(DECLARATION) {
+    addChild(lhs);
+    addChild(rhs);
 }
 
 void Decl::dump(std::ostream& os) const {
@@ -231,25 +481,26 @@ bool Decl::operator==(Node& n) {
 }
 
 Expr *Decl::getLHS() const {
-    assert(dynamic_cast<Expr *>(children[0]));
-    return dynamic_cast<Expr *>(children[0]);
+    assert(isa<Expr>(children[0]));
+    return static_cast<Expr *>(children[0]);
 }
 
 Expr *Decl::getDef() const {
-    assert(dynamic_cast<Expr *>(children[1]));
-    return dynamic_cast<Expr *>(children[1]);
+    assert(isa<Expr>(children[1]));
+    return static_cast<Expr *>(children[1]);
 }
 
-Equation::Equation(std::string name,
-        Expr *lhs, Expr *rhs, BCLst *bcs, Node *p) : Node(p), name(name) {
+Equation::Equation(Name name,
+        Expr *lhs, Expr *rhs, BCLst *bcs, Node *p) :
+    Node(EQUATION, p), generation(0), name(name) {
     assert(lhs && rhs);
     if ((isScalar(lhs) && isScalar(rhs)) ||
             (isVect(lhs) && isVect(rhs))) {
-        children.push_back(lhs);
-        children.push_back(rhs);
+        addChild(lhs);
+        addChild(rhs);
         if (bcs) {
             for (auto bc:*bcs) {
-                children.push_back(bc);
+                addChild(bc);
             }
         }
     }
@@ -262,22 +513,27 @@ Equation::Equation(std::string name,
     }
 }
 
-Equation::Equation(std::string name, const Expr& lhs, const Expr& rhs,
+Equation::Equation(Name name, const Expr& lhs, const Expr& rhs,
         BCLst *bcs, Node *p) : Equation(name, lhs.copy(), rhs.copy(), bcs, p) {
 }
 
-Equation::Equation(std::string name, Equation &eq) :
-    Node(eq.getParent()), name(name) {
-        children.push_back(eq.getLHS());
-        children.push_back(eq.getRHS());
-        for (auto bc: *eq.getBCs())
-            children.push_back(bc);
+Equation::Equation(Name name, Equation &eq) :
+    Node(EQUATION, eq.getParent()), generation(0), name(name) {
+        addChild(eq.getLHS());
+        addChild(eq.getRHS());
+        for (auto bc: eq.getBCs())
+            addChild(bc);
     }
 
 void Equation::setBCs(ir::BCLst *bcs) {
     for (auto b: *bcs) {
-        children.push_back(b);
+        addChild(b);
     }
+    invalidate();
+}
+
+unsigned Equation::getGeneration() const {
+    return generation;
 }
 
 void Equation::dump(std::ostream& os) const {
@@ -285,11 +541,11 @@ void Equation::dump(std::ostream& os) const {
 }
 
 Expr *Equation::getLHS() const {
-    return dynamic_cast<Expr *>(children[0]);
+    return dyn_cast<Expr>(children[0]);
 }
 
 Expr *Equation::getRHS() const {
-    return dynamic_cast<Expr *>(children[1]);
+    return dyn_cast<Expr>(children[1]);
 }
 
 bool Equation::operator==(Node& n) {
@@ -297,21 +553,20 @@ bool Equation::operator==(Node& n) {
     return false;
 }
 
-BCLst *Equation::getBCs() const {
-    BCLst *bcs = new BCLst();
-    int n = 0;
+BCLst Equation::getBCs() const {
+    BCLst bcs;
     for (auto c: children) {
-        if (auto bc = dynamic_cast<ir::BC *>(c)) {
-            bcs->push_back(bc);
-            n ++;
+        if (auto bc = dyn_cast<ir::BC>(c)) {
+            bcs.push_back(bc);
         }
     }
     return bcs;
 }
 
-BC::BC(Equation *cond, Equation *loc, Node *p) : Node(p) {
-    children.push_back(cond);
-    children.push_back(loc);
+BC::BC(Equation *cond, Equation *loc, Node *p) : Node(BOUNDARY_COND, p) {
+    eqLoc = -1;
+    addChild(cond);
+    addChild(loc);
 }
 
 void BC::dump(std::ostream& os) const {
@@ -319,11 +574,11 @@ void BC::dump(std::ostream& os) const {
 }
 
 Equation *BC::getLoc() const {
-    return dynamic_cast<Equation *>(children[1]);
+    return dyn_cast<Equation>(children[1]);
 }
 
 Equation *BC::getCond() const {
-    return dynamic_cast<Equation *>(children[0]);
+    return dyn_cast<Equation>(children[0]);
 }
 
 void BC::setEqLoc(int loc) {
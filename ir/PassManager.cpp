@@ -0,0 +1,73 @@
+#include "PassManager.h"
+
+#include <chrono>
+#include <iomanip>
+
+namespace ir {
+
+static double now() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PassManager::Stats::Stats(const std::string& name) :
+    name(name), runs(0), hits(0), seconds(0) { }
+
+PassManager::Timer::Timer(Stats& s) : stats(s), start(now()) { }
+
+PassManager::Timer::~Timer() {
+    stats.runs++;
+    stats.seconds += now() - start;
+}
+
+PassManager::PassManager() { }
+
+void PassManager::addProgramPass(const std::string& name, ProgramPass p) {
+    programPasses.push_back(std::make_pair(stats.size(), p));
+    stats.push_back(Stats(name));
+}
+
+void PassManager::addEquationPass(const std::string& name, EquationPass p) {
+    equationPasses.push_back(std::make_pair(stats.size(), p));
+    stats.push_back(Stats(name));
+}
+
+void PassManager::run(Program *prog) {
+    for (auto& p: programPasses) {
+        Timer timer(stats[p.first]);
+        p.second(prog);
+    }
+    // a pass may add or remove equations: the list is read for each pass
+    for (auto& p: equationPasses) {
+        Timer timer(stats[p.first]);
+        std::vector<Equation *> eqs(prog->getEqs().begin(),
+                prog->getEqs().end());
+        for (auto e: eqs)
+            p.second(e);
+    }
+}
+
+void PassManager::run(Equation *e) {
+    for (auto& p: equationPasses) {
+        Timer timer(stats[p.first]);
+        p.second(e);
+    }
+}
+
+void PassManager::forget(Equation *e) {
+    for (auto& a: analyses)
+        a.cache.erase(e);
+}
+
+void PassManager::report(std::ostream& os) const {
+    for (auto& s: stats) {
+        os << std::left << std::setw(16) << s.name << std::right <<
+            std::fixed << std::setprecision(3) << std::setw(10) <<
+            s.seconds * 1000 << " ms, " << s.runs << " runs";
+        if (s.hits)
+            os << ", " << s.hits << " cached";
+        os << "\n";
+    }
+}
+
+} // end namespace ir
@@ -0,0 +1,157 @@
+#ifndef PASS_MANAGER_H
+#define PASS_MANAGER_H
+
+#include "config.h"
+#include "IR.h"
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ir {
+
+///
+/// Runs the passes of a compilation, and caches the analyses of the
+/// equations.
+///
+/// Program passes run once on the whole program, equation passes on each
+/// equation: run(Program *) runs the program passes, then each equation pass
+/// on all the equations before the next one; run(Equation *) runs the
+/// equation passes on a single equation (when the equations are streamed).
+///
+/// An analysis computes something about an equation, on demand. Its result
+/// is cached until the equation is modified: modifications of the IR go
+/// through Node::invalidate, which counts them in the generation of the
+/// equation (see Equation::getGeneration), so only the equations that
+/// changed are analyzed again.
+///
+/// The time spent in each pass and analysis is accumulated (see report).
+///
+class PassManager {
+    public:
+        typedef std::function<void (Program *)> ProgramPass;
+        typedef std::function<void (Equation *)> EquationPass;
+
+        /// handle of a registered analysis, whose result is an R
+        template<class R>
+        class AnalysisId {
+            friend class PassManager;
+            private:
+                size_t index;
+            public:
+                AnalysisId() : index(0) { }
+        };
+
+    private:
+        struct Stats {
+            std::string name;
+            /// number of runs (of computations for an analysis), and of
+            /// results found in the cache
+            int runs;
+            int hits;
+            double seconds;
+
+            Stats(const std::string& name);
+        };
+
+        ///
+        /// Accounts for the time spent in a pass or an analysis for the
+        /// lifetime of the object
+        ///
+        class Timer {
+            private:
+                Stats& stats;
+                double start;
+            public:
+                Timer(Stats&);
+                ~Timer();
+        };
+
+        /// result of an analysis, whatever its type
+        struct Result {
+            virtual ~Result() { }
+        };
+        template<class R>
+        struct Holder : public Result {
+            R value;
+            Holder(R&& v) : value(std::move(v)) { }
+        };
+        struct Cached {
+            unsigned generation;
+            std::unique_ptr<Result> result;
+        };
+        struct Analysis {
+            size_t stats;
+            std::function<Result *(Equation *)> compute;
+            std::unordered_map<Equation *, Cached> cache;
+        };
+
+        std::vector<Stats> stats;
+        std::vector<std::pair<size_t, ProgramPass>> programPasses;
+        std::vector<std::pair<size_t, EquationPass>> equationPasses;
+        std::vector<Analysis> analyses;
+
+    public:
+        PassManager();
+
+        void addProgramPass(const std::string& name, ProgramPass);
+        void addEquationPass(const std::string& name, EquationPass);
+        template<class R>
+        AnalysisId<R> addAnalysis(const std::string& name,
+                std::function<R (Equation *)> compute) {
+            Analysis a;
+            a.stats = stats.size();
+            a.compute = [compute] (Equation *e) -> Result * {
+                return new Holder<R>(compute(e));
+            };
+            stats.push_back(Stats(name));
+            analyses.push_back(std::move(a));
+            AnalysisId<R> id;
+            id.index = analyses.size() - 1;
+            return id;
+        }
+
+        void run(Program *);
+        void run(Equation *);
+
+        /// result of an analysis of an equation, computed if the equation
+        /// was modified since it was cached (or if it is not cached). The
+        /// reference is only valid until the equation is modified: the next
+        /// get (of this analysis on this equation) replaces the result.
+        /// Anything that may bind an identifier or modify the IR must not
+        /// be called while the result (or a reference into it) is in use:
+        /// copy what is needed first
+        template<class R>
+        R& get(AnalysisId<R> id, Equation *e) {
+            Analysis& a = analyses[id.index];
+            Cached& c = a.cache[e];
+            if (c.result && c.generation == e->getGeneration()) {
+                stats[a.stats].hits++;
+                return static_cast<Holder<R> *>(c.result.get())->value;
+            }
+            {
+                Timer timer(stats[a.stats]);
+                c.result.reset(a.compute(e));
+                // the modifications of the equation are only counted once
+                // its hash is computed
+                e->getHash();
+            }
+            c.generation = e->getGeneration();
+            return static_cast<Holder<R> *>(c.result.get())->value;
+        }
+
+        /// drops the analyses of an equation (before it is deleted)
+        void forget(Equation *);
+
+        /// one line per pass and analysis: time spent, number of runs and
+        /// of cached results used (the time of an analysis is also counted
+        /// in the pass that needed it)
+        void report(std::ostream&) const;
+};
+
+} // end namespace ir
+
+#endif // PASS_MANAGER_H
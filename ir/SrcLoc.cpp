@@ -0,0 +1,87 @@
+#include "SrcLoc.h"
+#include "Printer.h"
+
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace ir {
+
+// file names, indexed by id - 1 (a deque does not move them when it grows)
+static std::deque<std::string>& files() {
+    static std::deque<std::string> names;
+    return names;
+}
+
+static std::unordered_map<std::string, uint16_t>& fileIds() {
+    static std::unordered_map<std::string, uint16_t> ids;
+    return ids;
+}
+
+// files are interned by concurrent parses
+static std::mutex filesMutex;
+
+SrcLoc::SrcLoc() : fileId(0), column(0), line(0) { }
+
+SrcLoc::SrcLoc(uint16_t fileId, uint32_t line, uint32_t column) :
+    fileId(fileId), column(column > UINT16_MAX ? UINT16_MAX : column),
+    line(line) { }
+
+uint16_t SrcLoc::internFile(const std::string& name) {
+    std::lock_guard<std::mutex> lock(filesMutex);
+    auto it = fileIds().find(name);
+    if (it != fileIds().end())
+        return it->second;
+    if (files().size() == UINT16_MAX) {
+        logger::err << "too many source files\n";
+        exit(EXIT_FAILURE);
+    }
+    files().push_back(name);
+    uint16_t id = files().size();
+    fileIds()[name] = id;
+    return id;
+}
+
+const std::string& SrcLoc::getFile(uint16_t fileId) {
+    static const std::string unknown = "unknown";
+    std::lock_guard<std::mutex> lock(filesMutex);
+    if (fileId == 0 || fileId > files().size())
+        return unknown;
+    return files()[fileId - 1];
+}
+
+bool SrcLoc::isKnown() const {
+    return fileId != 0;
+}
+
+uint16_t SrcLoc::getFileId() const {
+    return fileId;
+}
+
+uint32_t SrcLoc::getLine() const {
+    return line;
+}
+
+uint32_t SrcLoc::getColumn() const {
+    return column;
+}
+
+std::string SrcLoc::str() const {
+    if (!isKnown())
+        return "unknown";
+    std::string s = getFile(fileId) + ":" + std::to_string(line);
+    if (column)
+        s += ":" + std::to_string(column);
+    return s;
+}
+
+bool SrcLoc::operator==(const SrcLoc& loc) const {
+    return fileId == loc.fileId && line == loc.line && column == loc.column;
+}
+
+bool SrcLoc::operator!=(const SrcLoc& loc) const {
+    return !(*this == loc);
+}
+
+} // end namespace ir
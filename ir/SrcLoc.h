@@ -0,0 +1,46 @@
+#ifndef SRC_LOC_H
+#define SRC_LOC_H
+
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+
+namespace ir {
+
+///
+/// Packed source location of a node.
+///
+/// File names are interned in a global table (see SrcLoc::internFile): a
+/// location fits in 8 bytes and setting it does not allocate.
+///
+class SrcLoc {
+    private:
+        /// 0 means "unknown location"
+        uint16_t fileId;
+        uint16_t column;
+        uint32_t line;
+
+    public:
+        SrcLoc();
+        SrcLoc(uint16_t fileId, uint32_t line, uint32_t column = 0);
+
+        /// returns the id of a file name (ids are never 0)
+        static uint16_t internFile(const std::string&);
+        static const std::string& getFile(uint16_t fileId);
+
+        bool isKnown() const;
+        uint16_t getFileId() const;
+        uint32_t getLine() const;
+        uint32_t getColumn() const;
+
+        /// `file:line:column' (`unknown' if the location is not known)
+        std::string str() const;
+
+        bool operator==(const SrcLoc&) const;
+        bool operator!=(const SrcLoc&) const;
+};
+
+} // end namespace ir
+
+#endif // SRC_LOC_H
@@ -8,23 +8,26 @@
 SymTab::SymTab() { }
 
 SymTab::~SymTab() {
-    for (auto s: *this) {
+    for (auto s: symbols) {
         delete s;
     }
 }
 
-void SymTab::push_back(ir::Symbol *s) {
-    add(s);
-}
-
 void SymTab::add(ir::Symbol *s) {
     assert(s);
-    if (this->search(s->name) == NULL)
-        std::list<ir::Symbol *>::push_back(s);
+    auto it = index.find(s->name);
+    if (it == index.end()) {
+        index[s->name] = {s, getDepth()};
+    }
+    else if (it->second.depth < getDepth()) {
+        hidden.push_back(*it);
+        it->second = {s, getDepth()};
+    }
     else {
         logger::err << s->name << " already defined\n";
         exit(EXIT_FAILURE);
     }
+    symbols.push_back(s);
 }
 
 ir::Symbol *SymTab::search(ir::Identifier *id) const {
@@ -32,13 +35,52 @@ ir::Symbol *SymTab::search(ir::Identifier *id) const {
     return search(id->name);
 }
 
-ir::Symbol *SymTab::search(const std::string& id) const {
-    for (auto s:*this) {
-        if (s->name == id) {
-            return s;
-        }
+ir::Symbol *SymTab::search(const ir::Name& id) const {
+    auto it = index.find(id);
+    if (it == index.end())
+        return NULL;
+    return it->second.symbol;
+}
+
+void SymTab::pushScope() {
+    scopes.push_back(std::make_pair(symbols.size(), hidden.size()));
+}
+
+void SymTab::popScope() {
+    assert(!scopes.empty());
+    size_t firstSymbol = scopes.back().first;
+    size_t firstHidden = scopes.back().second;
+    scopes.pop_back();
+
+    for (size_t i=firstSymbol; i<symbols.size(); i++) {
+        index.erase(symbols[i]->name);
+        delete symbols[i];
+    }
+    symbols.resize(firstSymbol);
+    for (size_t i=firstHidden; i<hidden.size(); i++) {
+        index[hidden[i].first] = hidden[i].second;
     }
-    return NULL;
+    hidden.resize(firstHidden);
+}
+
+unsigned SymTab::getDepth() const {
+    return scopes.size();
+}
+
+SymTab::const_iterator SymTab::begin() const {
+    return symbols.begin();
+}
+
+SymTab::const_iterator SymTab::end() const {
+    return symbols.end();
+}
+
+size_t SymTab::size() const {
+    return symbols.size();
+}
+
+bool SymTab::empty() const {
+    return symbols.empty();
 }
 
 void SymTab::dumpDOT(std::ostream& os, std::string title, bool root) const {
@@ -89,3 +131,11 @@ void SymTab::dumpDOT(std::ostream& os, std::string title, bool root) const {
     }
     os << "}\n";
 }
+
+SymTab::Scope::Scope(SymTab& s) : symTab(s) {
+    symTab.pushScope();
+}
+
+SymTab::Scope::~Scope() {
+    symTab.popScope();
+}
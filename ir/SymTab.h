@@ -3,9 +3,13 @@
 
 #include "config.h"
 #include "DOT.h"
+#include "Name.h"
 
-#include <list>
 #include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace ir{
     class Symbol;
@@ -14,16 +18,70 @@ namespace ir{
 
 ///
 /// Symbol table
-//
-class SymTab : public std::list<ir::Symbol *>, public DOT {
+///
+/// Symbols are indexed by (interned) name in a hash table and iterated in declaration
+/// order (the order the code generators emit them in). The table owns its
+/// symbols.
+///
+/// Scopes can be nested (see SymTab::Scope): a symbol added in an inner
+/// scope hides the symbols of the same name of the outer scopes, and is
+/// deleted when the scope is closed.
+///
+class SymTab : public DOT {
+    public:
+        typedef std::vector<ir::Symbol *>::const_iterator const_iterator;
+
+    private:
+        struct Entry {
+            ir::Symbol *symbol;
+            /// depth of the scope the symbol was added in
+            unsigned depth;
+        };
+
+        /// symbols of every open scope, in declaration order
+        std::vector<ir::Symbol *> symbols;
+        std::unordered_map<ir::Name, Entry> index;
+        /// entries hidden by a symbol of an inner scope
+        std::vector<std::pair<ir::Name, Entry>> hidden;
+        /// for each open inner scope: where its symbols and hidden entries
+        /// start
+        std::vector<std::pair<size_t, size_t>> scopes;
+
     public:
         SymTab();
         ~SymTab();
-        void push_back(ir::Symbol *s);
+        SymTab(const SymTab&) = delete;
+        SymTab& operator=(const SymTab&) = delete;
+
+        /// adds a symbol to the current scope (exits if the name is already
+        /// defined in this scope)
         void add(ir::Symbol *s);
-        ir::Symbol *search(const std::string& id) const;
+        ir::Symbol *search(const ir::Name& id) const;
         ir::Symbol *search(ir::Identifier *) const;
+
+        void pushScope();
+        /// deletes the symbols of the current scope and restores the ones
+        /// they were hiding
+        void popScope();
+        unsigned getDepth() const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+        size_t size() const;
+        bool empty() const;
+
         void dumpDOT(std::ostream& os, std::string title="", bool root=true) const;
+
+        ///
+        /// Opens a scope for the lifetime of the object
+        ///
+        class Scope {
+            private:
+                SymTab& symTab;
+            public:
+                Scope(SymTab&);
+                ~Scope();
+        };
 };
 
 #endif // SYMTAB_H
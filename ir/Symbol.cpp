@@ -2,13 +2,14 @@
 
 namespace ir {
 
-Symbol::Symbol(std::string n, Expr *def, bool internal) : name(n) {
+Symbol::Symbol(SymbolKind kind, Name n, Expr *def, bool internal) :
+    kind(kind), name(n) {
     this->expr = def;
     this->internal = internal;
 }
 
 Symbol::~Symbol() {
-    if (expr)
+    if (expr && !expr->isShared())
         delete expr;
 }
 
@@ -20,7 +21,15 @@ bool Symbol::isInternal() {
     return internal;
 }
 
-Param::Param(std::string n, std::string t, Expr *def) : Symbol(n, def, internal) {
+SymbolKind Symbol::getKind() const {
+    return kind;
+}
+
+bool Symbol::isVariable() const {
+    return kind == VARIABLE_SYMBOL || kind == ARRAY_SYMBOL;
+}
+
+Param::Param(Name n, std::string t, Expr *def) : Symbol(PARAM_SYMBOL, n, def, false) {
     type = t;
 }
 
@@ -28,21 +37,32 @@ std::string Param::getType() {
     return type;
 }
 
-Variable::Variable(std::string n, int vc, Expr *def, bool internal) :
-    Symbol(n, def, internal), vectComponent(vc) { }
+Variable::Variable(SymbolKind kind, Name n, int vc, Expr *def,
+        bool internal) : Symbol(kind, n, def, internal), vectComponent(vc) { }
+
+Variable::Variable(Name n, int vc, Expr *def, bool internal) :
+    Variable(VARIABLE_SYMBOL, n, vc, def, internal) { }
 
-Array::Array(std::string n, int ndim, Expr *def, bool internal) :
-    Variable(n, 0, def, internal), ndim(ndim) { }
+Array::Array(Name n, int ndim, Expr *def, bool internal) :
+    Variable(ARRAY_SYMBOL, n, 0, def, internal), ndim(ndim) { }
 
-Function::Function(std::string name, int nparams) :
-    Symbol(name, NULL, true) { 
+int Array::getNDim() const {
+    return ndim;
+}
+
+Function::Function(Name name, int nparams) :
+    Symbol(FUNCTION_SYMBOL, name, NULL, true) {
         this->nparams = nparams;
 }
 
-Field::Field(std::string name) :
-    Symbol(name, NULL, false) {}
+int Function::getNParams() const {
+    return nparams;
+}
+
+Field::Field(Name name) :
+    Symbol(FIELD_SYMBOL, name, NULL, false) {}
 
-Scalar::Scalar(std::string name) :
-    Symbol(name, NULL, false) {}
+Scalar::Scalar(Name name) :
+    Symbol(SCALAR_SYMBOL, name, NULL, false) {}
 
 }
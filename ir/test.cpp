@@ -1,7 +1,11 @@
 #include "IR.h"
 #include "Coord.h"
+#include "FlatIR.h"
+#include "MemStats.h"
+#include "PassManager.h"
 
 #include <fstream>
+#include <sstream>
 
 int main() {
 
@@ -24,13 +28,13 @@ int main() {
             ir::VectExpr gradH = cartesian.grad(h);
             gradH.display("grad in cartesian coordinates");
 
-            ir::BinExpr divV = cartesian.div(v);
+            ir::Sum divV = cartesian.div(v);
             divV.display("div in cartesian coordinates");
 
             ir::VectExpr curlV = cartesian.curl(v);
             curlV.display("curl in cartesian coordinates");
 
-            ir::BinExpr lapH = cartesian.div(cartesian.grad(h));
+            ir::Sum lapH = cartesian.div(cartesian.grad(h));
             // ir::Equation poisson("poisson", lapH, ir::Value<float>(0), NULL);
         }
         std::cout << "remaining nodes (after cartesian coord): "
@@ -44,7 +48,7 @@ int main() {
             ir::VectExpr gradH = spherical.grad(h);
             gradH.display("grad in spherical coordinates");
 
-            ir::BinExpr divV = spherical.div(v);
+            ir::Sum divV = spherical.div(v);
             divV.display("div in spherical coordinates");
 
             ir::VectExpr curlV = spherical.curl(v);
@@ -54,6 +58,293 @@ int main() {
             << ir::Node::getNodeNumber() << "\n";
 #endif
 
+#if 1
+        {
+            ir::ExprPool pool;
+            ir::Value<int> one(1);
+
+            ir::Expr *e1 = pool.share((h*h + one).copy());
+            ir::Expr *e2 = pool.share((h*h + one).copy());
+            // nodes of different pools are compared structurally
+            ir::ExprPool other;
+            ir::Expr *e3 = other.share((h*h + one).copy());
+            std::cout << "hash-consing: " << pool.getSharedNumber() <<
+                " shared nodes, " << pool.getMergedNumber() <<
+                " merged nodes, same root: " << (e1 == e2) <<
+                ", equal in another pool: " << (*e1 == *e3) << "\n";
+        }
+        std::cout << "remaining nodes (after hash-consing): "
+            << ir::Node::getNodeNumber() << "\n";
+#endif
+
+#if 1
+        {
+            ir::FuncCall s = ir::sin(h);
+            ir::Expr *e = &s;
+            std::cout << "kinds: FuncCall isa Identifier: "
+                << ir::isa<ir::Identifier>(e) << ", isa BinExpr: "
+                << ir::isa<ir::BinExpr>(e) << ", isa VectExpr: "
+                << ir::isa<ir::VectExpr>(e) << ", scalar == vector: "
+                << (h == v) << "\n";
+        }
+#endif
+
+#if 1
+        {
+            ir::Sum e1 = h*h + Vx;
+            ir::Sum e2 = h*h + Vx;
+            ir::Sum e3 = h*h + Vy;
+            std::cout << "hash: same hash: " <<
+                (e1.getHash() == e2.getHash()) << ", equal: " << (e1 == e2) <<
+                ", different hash: " << (e1.getHash() != e3.getHash()) <<
+                ", contains Vx: " << e1.contains(Vx) << "\n";
+        }
+#endif
+
+#if 1
+        {
+            int n0 = ir::Node::getNodeNumber();
+            ir::Expr *sum = new ir::Identifier("a");
+            for (int i=0; i<100; i++)
+                sum = ir::binOp(sum, '+', new ir::Identifier("a"));
+            std::cout << "binOp: 100 additions, new nodes: " <<
+                ir::Node::getNodeNumber() - n0 << "\n";
+            delete sum;
+        }
+#endif
+
+#if 1
+        {
+            ir::Sum s1 = h*Vx*Vy + Vz + h;
+            ir::Sum s2 = h + Vz + Vy*(Vx*h);
+            ir::Product p1 = Vy*h*Vx;
+            std::cout << "n-ary: operands: " << s1.getNOperands() << ", " <<
+                p1.getNOperands() << ", commuted sums equal: " <<
+                (s1 == s2) << ", same hash: " <<
+                (s1.getHash() == s2.getHash()) << ", first factor: " <<
+                static_cast<ir::Identifier *>(p1.getOperand(0))->name;
+            // the pool does not merge the commuted sums: their parents are
+            // different nodes, equal all the same
+            ir::ExprPool pool;
+            ir::Value<int> two(2);
+            ir::Expr *q1 = pool.share(ir::BinExpr(s1, '^', two).copy());
+            ir::Expr *q2 = pool.share(ir::BinExpr(s2, '^', two).copy());
+            std::cout << ", shared powers: same node: " << (q1 == q2) <<
+                ", equal: " << (*q1 == *q2) << "\n";
+        }
+#endif
+
+#if 1
+        {
+            ir::Sum e = h*Vx - Vy + h*Vz;
+            ir::FlatIR flat;
+            ir::FlatIR::Index root = flat.add(&e);
+            ir::Node *n = flat.toNode(root);
+            std::cout << "flat: " << flat.size() << " nodes, ids: " <<
+                flat.getIds(root).size() << ", round trip: " <<
+                (*n == e) << "\n";
+            delete n;
+        }
+#endif
+
+#if 1
+        {
+            ir::Sum e = h*Vx - Vy + h*Vz;
+            e.srcLoc = ir::SrcLoc(ir::SrcLoc::internFile("test.edl"), 2, 5);
+            ir::FlatIR flat;
+            ir::FlatIR::Index root = flat.add(&e);
+            std::ostringstream os;
+            flat.write(os);
+            std::string bin = os.str();
+            ir::FlatIR loaded(bin.data(), bin.size(), "test.edlb");
+            ir::Node *n = loaded.toNode(root);
+            std::cout << "binary: " << bin.size() << " bytes, recognized: " <<
+                ir::FlatIR::isBinary(bin.data(), bin.size()) <<
+                ", round trip: " << (*n == e) << ", location: " <<
+                n->srcLoc.str() << "\n";
+            delete n;
+        }
+#endif
+
+#if 1
+        {
+            ir::Identifier *x = new ir::Identifier("x");
+            ir::UnaryExpr *d = new ir::UnaryExpr(x, '\'');
+            ir::Product *p = new ir::Product(new ir::Identifier("b"), d);
+            ir::Sum s(new ir::Identifier("a"), p);
+            s.setClearOnDelete(true);
+            size_t h = s.getHash();
+            ir::Identifier *c = new ir::Identifier("c");
+            bool spliced = d->getParent()->replace(d, c);
+            bool rehashed = s.getHash() != h;
+            delete d;
+            delete x;
+
+            ir::Replacements r;
+            ir::Node *a = s.getOperand(0);
+            r[a] = new ir::Identifier("y");
+            r[c] = new ir::Identifier("z");
+            s.replace(r);
+            delete a;
+            delete c;
+            ir::Identifier y("y"), b("b"), z("z");
+            ir::Sum e = y + b*z;
+            std::cout << "replace: spliced: " << spliced << ", rehashed: " <<
+                rehashed << ", batch: " << (s == e) <<
+                ", parent: " << (r[c]->getParent() == p) << "\n";
+        }
+#endif
+
+#if 1
+        {
+            // more operands than inline child slots
+            ir::Sum s = h + Vx + Vy + Vz + h*h;
+            s.srcLoc = ir::SrcLoc(ir::SrcLoc::internFile("test.edl"), 3, 7);
+            ir::Sum c(s);
+            std::cout << "layout: operands: " << s.getNOperands() <<
+                ", copy equal: " << (c == s) << ", location: " <<
+                s.srcLoc.str() << ", copy location: " << c.srcLoc.str() <<
+                "\n";
+        }
+#endif
+
+#if 1
+        {
+            ir::MemStats stats;
+            stats.begin("build");
+            ir::Sum *s = new ir::Sum(h*Vx + Vy + Vz*h);
+            stats.begin("release");
+            delete s;
+            stats.end();
+            auto& p = stats.getPhases();
+            std::cout << "memory: build: " <<
+                p[0].end.nodes - p[0].start.nodes << " nodes, bytes grew: " <<
+                (p[0].end.bytes > p[0].start.bytes) << ", release: " <<
+                p[1].end.nodes - p[1].start.nodes << " nodes\n";
+        }
+#endif
+
+#if 1
+        {
+            SymTab symTab;
+            symTab.add(new ir::Param("a", "double"));
+            symTab.add(new ir::Field("b"));
+            bool shadowed;
+            {
+                SymTab::Scope scope(symTab);
+                symTab.add(new ir::Variable("a"));
+                symTab.add(new ir::Scalar("c"));
+                shadowed = dynamic_cast<ir::Variable *>(symTab.search("a"));
+            }
+            std::cout << "symtab: shadowed: " << shadowed << ", restored: " <<
+                (dynamic_cast<ir::Param *>(symTab.search("a")) != NULL) <<
+                ", local removed: " << (symTab.search("c") == NULL) <<
+                ", order: ";
+            for (auto s: symTab)
+                std::cout << s->name;
+            std::cout << "\n";
+        }
+#endif
+
+#if 1
+        {
+            SymTab *symTab = new SymTab();
+            symTab->add(new ir::Field("r"));
+            symTab->add(new ir::Variable("u"));
+            symTab->add(new ir::Variable("v"));
+            ir::Identifier *r = new ir::Identifier("r");
+            ir::Identifier *v = new ir::Identifier("v");
+            ir::Identifier *w = new ir::Identifier("w");
+            ir::EqLst *eqs = new ir::EqLst();
+            eqs->push_back(new ir::Equation("eqv", new ir::Product(r, v), w,
+                        NULL));
+            ir::Program p("test.edl", symTab, new ir::DeclLst(), eqs);
+            p.resolveNames();
+            ir::Identifier eq("eqv");
+            p.resolve(&eq);
+            std::cout << "resolution: field: " <<
+                (r->getSymbolKind() == ir::FIELD_SYMBOL) << ", variable: " <<
+                (v->getSymbolKind() == ir::VARIABLE_SYMBOL) << " (" <<
+                v->getIndex() << "), undefined: " <<
+                (w->getSymbolKind() == ir::UNDEFINED_NAME) << ", equation: " <<
+                (eq.getSymbolKind() == ir::EQUATION_NAME) << " (" <<
+                eq.getIndex() << ")\n";
+        }
+#endif
+
+#if 1
+        {
+            size_t n0 = ir::Name::getInternedNumber();
+            std::string s("interned");
+            ir::Name n1(s);
+            ir::Name n2("interned");
+            ir::Identifier a(s), b("interned");
+            std::cout << "names: same handle: " <<
+                (n1.handle() == n2.handle()) << ", identifiers: " <<
+                (a.name == b.name) << ", string compare: " <<
+                (n1 == "interned") << ", new names: " <<
+                ir::Name::getInternedNumber() - n0 << "\n";
+        }
+#endif
+
+#if 1
+        {
+            ir::Identifier fp("fp"), l("l");
+            ir::Identifier *r = new ir::Identifier("r");
+            ir::BinExpr *q = new ir::BinExpr(r, '/', new ir::Identifier("u"));
+            ir::Product e(new ir::BinExpr(fp, '^', ir::Value<int>(2)), q);
+            e.setClearOnDelete(true);
+            ir::UnaryExpr ll(l, '\'');
+            std::cout << "attributes: fp degree: " << e.getFpDegree() <<
+                ", names: " << e.getNames().size() << ", unresolved: " <<
+                e.hasAttr(ir::ATTR_UNRESOLVED) << ", l': " <<
+                ll.hasAttr(ir::ATTR_LL) << "\n";
+            r->bind(NULL, ir::FIELD_SYMBOL);
+            std::cout << "after binding: field: " << e.hasAttr(ir::ATTR_FIELD);
+            q->replace(r, new ir::Sum(fp, *r));
+            delete r;
+            std::cout << ", after rewrite: fp degree: " << e.getFpDegree() <<
+                " (" << (e.getFpDegree() == ir::NOT_FP_MONOMIAL) <<
+                "), field: " << e.hasAttr(ir::ATTR_FIELD) << "\n";
+        }
+#endif
+
+#if 1
+        {
+            ir::Identifier *a = new ir::Identifier("a");
+            ir::EqLst *eqs = new ir::EqLst();
+            eqs->push_back(new ir::Equation("eq1", a, new ir::Identifier("b"),
+                        NULL));
+            eqs->push_back(new ir::Equation("eq2", new ir::Identifier("c"),
+                        new ir::Identifier("d"), NULL));
+            ir::Program p("test.edl", new SymTab(), new ir::DeclLst(), eqs);
+            ir::PassManager passes;
+            int nPassed = 0, nComputed = 0;
+            passes.addEquationPass("count", [&nPassed] (ir::Equation *) {
+                    nPassed++;
+                });
+            auto names = passes.addAnalysis<int>("names",
+                    [&nComputed] (ir::Equation *e) {
+                        nComputed++;
+                        return (int) e->getLHS()->getNames().size();
+                    });
+            passes.run(&p);
+            for (int i=0; i<2; i++) {
+                for (auto e: p.getEqs())
+                    passes.get(names, e);
+            }
+            std::cout << "passes: equations: " << nPassed <<
+                ", analyses: " << nComputed;
+            p.replace(a, new ir::Sum(new ir::Identifier("a"),
+                        new ir::Identifier("e")));
+            delete a;
+            for (auto e: p.getEqs())
+                passes.get(names, e);
+            std::cout << ", after rewrite: " << nComputed << ", names: " <<
+                passes.get(names, p.getEqs().front()) << "\n";
+        }
+#endif
+
 #if 0
         SpheroidalCoord spheroidal;
 
@@ -4,6 +4,7 @@
 namespace logger {
 
 int logger::Printer::verbosity = 0;
+thread_local bool Printer::intercepting = false;
 
 Printer::Printer(const std::string& str, std::ostream& stream, int level) :
     pref(str), os(stream) {
@@ -19,8 +20,16 @@ void Printer::init(int v) {
     Printer::verbosity = v;
 }
 
+bool Printer::printed() const {
+    if (Printer::verbosity < this->level)
+        return false;
+    if (intercepting)
+        throw Interrupt();
+    return true;
+}
+
 std::ostream& Printer::operator<<(const std::string str) {
-    if (Printer::verbosity >= this->level) {
+    if (printed()) {
         os << this->pref << str;
         return this->os;
     }
@@ -28,7 +37,7 @@ std::ostream& Printer::operator<<(const std::string str) {
 }
 
 std::ostream& Printer::operator<<(const char *str) {
-    if (Printer::verbosity >= this->level) {
+    if (printed()) {
         os << this->pref << str;
         return this->os;
     }
@@ -36,12 +45,20 @@ std::ostream& Printer::operator<<(const char *str) {
 }
 
 std::ostream& Printer::stream() {
-    if (this->level > Printer::verbosity) {
+    if (!printed()) {
         return devnull;
     }
     return os;
 }
 
+Printer::Intercept::Intercept() : previous(Printer::intercepting) {
+    Printer::intercepting = true;
+}
+
+Printer::Intercept::~Intercept() {
+    Printer::intercepting = previous;
+}
+
 Printer err("[error]: ",    std::cerr, 0);
 Printer warn("[warning]: ", std::cerr, 1);
 Printer log("[log]: ",      std::cerr, 2);
@@ -6,21 +6,40 @@
 #include <iostream>
 #include <fstream>
 
-extern std::string *filename;
-extern int yylineno;
-
 namespace logger {
 
+/// thrown instead of printing a message on a thread intercepting them
+class Interrupt { };
+
 class Printer {
     std::string pref;
     std::ostream &os;
     std::ofstream devnull;
     int level;
 
+    static thread_local bool intercepting;
+
+    /// messages of this printer are printed at the current verbosity
+    /// (throws Interrupt when intercepted)
+    bool printed() const;
+
     public:
         static int verbosity;
         static void init(int verbosity = 1);
 
+        ///
+        /// While alive, a message the current thread would print throws
+        /// Interrupt instead (before anything is printed, and before the
+        /// caller gets a chance to exit).
+        ///
+        class Intercept {
+            private:
+                bool previous;
+            public:
+                Intercept();
+                ~Intercept();
+        };
+
         Printer(const std::string&, std::ostream&, int level);
         ~Printer();
         std::ostream& stream();